@@ -0,0 +1,47 @@
+#include <benchmark/benchmark.h>
+#include <fixture.hpp>
+
+static void BM_get_api_get_hierarchy(benchmark::State& state) {
+    // half pages, half files
+    const auto entries = static_cast<std::size_t>(state.range(0));
+    auto& f = webber::bench::get_fixture(entries / 2, entries - entries / 2);
+    const auto request = webber::bench::fixture::admin_request("/api/get_hierarchy");
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(webber::get_api_get_hierarchy(request, f.db()));
+    }
+}
+BENCHMARK(BM_get_api_get_hierarchy)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+static void BM_get_api_get_logs(benchmark::State& state) {
+    auto& f = webber::bench::get_fixture(0, 0, static_cast<std::size_t>(state.range(0)));
+    const auto request = webber::bench::fixture::admin_request("/api/get_logs", {{"backlog", 100}});
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(webber::get_api_get_logs(request, f.db()));
+    }
+}
+BENCHMARK(BM_get_api_get_logs)->Arg(10000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+
+// full handle_request path: access log, blacklist check, handler lookup, then the cheapest handler for each case
+static void BM_router_dispatch(benchmark::State& state) {
+    static const std::vector<std::string> endpoints{
+        "/css/main.css", // first handlers entry
+        "/api/reload_settings", // last handlers entry, rejected without a session
+        "/page/0", // no handler, misses the files, falls back to the index
+    };
+
+    auto& f = webber::bench::get_fixture(1);
+    limhamn::http::server::request request{};
+    request.endpoint = endpoints.at(static_cast<std::size_t>(state.range(0)));
+    request.method = "GET";
+    request.ip_address = "127.0.0.1";
+    request.user_agent = "webber_bench";
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(webber::handle_request(request, f.db()));
+    }
+
+    state.SetLabel(request.endpoint);
+}
+BENCHMARK(BM_router_dispatch)->DenseRange(0, 2);
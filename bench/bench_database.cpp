@@ -0,0 +1,40 @@
+#include <benchmark/benchmark.h>
+#include <fixture.hpp>
+
+// download_page appends a visitor on every call, so spread the calls over many pages to keep the rows from growing much
+static void BM_download_page(benchmark::State& state) {
+    const auto pages = static_cast<std::size_t>(state.range(0));
+    auto& f = webber::bench::get_fixture(pages);
+    const webber::UserProperties prop{
+        .username = "",
+        .ip_address = "127.0.0.1",
+        .user_agent = "webber_bench",
+    };
+
+    std::size_t i{0};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(webber::download_page(f.db(), prop, "/page/" + std::to_string(i++ % pages)));
+    }
+}
+BENCHMARK(BM_download_page)->Arg(1000)->Arg(10000);
+
+static void BM_is_file_hit(benchmark::State& state) {
+    const auto files = static_cast<std::size_t>(state.range(0));
+    auto& f = webber::bench::get_fixture(0, files);
+
+    std::size_t i{0};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(webber::is_file(f.db(), "/file/" + std::to_string(i++ % files)));
+    }
+}
+BENCHMARK(BM_is_file_hit)->Arg(1000)->Arg(10000);
+
+// every request that misses the handlers and custom paths pays for this before falling back to the index
+static void BM_is_file_miss(benchmark::State& state) {
+    auto& f = webber::bench::get_fixture(0, static_cast<std::size_t>(state.range(0)));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(webber::is_file(f.db(), "/does/not/exist"));
+    }
+}
+BENCHMARK(BM_is_file_miss)->Arg(1000)->Arg(10000);
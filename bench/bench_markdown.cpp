@@ -0,0 +1,70 @@
+#include <sstream>
+#include <benchmark/benchmark.h>
+#include <maddy/parser.h>
+#include <fixture.hpp>
+#include <markdown.hpp>
+
+static void BM_markdown_to_html(benchmark::State& state) {
+    const std::string markdown = webber::bench::markdown_corpus(static_cast<std::size_t>(state.range(0)));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(webber::markdown_to_html(markdown));
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(markdown.size()));
+}
+BENCHMARK(BM_markdown_to_html)->Arg(1 << 10)->Arg(16 << 10)->Arg(256 << 10);
+
+// what markdown_to_html() used to do: a new parser and a copy of the input for every page
+static void BM_markdown_fresh_parser(benchmark::State& state) {
+    const std::string markdown = webber::bench::markdown_corpus(static_cast<std::size_t>(state.range(0)));
+
+    for (auto _ : state) {
+        maddy::Parser parser{};
+        std::istringstream stream{markdown};
+        benchmark::DoNotOptimize(parser.Parse(stream));
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(markdown.size()));
+}
+BENCHMARK(BM_markdown_fresh_parser)->Arg(1 << 10)->Arg(16 << 10)->Arg(256 << 10);
+
+// a site's worth of pages, mostly small with a few large ones, rendered by one thread's renderer
+static void BM_markdown_corpus(benchmark::State& state) {
+    std::vector<std::string> pages{};
+    std::size_t bytes{0};
+    for (std::size_t i{0}; i < 64; ++i) {
+        const std::size_t size = i % 16 == 15 ? 256 << 10 : i % 4 == 3 ? 16 << 10 : 1 << 10;
+        bytes += pages.emplace_back(webber::bench::markdown_corpus(size)).size();
+    }
+
+    const auto& renderer = webber::markdown_renderer::get_local();
+    for (auto _ : state) {
+        for (const auto& it : pages) {
+            benchmark::DoNotOptimize(renderer.render(it));
+        }
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(pages.size()));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(bytes));
+}
+BENCHMARK(BM_markdown_corpus)->Unit(benchmark::kMillisecond);
+
+// the same corpus, one renderer per benchmark thread
+static void BM_markdown_corpus_threads(benchmark::State& state) {
+    std::vector<std::string> pages{};
+    std::size_t bytes{0};
+    for (std::size_t i{0}; i < 16; ++i) {
+        bytes += pages.emplace_back(webber::bench::markdown_corpus(i % 4 == 3 ? 16 << 10 : 1 << 10)).size();
+    }
+
+    for (auto _ : state) {
+        for (const auto& it : pages) {
+            benchmark::DoNotOptimize(webber::markdown_to_html(it));
+        }
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(pages.size()));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(bytes));
+}
+BENCHMARK(BM_markdown_corpus_threads)->ThreadRange(1, 8)->UseRealTime();
@@ -0,0 +1,37 @@
+#include <fstream>
+#include <benchmark/benchmark.h>
+#include <fixture.hpp>
+#include <scrypto.hpp>
+
+static void BM_sha256hash(benchmark::State& state) {
+    const std::string data(static_cast<std::size_t>(state.range(0)), 'x');
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(scrypto::sha256hash(data));
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_sha256hash)->Arg(64)->Arg(4 << 10)->Arg(1 << 20);
+
+static void BM_sha256hash_file(benchmark::State& state) {
+    const auto& f = webber::bench::get_fixture(0);
+    const std::string path = f.get_directory() + "/hash_input";
+    std::ofstream{path, std::ios::binary | std::ios::trunc} << std::string(static_cast<std::size_t>(state.range(0)), 'x');
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(scrypto::sha256hash_file(path));
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_sha256hash_file)->Arg(4 << 10)->Arg(1 << 20)->Arg(64 << 20);
+
+static void BM_generate_key(benchmark::State& state) {
+    const std::vector<std::string> strings{"username", "password", "127.0.0.1", "Mozilla/5.0"};
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(scrypto::generate_key(strings));
+    }
+}
+BENCHMARK(BM_generate_key);
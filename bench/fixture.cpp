@@ -0,0 +1,183 @@
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <tuple>
+#include <unistd.h>
+#include <fixture.hpp>
+#include <scrypto.hpp>
+
+webber::bench::fixture::fixture() {
+    static int counter{0};
+    this->directory = (std::filesystem::temp_directory_path() / ("webber_bench_" + std::to_string(getpid()) + "_" + std::to_string(counter++))).string();
+
+    std::filesystem::remove_all(this->directory);
+    std::filesystem::create_directories(this->directory + "/data");
+    std::filesystem::create_directories(this->directory + "/temp");
+    std::filesystem::create_directories(this->directory + "/sessions");
+
+    settings.data_directory = this->directory + "/data";
+    settings.temp_directory = this->directory + "/temp";
+    settings.session_directory = this->directory + "/sessions";
+    settings.sqlite_database_file = this->directory + "/webber.db";
+    settings.access_file = this->directory + "/access.log";
+    settings.warning_file = this->directory + "/warning.log";
+    settings.error_file = this->directory + "/error.log";
+    settings.notice_file = this->directory + "/notice.log";
+    settings.enabled_database = false;
+    settings.output_to_std = false;
+    settings.slow_query_threshold = -1;
+
+    logger.override_properties(
+        limhamn::logger::logger_properties{
+            .access_log_file = settings.access_file,
+            .warning_log_file = settings.warning_file,
+            .error_log_file = settings.error_file,
+            .notice_log_file = settings.notice_file,
+            .output_to_std = false,
+            .log_access_to_file = true,
+            .log_warning_to_file = true,
+            .log_error_to_file = true,
+            .log_notice_to_file = true
+        }
+    );
+
+    publish_settings(settings);
+
+    std::ofstream{settings.data_directory + "/index.html"} << "<!DOCTYPE html><html><head><title>webber</title></head><body></body></html>\n";
+    std::ofstream{settings.data_directory + "/style.css"} << "body { margin: 0; }\n";
+
+    this->database_handle = open_database();
+    setup_database(*this->database_handle);
+
+    const int64_t now = scrypto::return_unix_timestamp();
+    insert_into_user_table(*this->database_handle, admin_username, scrypto::password_hash("benchpassword"), admin_key,
+        "bench@localhost", now, now, "127.0.0.1", "webber_bench", UserType::Administrator, "{}");
+}
+
+webber::bench::fixture::~fixture() {
+    this->database_handle.reset();
+
+    std::error_code ec{};
+    std::filesystem::remove_all(this->directory, ec);
+}
+
+webber::database& webber::bench::fixture::db() const {
+    return *this->database_handle;
+}
+
+const std::string& webber::bench::fixture::get_directory() const {
+    return this->directory;
+}
+
+void webber::bench::fixture::add_pages(const std::size_t count, const std::string& markdown) {
+    // the same row upload_page() would write, without its duplicate check, which is quadratic for large fixtures
+    nlohmann::json json;
+    json["username"] = admin_username;
+    json["ip_address"] = "127.0.0.1";
+    json["user_agent"] = "webber_bench";
+    json["uploaded_at"] = json["updated_at"] = scrypto::return_unix_timestamp();
+    json["visits"] = 0;
+    json["input_content_type"] = "markdown";
+    json["output_content_type"] = "html";
+    json["history"] = nlohmann::json::array();
+    json["input_content"] = markdown;
+    json["output_content"] = markdown_to_html(markdown);
+    json["visitors"] = nlohmann::json::array();
+    json["require_admin"] = false;
+    json["require_login"] = false;
+    const std::string dump = json.dump();
+
+    this->db().exec("BEGIN;");
+    for (std::size_t i{0}; i < count; ++i) {
+        this->db().exec("INSERT INTO pages (location, json) VALUES (?, ?);", "/page/" + std::to_string(this->page_count++), dump);
+    }
+    this->db().exec("COMMIT;");
+}
+
+void webber::bench::fixture::add_files(const std::size_t count) {
+    const std::string path = this->directory + "/data/bench_file";
+    std::ofstream{path} << std::string(4096, 'x');
+
+    nlohmann::json json;
+    json["filename"] = "bench_file";
+    json["username"] = admin_username;
+    json["ip_address"] = "127.0.0.1";
+    json["user_agent"] = "webber_bench";
+    json["uploaded_at"] = scrypto::return_unix_timestamp();
+    json["downloads"] = 0;
+    json["downloaders"] = nlohmann::json::array();
+    json["require_admin"] = false;
+    json["require_login"] = false;
+    json["path"] = path;
+    json["size"] = 4096;
+    const std::string dump = json.dump();
+
+    this->db().exec("BEGIN;");
+    for (std::size_t i{0}; i < count; ++i) {
+        this->db().exec("INSERT INTO files (file_path, json) VALUES (?, ?);", "/file/" + std::to_string(this->file_count++), dump);
+    }
+    this->db().exec("COMMIT;");
+}
+
+void webber::bench::fixture::write_logs(const std::size_t lines_per_file) const {
+    const auto snapshot = current_settings();
+    const Settings& s = *snapshot;
+    for (const auto& it : {s.access_file, s.warning_file, s.error_file, s.notice_file}) {
+        std::ofstream file{it, std::ios::trunc};
+        for (std::size_t i{0}; i < lines_per_file; ++i) {
+            file << "[" << 1700000000 + i << "] Request received from 127.0.0.1 to /page/" << i % 1000 << " received, handling it.\n";
+        }
+    }
+}
+
+limhamn::http::server::request webber::bench::fixture::admin_request(const std::string& endpoint, nlohmann::json body) {
+    body["username"] = admin_username;
+    body["key"] = admin_key;
+
+    limhamn::http::server::request request{};
+    request.endpoint = endpoint;
+    request.method = "POST";
+    request.body = body.dump();
+    request.ip_address = "127.0.0.1";
+    request.user_agent = "webber_bench";
+
+    return request;
+}
+
+webber::bench::fixture& webber::bench::get_fixture(const std::size_t pages, const std::size_t files, const std::size_t log_lines) {
+    static std::tuple<std::size_t, std::size_t, std::size_t> current{};
+    static std::unique_ptr<fixture> f{};
+
+    if (f && current == std::make_tuple(pages, files, log_lines)) {
+        return *f;
+    }
+
+    f.reset();
+    f = std::make_unique<fixture>();
+    f->add_pages(pages);
+    f->add_files(files);
+    if (log_lines != 0) {
+        f->write_logs(log_lines);
+    }
+    current = {pages, files, log_lines};
+
+    return *f;
+}
+
+std::string webber::bench::markdown_corpus(const std::size_t size) {
+    std::string ret{};
+    ret.reserve(size + 1024);
+
+    for (std::size_t section{0}; ret.size() < size; ++section) {
+        ret += "## Section " + std::to_string(section) + "\n\n";
+        ret += "Webber stores pages as *markdown* and renders them to **HTML** when they are saved. "
+               "See [the documentation](https://example.com/docs/" + std::to_string(section) + ") for `inline code` and more.\n\n";
+        ret += "- first item\n- second item with a [link](/page/" + std::to_string(section) + ")\n- third item\n\n";
+        ret += "1. ordered\n2. list\n3. entries\n\n";
+        ret += "> a quote that spans\n> two lines\n\n";
+        ret += "```cpp\nint main() {\n    return 0;\n}\n```\n\n";
+        ret += "|name|value|\n|-|-|\n|a|1|\n|b|2|\n\n";
+    }
+
+    return ret;
+}
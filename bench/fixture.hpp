@@ -0,0 +1,47 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <webber.hpp>
+#include <db_abstract.hpp>
+#include <limhamn/http/http_server.hpp>
+#include <nlohmann/json.hpp>
+
+namespace webber::bench {
+    inline constexpr const char* admin_username{"bench"};
+    inline constexpr const char* admin_key{"benchkey"};
+
+    /* a scratch data directory with its own SQLite database, log files and settings
+     *
+     * constructing one points webber::settings at it, so only one should be alive at a time.
+     */
+    class fixture {
+    public:
+        fixture();
+        ~fixture();
+        fixture(const fixture&) = delete;
+        fixture& operator=(const fixture&) = delete;
+
+        [[nodiscard]] database& db() const;
+        [[nodiscard]] const std::string& get_directory() const;
+
+        // pages are named /page/<n> and files /file/<n>
+        void add_pages(std::size_t count, const std::string& markdown = "# Page\n\nSome *content*.\n");
+        void add_files(std::size_t count);
+        void write_logs(std::size_t lines_per_file) const;
+
+        // a request authenticated as the benchmark administrator through the json body
+        [[nodiscard]] static limhamn::http::server::request admin_request(const std::string& endpoint, nlohmann::json body = nlohmann::json::object());
+    private:
+        std::string directory{};
+        std::shared_ptr<database> database_handle{};
+        std::size_t page_count{0};
+        std::size_t file_count{0};
+    };
+
+    // one shared fixture per distinct set of contents, built on first use and reused across benchmark runs
+    fixture& get_fixture(std::size_t pages, std::size_t files = 0, std::size_t log_lines = 0);
+
+    // markdown resembling a real page (headings, lists, links, code, tables), roughly the given size in bytes
+    std::string markdown_corpus(std::size_t size);
+}
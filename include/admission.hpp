@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <semaphore>
+#include <string_view>
+#include <utility>
+#include <limhamn/http/http_server.hpp>
+
+namespace webber {
+    enum class RouteClass : std::size_t {
+        Static, // stylesheet, script, custom paths, files, the index
+        Page, // reading and editing pages, the hierarchy, client settings
+        Auth, // login, registration and setup; bcrypt makes these expensive
+        Upload, // uploading and deleting files
+        Admin, // logs, metrics, traces, server settings
+    };
+
+    inline constexpr std::size_t route_class_count{5};
+
+    struct AdmissionLimit {
+        std::size_t max_concurrent{0}; // 0 = unlimited
+        int64_t max_queue_time{1000}; // milliseconds a request may wait for a slot
+    };
+
+    RouteClass classify_request(const limhamn::http::server::request& request);
+    std::string_view get_route_class_name(RouteClass route_class);
+
+    /* admission control
+     *
+     * bounds the number of requests of each route class that are being handled at once, so that a flood of
+     * uploads or logins can't take every worker and leave cached pages and assets waiting behind them.
+     * a request that can't get a slot before its deadline is turned away instead of queueing indefinitely.
+     *
+     * the per-class limits are set in the configuration and may add up to more than there are workers, so
+     * every class but static also shares one limit of all but a quarter of the workers (at least one). those
+     * are left to static requests, which also go ahead of anything else queued for a worker.
+     */
+    class admission_controller {
+    public:
+        // held for as long as the request is being handled
+        class ticket {
+        public:
+            ticket() = default;
+            ticket(std::counting_semaphore<>* semaphore, std::counting_semaphore<>* shared) : semaphore(semaphore), shared(shared) {}
+            ~ticket() {
+                if (this->semaphore) this->semaphore->release();
+                if (this->shared) this->shared->release();
+            }
+            ticket(ticket&& other) noexcept : semaphore(std::exchange(other.semaphore, nullptr)), shared(std::exchange(other.shared, nullptr)) {}
+            ticket& operator=(ticket&&) = delete;
+            ticket(const ticket&) = delete;
+            ticket& operator=(const ticket&) = delete;
+        private:
+            std::counting_semaphore<>* semaphore{nullptr};
+            std::counting_semaphore<>* shared{nullptr};
+        };
+
+        void start(const std::array<AdmissionLimit, route_class_count>& limits, std::size_t worker_count);
+
+        // nothing if no slot frees up before the deadline
+        std::optional<ticket> admit(RouteClass route_class, std::chrono::steady_clock::time_point deadline);
+        [[nodiscard]] std::chrono::steady_clock::time_point get_deadline(RouteClass route_class, std::chrono::steady_clock::time_point arrival) const;
+    private:
+        std::array<AdmissionLimit, route_class_count> limits{};
+        std::array<std::unique_ptr<std::counting_semaphore<>>, route_class_count> semaphores{};
+        std::unique_ptr<std::counting_semaphore<>> shared{}; // every class but static
+    };
+
+    inline admission_controller admission{};
+}
@@ -1,9 +1,25 @@
 #pragma once
 
 #include <limhamn/database/database.hpp>
+#include <array>
+#include <chrono>
 #include <functional>
+#include <span>
+#include <string_view>
+#include <type_traits>
 
 namespace webber {
+    // what the database wrapper reports about every statement it ran
+    struct query_trace {
+        std::string_view statement{};
+        bool type{false}; // false = sqlite, true = postgres
+        std::chrono::nanoseconds duration{};
+        std::size_t rows{0};
+        std::size_t bytes{0}; // size of the returned rows
+        std::span<const std::size_t> parameter_sizes{}; // the values themselves are never passed on
+        bool ok{true};
+    };
+
         class database {
 #if WEBBER_ENABLE_SQLITE
         limhamn::database::sqlite3_database sqlite{};
@@ -21,43 +37,78 @@ namespace webber {
 #endif
 
         bool enabled_type = false; // false = sqlite, true = postgres
-        std::function<void(const std::string&, bool)> callback;
+        std::function<void(const query_trace&)> tracer;
+
+        template <typename T>
+        static std::size_t parameter_size(const T& arg) {
+            if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+                return std::string_view{arg}.size();
+            } else if constexpr (requires { arg.size(); }) {
+                return arg.size();
+            } else {
+                return sizeof(arg);
+            }
+        }
+
+        // runs the statement and hands the tracer its timing; the statement is logged after it ran, never before
+        template <typename F, typename... Args>
+        auto traced(const std::string& query, F&& f, const Args&... args) {
+            const auto start = std::chrono::steady_clock::now();
+            auto ret = f();
+            if (!this->tracer) {
+                return ret;
+            }
+
+            const std::array<std::size_t, sizeof...(Args)> parameter_sizes{parameter_size(args)...};
+            query_trace trace{};
+            trace.statement = query;
+            trace.type = this->enabled_type;
+            trace.duration = std::chrono::steady_clock::now() - start;
+            trace.parameter_sizes = parameter_sizes;
+            if constexpr (std::is_same_v<decltype(ret), bool>) {
+                trace.ok = ret;
+            } else {
+                trace.rows = ret.size();
+                for (const auto& row : ret) {
+                    for (const auto& [key, value] : row) {
+                        trace.bytes += key.size() + value.size();
+                    }
+                }
+            }
+
+            this->tracer(trace);
+            return ret;
+        }
     public:
-        explicit database(bool type, const std::function<void(const std::string&, bool)>& callback) : enabled_type(type), callback(callback) {}
+        explicit database(bool type, const std::function<void(const query_trace&)>& tracer = {}) : enabled_type(type), tracer(tracer) {}
         std::vector<std::unordered_map<std::string, std::string>> query(const std::string& query) {
             if (!this->enabled_type) {
-                if (this->callback) callback(query, enabled_type);
-                return SQLITE_HANDLE.query(query);
+                return this->traced(query, [&]() { return SQLITE_HANDLE.query(query); });
             }
-
-            if (this->callback) callback(query, enabled_type);
-            return POSTGRES_HANDLE.query(query);
+            return this->traced(query, [&]() { return POSTGRES_HANDLE.query(query); });
         }
         bool exec(const std::string& query) {
             if (!this->enabled_type) {
-                if (this->callback) callback(query, enabled_type);
-                return SQLITE_HANDLE.exec(query);
+                return this->traced(query, [&]() { return SQLITE_HANDLE.exec(query); });
             }
-            if (this->callback) callback(query, enabled_type);
-            return POSTGRES_HANDLE.exec(query);
+            return this->traced(query, [&]() { return POSTGRES_HANDLE.exec(query); });
         }
         template <typename... Args>
         std::vector<std::unordered_map<std::string, std::string>> query(const std::string& query, Args... args) {
             if (!this->enabled_type) {
-                if (this->callback) callback(query, enabled_type);
-                return SQLITE_HANDLE.query(query, args...);
+                return this->traced(query, [&]() { return SQLITE_HANDLE.query(query, args...); }, args...);
             }
-            if (this->callback) callback(query, enabled_type);
-            return POSTGRES_HANDLE.query(query, args...);
+            return this->traced(query, [&]() { return POSTGRES_HANDLE.query(query, args...); }, args...);
         }
         template <typename... Args>
         bool exec(const std::string& query, Args... args) {
             if (!this->enabled_type) {
-                if (this->callback) callback(query, enabled_type);
-                return SQLITE_HANDLE.exec(query, args...);
+                return this->traced(query, [&]() { return SQLITE_HANDLE.exec(query, args...); }, args...);
             }
-            if (this->callback) callback(query, enabled_type);
-            return POSTGRES_HANDLE.exec(query, args...);
+            return this->traced(query, [&]() { return POSTGRES_HANDLE.exec(query, args...); }, args...);
+        }
+        [[nodiscard]] bool is_postgres() const {
+            return this->enabled_type;
         }
         [[nodiscard]] bool good() const {
             return this->enabled_type ? POSTGRES_HANDLE.good() : SQLITE_HANDLE.good();
@@ -73,4 +124,25 @@ namespace webber {
         }
 #endif
     };
-}
\ No newline at end of file
+
+    /* a transaction on one connection, rolled back unless it is committed
+     *
+     * on sqlite it takes the write lock up front (BEGIN IMMEDIATE), so two connections that read rows and then
+     * write them wait for each other instead of one failing or overwriting the other. on postgresql those rows
+     * have to be selected with get_lock_clause() to be locked.
+     */
+    class transaction {
+    public:
+        explicit transaction(database& db);
+        ~transaction();
+        transaction(const transaction&) = delete;
+        transaction& operator=(const transaction&) = delete;
+
+        void commit();
+        // to append to a select of rows that will be written before the commit
+        [[nodiscard]] std::string_view get_lock_clause() const;
+    private:
+        database& db;
+        bool done{false};
+    };
+}
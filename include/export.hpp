@@ -0,0 +1,29 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <nlohmann/json.hpp>
+
+namespace webber {
+    /* static export
+     *
+     * every public page (neither require_login nor require_admin) is written to
+     * <export_directory><location>/index.html as a complete document: index.html with the client settings and
+     * the page embedded, as get_index_page() would send it to a visitor who isn't logged in, and the content in a
+     * <noscript> for clients without javascript. webber serves these without touching the database, and so can
+     * any file server or CDN pointed at the directory.
+     *
+     * a page's document is rewritten whenever its html is stored and removed when the page is removed or stops
+     * being public. --export-pages writes all of them, which is needed after index.html or settings.json change.
+     * visits to exported pages are not counted.
+     */
+
+    // the document for the location, nothing if exports are disabled or the location can't be a path
+    std::optional<std::filesystem::path> get_export_file(const std::string& location);
+    // writes the page (as stored in the pages table) or removes it if it isn't public; never throws
+    void update_export(const std::string& location, const nlohmann::json& page);
+    void remove_export(const std::string& location);
+    // writes every public page and removes documents of pages that are gone or no longer public
+    bool export_pages();
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace webber {
+    /* set of ip address ranges
+     *
+     * holds IPv4 and IPv6 addresses and CIDR ranges (10.0.0.0/8, 2001:db8::/32) in a binary radix tree, keyed
+     * on the bits of the address with IPv4 mapped into ::ffff:0:0/96. a lookup walks at most one node per bit
+     * of the longest prefix on its path, no matter how many ranges the set holds.
+     */
+    class ip_set {
+    public:
+        using address = std::array<uint8_t, 16>;
+
+        // throws std::runtime_error if the entry is neither an address nor a CIDR range
+        void insert(std::string_view entry);
+        [[nodiscard]] bool contains(std::string_view ip_address) const;
+        [[nodiscard]] bool contains(const address& ip_address) const;
+        [[nodiscard]] std::size_t size() const { return this->entries; }
+
+        // nothing if it isn't an address; IPv4 is returned mapped into IPv6
+        static std::optional<address> parse_address(std::string_view ip_address);
+    private:
+        struct node {
+            std::array<uint32_t, 2> children{0, 0}; // 0 = none, the root is never anyone's child
+            bool terminal{false};
+        };
+
+        std::vector<node> nodes{node{}};
+        std::size_t entries{0};
+    };
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <limhamn/logger/logger.hpp>
+
+namespace webber {
+    /* asynchronous logger
+     *
+     * a drop-in for limhamn::logger::logger that keeps disk latency off the request path. write_to_log()
+     * formats the line straight into a preallocated slot of a bounded ring (multiple producers, one consumer)
+     * and returns; a writer thread takes whatever has been queued and writes it to the log files with one
+     * writev() per file. when the ring is full, lines are either dropped and counted or the caller waits.
+     *
+     * lines are written as "<unix time>.<milliseconds> [<type>] <message>".
+     *
+     * the writer also rotates the files: a file that grows too large or too old is renamed to
+     * <file>.<unix time in milliseconds> and reopened, and the rotated segment is gzipped and old segments
+     * are deleted by a low priority thread, so neither ever holds up a request.
+     *
+     * every log file gets a sparse timestamp to offset index (see log_reader.hpp) written alongside it.
+     */
+    class async_logger {
+    public:
+        enum class full_policy {
+            drop,
+            block,
+        };
+
+        struct rotation {
+            int64_t max_size{0}; // bytes, 0 = not rotated by size
+            int64_t max_age{0}; // seconds since the file was opened, 0 = not rotated by age
+            std::size_t keep{0}; // rotated segments kept per file, 0 = all of them
+            bool compress{true};
+        };
+
+        async_logger() = default;
+        ~async_logger();
+        async_logger(const async_logger&) = delete;
+        async_logger& operator=(const async_logger&) = delete;
+
+        // opens the files and starts the writer; until then, lines are written synchronously to stderr
+        void override_properties(const limhamn::logger::logger_properties& properties, std::size_t queue_size = 65536, full_policy policy = full_policy::drop);
+        void set_rotation(const rotation& r);
+        void write_to_log(limhamn::logger::type type, std::string_view message);
+        // the parts are appended straight into the queued line, so the caller doesn't have to concatenate them first
+        template <typename... Parts> requires (sizeof...(Parts) > 1)
+        void write_to_log(limhamn::logger::type type, const Parts&... parts) {
+            uint64_t position{};
+            const std::size_t file = get_file(type);
+            if (std::string* out = this->begin_line(file, position); out != nullptr) {
+                (out->append(std::string_view{parts}), ...);
+                this->end_line(file, position);
+            }
+        }
+
+        // returns once everything logged before the call has been written
+        void flush();
+        // flushes and stops the writer, anything logged afterwards is written synchronously
+        void stop();
+
+        [[nodiscard]] uint64_t get_dropped() const { return this->dropped.load(std::memory_order_relaxed); }
+        [[nodiscard]] std::size_t get_queue_depth() const;
+        // bytes in the file currently being written to
+        [[nodiscard]] uint64_t get_segment_size(limhamn::logger::type type) const;
+    private:
+        struct slot {
+            std::atomic<uint64_t> sequence{0};
+            std::size_t file{0};
+            std::string text{};
+        };
+
+        static constexpr std::size_t file_count{4};
+        static constexpr std::size_t max_batch{512};
+        static constexpr uint64_t direct{UINT64_MAX}; // position of a line that bypasses the ring
+
+        static std::size_t get_file(limhamn::logger::type type);
+        static void format_prefix(std::string& out, std::size_t file);
+        static void crash_handler(int signal);
+
+        void run();
+        std::size_t drain();
+        // the line to append the message to, nullptr if it is dropped; end_line() queues or writes it
+        std::string* begin_line(std::size_t file, uint64_t& position);
+        void end_line(std::size_t file, uint64_t position);
+        void write_all(int fd, std::string_view text) const;
+        void open_files();
+        void close_files();
+        [[nodiscard]] const std::string& get_path(std::size_t file) const;
+        void open_index(std::size_t file);
+        void write_index(std::size_t file, uint64_t offset, std::string_view line);
+        void rotate_if_needed();
+        void rotate(std::size_t file);
+        void compress_segments(std::size_t file);
+        void run_compressor();
+
+        std::unique_ptr<slot[]> slots{};
+        std::size_t capacity{0};
+        full_policy policy{full_policy::drop};
+        alignas(64) std::atomic<uint64_t> tail{0}; // next slot to be claimed by a producer
+        alignas(64) std::atomic<uint64_t> head{0}; // next slot to be written by the writer
+        alignas(64) std::atomic<uint64_t> dropped{0};
+
+        limhamn::logger::logger_properties properties{};
+        bool configured{false};
+        std::array<int, file_count> fds{-1, -1, -1, -1};
+        std::array<std::atomic<uint64_t>, file_count> sizes{};
+        std::array<int, file_count> index_fds{-1, -1, -1, -1};
+        std::array<uint64_t, file_count> indexed{}; // offset of the last index entry, none if no_index
+        static constexpr uint64_t no_index{UINT64_MAX};
+        std::array<std::chrono::steady_clock::time_point, file_count> opened{};
+        std::mutex files_mutex{}; // held while writing to or reopening the files
+
+        std::atomic<int64_t> max_size{0};
+        std::atomic<int64_t> max_age{0};
+        std::atomic<std::size_t> keep{0};
+        std::atomic<bool> compress{true};
+
+        std::thread compressor{};
+        std::mutex compressor_mutex{};
+        std::condition_variable compressor_cv{};
+        std::deque<std::size_t> compressor_queue{}; // files whose rotated segments need compressing and pruning
+        bool compressor_running{false};
+
+        std::thread writer{};
+        std::atomic<bool> running{false};
+        std::atomic<bool> idle{false};
+        std::mutex wake_mutex{};
+        std::condition_variable wake_cv{};
+    };
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace webber {
+    /* live log lines
+     *
+     * the log writer hands every line it writes to the hub. the hub keeps the most recent lines in a bounded
+     * buffer with increasing ids, and subscribers wait for lines newer than the last one they have seen, so a
+     * client reconnecting between long polls gets what was written in between. a subscriber that falls further
+     * behind than the buffer is told it missed lines.
+     */
+    class log_hub {
+    public:
+        struct line {
+            uint64_t id{};
+            std::size_t file{}; // access, warning, error, notice
+            std::string text{};
+        };
+
+        // held by a subscriber for as long as it is waiting for lines
+        class subscription {
+        public:
+            explicit subscription(std::atomic<std::size_t>* subscribers) : subscribers(subscribers) {}
+            ~subscription() { if (this->subscribers) this->subscribers->fetch_sub(1); }
+            subscription(subscription&& other) noexcept : subscribers(std::exchange(other.subscribers, nullptr)) {}
+            subscription& operator=(subscription&&) = delete;
+            subscription(const subscription&) = delete;
+            subscription& operator=(const subscription&) = delete;
+        private:
+            std::atomic<std::size_t>* subscribers{nullptr};
+        };
+
+        // nothing if there are already max_subscribers
+        std::optional<subscription> subscribe(std::size_t max_subscribers);
+
+        void publish(std::span<const std::pair<std::size_t, std::string_view>> lines);
+
+        // at most limit lines newer than cursor from the files in file_mask, waiting up to timeout for the first one.
+        // cursor is advanced past every line looked at, filtered out or not, and missed is set if lines newer than
+        // it had already been evicted from the buffer
+        std::vector<line> wait(uint64_t& cursor, unsigned file_mask, std::size_t limit, std::chrono::milliseconds timeout, bool& missed);
+        [[nodiscard]] uint64_t get_last_id() const;
+    private:
+        static constexpr std::size_t capacity{4096};
+
+        mutable std::mutex mutex{};
+        std::condition_variable cv{};
+        std::deque<line> lines{};
+        uint64_t next_id{1};
+        std::atomic<std::size_t> subscribers{0};
+    };
+
+    inline log_hub live_logs{};
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* reading the log files back
+ *
+ * the logs are only ever appended to, so the lines an administrator wants (the newest) are at the end of
+ * files that may be gigabytes long. these read just the part that is needed.
+ */
+namespace webber::logs {
+    // the last count lines of the file, oldest first, found by reading backwards from the end in blocks
+    std::vector<std::string> read_tail(const std::string& path, std::size_t count);
+    // the first count lines of the file
+    std::vector<std::string> read_head(const std::string& path, std::size_t count);
+
+    /* sparse index
+     *
+     * next to every log file, <file>.idx holds an entry for roughly every index_interval bytes written to it:
+     * the time the line starting at that offset was logged. a search seeks straight to the entry before the
+     * time range it's after instead of reading the file from the start.
+     */
+    struct index_entry {
+        int64_t timestamp{}; // milliseconds since the epoch
+        uint64_t offset{};
+    };
+
+    inline constexpr uint64_t index_interval{64 * 1024};
+
+    struct search_query {
+        int64_t from{0}; // milliseconds since the epoch, inclusive
+        int64_t to{INT64_MAX}; // milliseconds since the epoch, inclusive
+        std::string contains{}; // only lines containing this
+        std::string ip_address{}; // only lines mentioning this address
+        std::size_t limit{1000};
+    };
+
+    struct segment {
+        int64_t rotated_at{}; // milliseconds since the epoch, every line in it was logged before this
+        std::filesystem::path path{}; // <file>.<rotated_at>, or that with .gz once it has been compressed
+    };
+
+    // the rotated segments of the file, oldest first
+    std::vector<segment> get_segments(const std::string& path);
+
+    std::string get_index_path(const std::string& path);
+    // matching lines of the file and its rotated segments in the order they were logged. the current file is
+    // read from its index entry before the range, and only the segments that can hold lines in the range are read
+    std::vector<std::string> search(const std::string& path, const search_query& query);
+
+    // milliseconds since the epoch a line was logged at, nothing if it doesn't start with a timestamp
+    std::optional<int64_t> get_timestamp(std::string_view line);
+
+    // merges files that are each in chronological order into one, lines without a timestamp stay with the line above them
+    std::string merge(const std::vector<std::vector<std::string>>& files);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace maddy {
+    class Parser;
+}
+
+namespace webber {
+    /* markdown renderer
+     *
+     * maddy's parser builds all of its block and inline parsers when it is constructed, and only reads from a
+     * std::istream. a renderer keeps one parser around for as long as it lives and reads the markdown in place
+     * through a stream over the caller's buffer, so rendering neither rebuilds the parser nor copies the input.
+     * a renderer is not thread safe; get_local() returns the calling thread's own.
+     */
+    class markdown_renderer {
+    public:
+        markdown_renderer();
+        ~markdown_renderer();
+        markdown_renderer(const markdown_renderer&) = delete;
+        markdown_renderer& operator=(const markdown_renderer&) = delete;
+
+        [[nodiscard]] std::string render(std::string_view markdown) const;
+
+        static markdown_renderer& get_local();
+    private:
+        std::unique_ptr<maddy::Parser> parser{};
+    };
+
+    /* background rendering
+     *
+     * renders large pages on a few threads of their own, so that saving a page with hundreds of kilobytes of
+     * markdown doesn't hold a request worker (and its database connection) for the whole render. the pool
+     * has no database connection; a job hands whatever it rendered back to a request worker to store.
+     */
+    class render_pool {
+    public:
+        render_pool() = default;
+        ~render_pool();
+        render_pool(const render_pool&) = delete;
+        render_pool& operator=(const render_pool&) = delete;
+
+        void start(std::size_t count);
+        void stop();
+        [[nodiscard]] bool is_running() const;
+
+        void submit(std::function<void()> job);
+        [[nodiscard]] std::size_t get_queue_depth() const;
+    private:
+        void run();
+
+        std::vector<std::thread> threads{};
+        mutable std::mutex mutex{};
+        std::condition_variable cv{};
+        std::deque<std::function<void()>> queue{};
+        bool running{false};
+    };
+
+    inline render_pool renders{};
+}
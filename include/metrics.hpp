@@ -0,0 +1,30 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/* prometheus metrics
+ *
+ * everything is recorded into counters owned by the recording thread, so the hot path never
+ * takes a lock or shares a cache line with another thread. scrape() sums the threads up.
+ */
+namespace webber::metrics {
+    inline std::atomic<int64_t> uploads_in_flight{0};
+
+    // route being handled by the calling thread, set by handle_request and read when recording the request
+    void set_route(std::string_view route);
+    std::string_view get_route();
+
+    void record_request(std::string_view route, int status, std::chrono::nanoseconds duration, std::size_t response_size);
+    void record_query(std::string_view statement, std::chrono::nanoseconds duration, std::size_t rows, std::size_t bytes, bool failed);
+    void record_cache(std::string_view cache, bool hit);
+    void record_shed(std::string_view route_class);
+    void record_rate_limited(std::string_view route_class);
+    void add_upload_bytes(std::size_t bytes);
+    void add_download_bytes(std::size_t bytes);
+
+    std::string scrape();
+}
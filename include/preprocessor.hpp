@@ -0,0 +1,83 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <db_abstract.hpp>
+
+namespace webber {
+    struct PageAccess {
+        bool require_login{false};
+        bool require_admin{false};
+    };
+
+    std::string escape_html(std::string_view str);
+
+    /* markdown preprocessor
+     *
+     * expands the directives in a page's markdown when the page is saved, so that reading it stays a lookup:
+     *
+     * {{meta.title=...}}              the page title
+     * {{meta.<name>=...}}             <meta name="<name>" content="...">, e.g. description or keywords
+     * {{script[...]}}                 javascript, run when the page is shown
+     * {{style[...]}}                  css
+     * {{window.redirect=...}}         sends the visitor to another location
+     * {{include[<location>]}}         another page, rendered
+     * {{template.spoiler[...]}}       markdown hidden until clicked
+     * {{template.<name>[...]}}        the page /template/<name>, with {{content}} replaced by the markdown
+     * {{if(x)[...]}}                  markdown shown if the javascript expression x is true in the browser;
+     * {{else_if(x)[...]}}             may be followed by any number of these
+     * {{else[...]}}                   and one of these
+     *
+     * brackets and parentheses inside a directive must be balanced. anything that isn't a valid directive is
+     * left as it is.
+     *
+     * each directive is replaced by a placeholder and rendered by itself, and the placeholders are replaced
+     * with the html after maddy has rendered the rest, so maddy never sees (or mangles) the directives.
+     * included pages are rendered once per preprocessor no matter how many times they are included, and a
+     * page that (indirectly) includes itself gets a comment instead of recursing. a page is only included if
+     * it is no more restricted than the page including it.
+     *
+     * a preprocessor holds on to what it has rendered, so it should not outlive the save (or batch of saves)
+     * it was made for.
+     */
+    class preprocessor {
+    public:
+        struct expanded {
+            std::string markdown{}; // with a placeholder in place of each directive
+            std::vector<std::string> directives{}; // the html each placeholder stands for
+            std::vector<std::string> dependencies{}; // pages included or used as templates, sorted
+
+            // doesn't need the database, so it can be done on the render pool
+            [[nodiscard]] std::string render() const;
+        };
+
+        explicit preprocessor(database& db) : db(db) {}
+
+        expanded expand(const std::string& location, std::string_view markdown, const PageAccess& access);
+    private:
+        struct fragment {
+            bool found{false};
+            PageAccess access{};
+            std::string html{};
+        };
+
+        void expand_into(expanded& out, std::string_view markdown, const PageAccess& access);
+        // the position after the directive starting at start, or npos if it isn't one
+        std::size_t expand_directive(expanded& out, std::string_view markdown, std::size_t start, const PageAccess& access);
+        std::string render_block(expanded& out, std::string_view markdown, const PageAccess& access);
+        std::string include(expanded& out, const std::string& location, const PageAccess& access);
+        const fragment* get_fragment(const std::string& location);
+
+        database& db;
+        std::unordered_map<std::string, fragment> fragments{};
+        fragment uncached{}; // the last fragment that could not be kept
+        std::vector<std::string> stack{}; // pages being expanded, innermost last
+        std::size_t cycles{0}; // how many times a page included itself, fragments are not kept if it changes
+    };
+
+    void set_page_dependencies(database& db, const std::string& location, const std::vector<std::string>& dependencies);
+    // every page that includes the page, directly or through other pages
+    std::vector<std::string> get_page_dependents(database& db, const std::string& location);
+}
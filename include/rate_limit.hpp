@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <limhamn/http/http_server.hpp>
+
+namespace webber {
+    struct RouteCost {
+        std::string path{}; // the endpoint without its query string, or a path below it, see match_path()
+        double cost{1.0}; // tokens taken per request
+        int64_t bytes_per_token{0}; // one more token per this many bytes of request body, 0 = not weighted by size
+    };
+
+    /* cost-weighted rate limiting
+     *
+     * every ip address, and every logged in user, has a token bucket that refills at a constant rate and holds
+     * at most a minute's worth of tokens. a request takes as many tokens as it costs to serve, so a login (bcrypt)
+     * or an upload (its size) drains the bucket much faster than a stylesheet. downloads are charged once their
+     * size is known, which may leave the bucket in debt until it has refilled.
+     */
+    class rate_limiter {
+    public:
+        // takes the cost from the bucket and returns 0, or returns how many seconds until it could be taken
+        double acquire(const std::string& key, double tokens_per_minute, double cost);
+        void charge(const std::string& key, double tokens_per_minute, double cost);
+        void refund(const std::string& key, double tokens_per_minute, double cost);
+    private:
+        struct bucket {
+            double tokens{0.0};
+            double tokens_per_minute{0.0}; // as of the last update, to tell when it is full again
+            std::chrono::steady_clock::time_point updated{};
+            std::list<std::string>::iterator order{}; // its key in shard::order
+        };
+        struct shard {
+            std::mutex mutex{};
+            std::unordered_map<std::string, bucket> buckets{};
+            std::list<std::string> order{}; // least recently updated first
+            std::chrono::steady_clock::time_point swept{};
+        };
+
+        static constexpr std::size_t shard_count{64};
+        // past this, buckets that are full again are forgotten, and if that isn't enough, the least recently updated
+        static constexpr std::size_t max_buckets_per_shard{16384};
+
+        shard& get_shard(const std::string& key);
+        static bucket& get_bucket(shard& s, const std::string& key, double tokens_per_minute, std::chrono::steady_clock::time_point now);
+        static void make_room(shard& s, std::chrono::steady_clock::time_point now);
+
+        std::array<shard, shard_count> shards{};
+    };
+
+    // tokens the request costs before it is handled; download sizes are charged afterwards
+    double get_request_cost(const limhamn::http::server::request& request);
+
+    inline rate_limiter rate_limits{};
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include <db_abstract.hpp>
+
+namespace webber {
+    /* page revisions
+     *
+     * every version of a page that has been replaced by an update is kept in the page_revisions table rather
+     * than in the page's json, so that reading or saving a page never touches its history. revisions are
+     * numbered from 1 per location. each one stores the metadata of the version (who saved it, when, access)
+     * and its content, compressed with zlib: either in full (a snapshot, every snapshot_interval revisions and
+     * for the first one) or as the edit that turns the previous revision into it. getting a revision reads at
+     * most snapshot_interval rows.
+     *
+     * revisions are numbered by reading the last one, so the functions that add them have to be called in a
+     * transaction that has locked the page (see webber::transaction).
+     */
+    struct PageRevision {
+        int64_t revision{0};
+        nlohmann::json metadata{};
+        std::string input_content{};
+        std::string output_content{};
+    };
+
+    // records the page (as stored in the pages table) before it is replaced by an update from the user
+    void add_page_revision(database& db, const std::string& location, const nlohmann::json& page, const std::string& username, const std::string& ip_address, const std::string& user_agent);
+    // the metadata of every revision, oldest first, with the revision number in "revision"
+    std::vector<nlohmann::json> list_page_revisions(database& db, const std::string& location);
+    std::optional<PageRevision> get_page_revision(database& db, const std::string& location, int64_t revision);
+    void remove_page_revisions(database& db, const std::string& location);
+    // moves the "history" array pages used to keep in their json into page_revisions; returns false if there was none
+    bool migrate_page_history(database& db, const std::string& location, nlohmann::json& page);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <limhamn/http/http_server.hpp>
+
+namespace webber {
+    /* in-memory session store
+     *
+     * sessions are spread over a fixed number of independently locked shards so that
+     * concurrent requests rarely contend, expire after a sliding ttl, and are written to a
+     * single snapshot file periodically and on shutdown so that a restart keeps everyone logged in.
+     */
+    class session_store {
+    public:
+        using session = std::unordered_map<std::string, std::string>;
+
+        session_store() = default;
+        ~session_store();
+        session_store(const session_store&) = delete;
+        session_store& operator=(const session_store&) = delete;
+
+        void start(const std::string& snapshot_file, int64_t ttl, int64_t snapshot_interval);
+        void stop();
+
+        // session belonging to the cookie sent with the request, empty if there is none
+        session get(const limhamn::http::server::request& request);
+        // stores response.session (if any) and sets the session cookie when a new session was created, which is
+        // always the case when it holds credentials
+        void update(const limhamn::http::server::request& request, limhamn::http::server::response& response);
+
+        session find(const std::string& id);
+        void put(const std::string& id, const session& data);
+        void erase(const std::string& id);
+        [[nodiscard]] std::size_t size() const;
+
+        void sweep();
+        bool save();
+        bool load();
+    private:
+        struct entry {
+            session data{};
+            int64_t expires_at{};
+        };
+        struct shard {
+            mutable std::mutex mutex{};
+            std::unordered_map<std::string, entry> entries{};
+        };
+
+        static constexpr std::size_t shard_count{64};
+
+        shard& get_shard(const std::string& id);
+        [[nodiscard]] int64_t get_expiry() const;
+        static std::string get_id(const limhamn::http::server::request& request);
+        static std::string generate_id();
+
+        std::array<shard, shard_count> shards{};
+        std::string snapshot_file{};
+        int64_t ttl{};
+        int64_t snapshot_interval{};
+        std::atomic<uint64_t> generation{0};
+        uint64_t saved_generation{0};
+
+        std::mutex snapshot_mutex{};
+        std::mutex sweeper_mutex{};
+        std::condition_variable sweeper_cv{};
+        std::thread sweeper{};
+        bool running{false};
+    };
+
+    inline session_store sessions{};
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace webber {
+    /* request coalescing
+     *
+     * the first caller for a key does the work, everyone who asks for the same key while it runs waits for
+     * and shares its result (or its exception) instead of doing the same work again.
+     */
+    template <typename V, typename K = std::string>
+    class single_flight {
+    public:
+        struct result {
+            V value;
+            bool shared{false}; // true if another caller did the work
+        };
+
+        template <typename F>
+        result run(const K& key, F&& f) {
+            std::unique_lock lock{this->mutex};
+            if (const auto it = this->calls.find(key); it != this->calls.end()) {
+                std::shared_future<V> future = it->second;
+                lock.unlock();
+                return {future.get(), true};
+            }
+
+            std::promise<V> promise{};
+            this->calls.emplace(key, promise.get_future().share());
+            lock.unlock();
+
+            try {
+                V value = f();
+                promise.set_value(value);
+                this->forget(key);
+                return {std::move(value), false};
+            } catch (...) {
+                promise.set_exception(std::current_exception());
+                this->forget(key);
+                throw;
+            }
+        }
+    private:
+        void forget(const K& key) {
+            std::lock_guard lock{this->mutex};
+            this->calls.erase(key);
+        }
+
+        std::mutex mutex{};
+        std::unordered_map<K, std::shared_future<V>> calls{};
+    };
+}
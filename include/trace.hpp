@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/* request tracing
+ *
+ * a sampled request records a span for each stage it goes through (queueing, login checks, queries,
+ * rendering, file reads, serialization) into a ring buffer owned by the recording thread. dump() turns
+ * the last few seconds of all rings into a Chrome trace, which chrome://tracing and Perfetto can open.
+ * requests that aren't sampled pay for a thread_local check per span and nothing else.
+ */
+namespace webber::trace {
+    using clock = std::chrono::steady_clock;
+
+    // sizes the rings created from now on, in events per thread
+    void set_buffer_size(std::size_t events);
+
+    // starts a request on the calling thread, sampled with the given probability; returns whether it was
+    void begin_request(double sample_rate);
+    void end_request();
+    [[nodiscard]] bool active();
+
+    // records a finished span; names and details must outlive the process (string literals, route names)
+    void record(const char* name, clock::time_point start, clock::time_point end, std::string_view detail = {});
+
+    class span {
+    public:
+        explicit span(const char* name, const std::string_view detail = {}) : name(name), detail(detail) {
+            if (active()) {
+                this->start = clock::now();
+            }
+        }
+        ~span() {
+            if (this->start != clock::time_point{}) {
+                record(this->name, this->start, clock::now(), this->detail);
+            }
+        }
+        span(const span&) = delete;
+        span& operator=(const span&) = delete;
+
+        void set_detail(const std::string_view detail) { this->detail = detail; }
+    private:
+        const char* name{};
+        std::string_view detail{};
+        clock::time_point start{};
+    };
+
+    // the spans of the last `window` across all threads, as Chrome trace event json
+    std::string dump(std::chrono::milliseconds window);
+    // writes dump() to a file in the temp directory and returns its path
+    std::string dump_to_file(std::chrono::milliseconds window);
+}
@@ -1,8 +1,16 @@
 #pragma once
 
 #include <limhamn/logger/logger.hpp>
+#include <log.hpp>
 #include <limhamn/http/http_server.hpp>
 #include <db_abstract.hpp>
+#include <admission.hpp>
+#include <rate_limit.hpp>
+#include <ip_set.hpp>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace webber {
     struct Settings {
@@ -11,6 +19,7 @@ namespace webber {
         std::string warning_file{"/var/log/webber/warning.log"};
         std::string error_file{"/var/log/webber/error.log"};
         std::string notice_file{"/var/log/webber/notice.log"};
+        std::string pid_file{"/var/run/webber.pid"};
         bool output_to_std{false};
         bool halt_on_error{false};
         std::string sqlite_database_file{"/var/db/webber/webber.db"};
@@ -25,6 +34,7 @@ namespace webber {
         std::string warning_file{"./warning.log"};
         std::string error_file{"./error.log"};
         std::string notice_file{"./notice.log"};
+        std::string pid_file{"./webber.pid"};
         std::string sqlite_database_file{"./webber-debug.db"};
         bool output_to_std{true};
         bool halt_on_error{false};
@@ -55,10 +65,53 @@ namespace webber {
         int psql_port{5432};
         bool enabled_database{false}; // false = sqlite, true = postgres
         bool trust_x_forwarded_for{false};
-        int rate_limit{100};
-        std::vector<std::string> blacklisted_ips{};
-        std::vector<std::string> whitelisted_ips{"127.0.0.1"};
+        std::size_t log_queue_size{65536}; // lines waiting for the log writer
+        std::string log_when_full{"drop"}; // drop or block
+        int64_t log_max_size{64 * 1024 * 1024}; // bytes before a log file is rotated, 0 = never
+        int64_t log_max_age{60 * 60 * 24}; // seconds before a log file is rotated, 0 = never
+        std::size_t log_keep{14}; // rotated segments kept per log file, 0 = all of them
+        bool log_compress{true}; // gzip rotated segments
+        std::size_t log_stream_max_subscribers{2}; // each one holds a worker while it waits
+        int64_t log_stream_timeout{10000}; // milliseconds a log stream request waits for new lines
+        int rate_limit{100}; // tokens per ip address per minute, 0 = unlimited
+        int user_rate_limit{300}; // tokens per logged in user per minute, 0 = unlimited
+        std::vector<RouteCost> route_costs{ // first match wins, anything else costs 1
+            {"/api/try_login", 10.0, 0},
+            {"/api/try_register", 10.0, 0},
+            {"/api/try_setup", 10.0, 0},
+            {"/api/upload_file", 1.0, 4 * 1024 * 1024},
+        };
+        int64_t download_bytes_per_token{4 * 1024 * 1024}; // 0 = downloads are not charged by size
+        std::vector<std::string> blacklisted_ips{}; // addresses or CIDR ranges
+        std::vector<std::string> whitelisted_ips{"127.0.0.1"}; // addresses or CIDR ranges
+        std::string blocklist_file{}; // one address or CIDR range per line, added to blacklisted_ips
         int64_t max_file_size_hash{1024 * 1024 * 1024};
+        int workers{0}; // 0 = one per core
+        int render_threads{2}; // threads rendering large pages in the background
+        int64_t background_render_size{256 * 1024}; // bytes of markdown above which a page is rendered in the background, 0 = never
+        std::string export_directory{}; // public pages are exported here, empty = not exported
+        bool serve_exports{true};
+        bool pin_workers{true};
+        int64_t drain_timeout{30}; // seconds
+        int64_t session_ttl{60 * 60 * 24 * 30}; // seconds
+        int64_t session_snapshot_interval{60}; // seconds
+        int64_t slow_query_threshold{100}; // milliseconds, negative disables the slow query log
+        double query_trace_sample_rate{0.0}; // fraction of all queries traced to the notice log
+        double trace_sample_rate{0.01}; // fraction of requests recorded for trace dumps
+        std::size_t trace_buffer_size{16384}; // spans kept per thread
+        std::string metrics_token{}; // lets scrapers read /api/metrics with "Authorization: Bearer <token>", empty = administrators only
+        std::array<AdmissionLimit, route_class_count> admission_limits{{ // indexed by RouteClass
+            {256, 1000}, // static
+            {64, 2000}, // page
+            {8, 1000}, // auth
+            {4, 5000}, // upload
+            {4, 5000}, // admin
+        }};
+
+        // derived from the above by publish_settings(), so that requests don't have to
+        std::unordered_map<std::string, std::string> custom_path_table{};
+        std::shared_ptr<const ip_set> blacklist{std::make_shared<ip_set>()};
+        std::shared_ptr<const ip_set> whitelist{std::make_shared<ip_set>()};
     };
 
     enum class UserType : int {
@@ -130,6 +183,11 @@ namespace webber {
         std::string json{}; // only if requested and user is admin
     };
 
+    struct ClientSettings {
+        std::string body{}; // settings.json merged with the defaults
+        std::string etag{};
+    };
+
     struct RetrievedFile {
         std::string path{};
         std::string name{};
@@ -143,19 +201,54 @@ namespace webber {
         std::string user_agent{};
     };
 
-    inline limhamn::logger::logger logger{};
-    inline Settings settings{};
+    inline async_logger logger{};
+    inline Settings settings{}; // as loaded at startup; requests should use current_settings()
+    inline std::string config_path{};
     inline bool fatal{false};
-    inline bool needs_setup{false};
+    inline std::atomic<bool> needs_setup{false};
+    inline std::atomic<bool> upgrade{false};
+    inline std::atomic<bool> draining{false};
+    inline std::atomic<int64_t> in_flight{0};
 
     void print_help();
     Settings load_settings(const std::string&);
+    Settings parse_settings(const std::string&);
+    void validate_settings(const Settings&);
+    // held for as long as it is used; a reload publishes a new snapshot and the old one is freed by its last holder
+    std::shared_ptr<const Settings> current_settings();
+    void publish_settings(Settings);
+    bool reload_settings();
     std::string get_default_config();
     void prepare_wd();
     void clean_data();
+    bool rerender_pages();
     void server_init();
+    std::shared_ptr<database> open_database();
+    limhamn::http::server::response handle_request(const limhamn::http::server::request&, database&);
+
+    struct Route {
+        std::string_view path{};
+        RouteClass route_class{RouteClass::Static};
+        limhamn::http::server::response (*handler)(const limhamn::http::server::request&, database&){nullptr}; // nullptr if handled elsewhere
+        bool prefix{false}; // also handles the paths below it, such as /api/stream_logs/<types>
+    };
+    // whether the endpoint, without its query string, is the path (or with prefix, a path below it)
+    bool match_path(std::string_view endpoint, std::string_view path, bool prefix);
+    // the api or bundled asset at the endpoint, nullptr if it is neither
+    const Route* find_route(std::string_view endpoint);
+    void handle_signals();
+    void warm_up(database&);
+    // true if a running instance was signalled to hand over; the pid file is then written once this one listens
+    bool take_over();
+    void write_pid_file();
+    // handover: keep accepting until the instance taking over listens on the port too
+    void drain(bool handover = false);
     std::string open_file(const std::string&);
+    // through a temporary file and a rename, so that readers never see half of it
+    void write_file(const std::string&, const std::string&);
     void setup_database(database&);
+    std::string normalize_statement(std::string_view);
+    void trace_query(const query_trace&);
 
     UserType get_user_type(database&, const std::string&);
     bool is_user(database&, const std::string&);
@@ -180,13 +273,24 @@ namespace webber {
 
     bool is_page(database&, const std::string&);
     RetrievedPage download_page(database&, const UserProperties&, const std::string&, bool = false);
+    void record_visit(const std::string&, const UserProperties&);
+    // writes the visits record_visit() has buffered
+    void flush_visits(database&);
     void upload_page(database&, const PageConstruct&);
     void remove_page(database&, const std::string&);
     void update_page(database&, const PageConstruct&);
 
     std::pair<bool, std::string> is_logged_in(const limhamn::http::server::request&, database&, const std::string& = "");
 
-    std::string markdown_to_html(const std::string& markdown);
+    std::string markdown_to_html(std::string_view markdown);
+    // settings.json merged with the defaults, as sent to the client; read once and kept until the
+    // settings are updated through the api or the configuration file is reloaded
+    std::shared_ptr<const ClientSettings> get_client_settings();
+    void reset_client_settings();
+    // what /api/get_page sends for the page
+    std::string get_page_body(const RetrievedPage&);
+    // index.html with the client settings and the /api/get_page response for the path embedded, see main.js
+    std::string get_bootstrapped_index(const std::string& path, const std::string& page);
 
     limhamn::http::server::response get_stylesheet(const limhamn::http::server::request&, database&);
     limhamn::http::server::response get_script(const limhamn::http::server::request&, database&);
@@ -205,5 +309,12 @@ namespace webber {
     limhamn::http::server::response get_api_upload_file(const limhamn::http::server::request&, database&);
     limhamn::http::server::response get_api_delete_file(const limhamn::http::server::request&, database&);
     limhamn::http::server::response get_api_get_hierarchy(const limhamn::http::server::request&, database&);
+    limhamn::http::server::response get_api_get_revisions(const limhamn::http::server::request&, database&);
+    limhamn::http::server::response get_api_get_revision(const limhamn::http::server::request&, database&);
     limhamn::http::server::response get_api_get_logs(const limhamn::http::server::request&, database&);
+    limhamn::http::server::response get_api_reload_settings(const limhamn::http::server::request&, database&);
+    limhamn::http::server::response get_api_metrics(const limhamn::http::server::request&, database&);
+    limhamn::http::server::response get_api_get_trace(const limhamn::http::server::request&, database&);
+    limhamn::http::server::response get_api_stream_logs(const limhamn::http::server::request&, database&);
+    limhamn::http::server::response get_api_search_logs(const limhamn::http::server::request&, database&);
 }
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <db_abstract.hpp>
+
+namespace webber {
+    /* request workers
+     *
+     * each worker is a thread pinned to a core that owns its own database connection, so
+     * handlers never share a connection and anything thread_local on the request path is
+     * effectively per worker. work is handed to the less loaded of two candidate workers, and a worker
+     * takes urgent work before anything else it has queued.
+     */
+    class worker_pool {
+    public:
+        worker_pool() = default;
+        ~worker_pool();
+        worker_pool(const worker_pool&) = delete;
+        worker_pool& operator=(const worker_pool&) = delete;
+
+        void start(std::size_t count, bool pin);
+        void stop();
+        [[nodiscard]] std::size_t size() const;
+
+        template <typename F>
+        auto submit(F&& f, const bool urgent = false) -> std::future<std::invoke_result_t<F, database&>> {
+            using R = std::invoke_result_t<F, database&>;
+            auto task = std::make_shared<std::packaged_task<R(database&)>>(std::forward<F>(f));
+            auto future = task->get_future();
+            this->push([task](database& db) { (*task)(db); }, urgent);
+            return future;
+        }
+    private:
+        struct worker {
+            std::thread thread{};
+            std::mutex mutex{};
+            std::condition_variable cv{};
+            std::deque<std::function<void(database&)>> queue{};
+            std::deque<std::function<void(database&)>> urgent{};
+            std::atomic<std::size_t> depth{0};
+            bool running{true};
+        };
+
+        void push(std::function<void(database&)> task, bool urgent);
+        worker& pick();
+
+        std::vector<std::unique_ptr<worker>> workers{};
+        std::atomic<std::size_t> next{0};
+    };
+
+    inline worker_pool workers{};
+}
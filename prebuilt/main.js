@@ -46,7 +46,31 @@ function include(file) {
     append_to_header(script);
 }
 
+/* the settings and the first page, embedded in index.html by the server so that
+ * the first paint doesn't have to wait for fetching them
+ */
+let bootstrap = null;
+function read_bootstrap() {
+    const element = document.getElementById('webber-bootstrap');
+    if (!element) {
+        return;
+    }
+
+    try {
+        bootstrap = JSON.parse(element.textContent);
+    } catch (error) {
+        console.error('invalid bootstrap data:', error);
+    }
+    element.remove();
+}
+
 async function get_site_settings() {
+    if (bootstrap && bootstrap.settings) {
+        const settings = bootstrap.settings;
+        bootstrap.settings = null;
+        return settings;
+    }
+
     try {
         const response = await fetch('/api/get_settings');
         if (!response.ok) {
@@ -82,7 +106,15 @@ class WindowProperties {
     }
 }
 
+// EventSource following the logs while the log window is open
+let log_stream = null;
+
 function hide_all_windows() {
+    if (log_stream) {
+        log_stream.close();
+        log_stream = null;
+    }
+
     const windows = document.getElementsByClassName('floating_window');
     for (let i = 0; i < windows.length; i++) {
         windows[i].style.display = 'none';
@@ -1579,6 +1611,101 @@ function server_manage(data) {
     hide_all_windows();
 }
 
+async function log_manage(data) {
+    set_path('/admin/logs');
+
+    const win = create_window('log-window');
+
+    const title = document.createElement('h1');
+    const paragraph = document.createElement('p');
+
+    title.innerHTML = 'Logs';
+    paragraph.innerHTML = 'The most recent log lines, followed live as they are written.';
+
+    const view = document.createElement('pre');
+    view.classList = 'log-view';
+
+    const types = ['access', 'warning', 'error', 'notice'];
+    const boxes = {};
+
+    // keeps the view from growing without bound while it is left open
+    function append_line(line) {
+        view.appendChild(document.createTextNode(line + '\n'));
+        while (view.childNodes.length > 1000) {
+            view.removeChild(view.firstChild);
+        }
+        view.scrollTop = view.scrollHeight;
+    }
+
+    async function follow() {
+        if (log_stream) {
+            log_stream.close();
+            log_stream = null;
+        }
+        while (view.firstChild) {
+            view.removeChild(view.firstChild);
+        }
+
+        const selected = types.filter(type => boxes[type].checked);
+        if (selected.length === 0) {
+            return;
+        }
+
+        // the backlog is read once, everything after it arrives through the stream
+        try {
+            const response = await fetch('/api/get_logs', {
+                method: 'POST',
+                headers: {
+                    'Content-Type': 'application/json',
+                },
+                body: JSON.stringify({
+                    get_access: boxes['access'].checked,
+                    get_warnings: boxes['warning'].checked,
+                    get_errors: boxes['error'].checked,
+                    get_notices: boxes['notice'].checked,
+                    backlog: 100,
+                }),
+            });
+            const text = await response.text();
+            for (const line of text.split('\n')) {
+                if (line !== '') {
+                    append_line(line);
+                }
+            }
+        } catch (error) {
+            console.error('Error:', error);
+        }
+
+        log_stream = new EventSource('/api/stream_logs/' + selected.join(','));
+        for (const type of types) {
+            log_stream.addEventListener(type, event => append_line(event.data));
+        }
+        log_stream.addEventListener('missed', event => append_line('-- ' + event.data + ' --'));
+    }
+
+    win.appendChild(title);
+    win.appendChild(paragraph);
+
+    for (const type of types) {
+        const label = document.createElement('label');
+        const box = document.createElement('input');
+        box.type = 'checkbox';
+        box.checked = true;
+        box.onchange = () => {
+            follow();
+        }
+        boxes[type] = box;
+
+        label.appendChild(box);
+        label.appendChild(document.createTextNode(type));
+        win.appendChild(label);
+    }
+
+    win.appendChild(view);
+
+    await follow();
+}
+
 function admin(data) {
     const win = create_window('admin-window');
 
@@ -1613,12 +1740,19 @@ function admin(data) {
         server_manage(data);
     }
 
+    const log_management = document.createElement('button');
+    log_management.innerText = 'Logs';
+    log_management.onclick = () => {
+        log_manage(data);
+    }
+
     win.appendChild(title);
     win.appendChild(paragraph);
     win.appendChild(page_management);
     win.appendChild(file_management);
     win.appendChild(user_management);
     win.appendChild(server_management);
+    win.appendChild(log_management);
 }
 
 function e404(data) {
@@ -1674,6 +1808,11 @@ async function load_page(path, data) {
         reinitialize_content();
         return;
     }
+    if (path === "/admin/logs") {
+        log_manage(data);
+        reinitialize_content();
+        return;
+    }
 
     // /admin/page/...
     if (path.includes('/admin/page/')) {
@@ -1703,18 +1842,24 @@ async function load_page(path, data) {
         const send = { page: path };
 
         try {
-            const response = await fetch(api, {
-                method: 'POST',
-                headers: { 'Content-Type': 'application/json' },
-                body: JSON.stringify(send),
-            });
+            let json;
+            if (bootstrap && bootstrap.page && bootstrap.page.path === path) {
+                json = bootstrap.page.response;
+                bootstrap.page = null; // only good for the first load, the page may change afterwards
+            } else {
+                const response = await fetch(api, {
+                    method: 'POST',
+                    headers: { 'Content-Type': 'application/json' },
+                    body: JSON.stringify(send),
+                });
+
+                if (!response.ok) {
+                    throw new Error('Network response was not ok');
+                }
 
-            if (!response.ok) {
-                throw new Error('Network response was not ok');
+                json = await response.json();
             }
 
-            const json = await response.json();
-
             if (json.error_str) {
                 console.error('Error from server:', json.error_str);
                 return undefined;
@@ -1740,6 +1885,7 @@ async function load_page(path, data) {
     if (content !== undefined && content !== null) {
         const div = document.getElementById('content');
         div.innerHTML += content;
+        run_page_directives(div);
 
         /* replace all links with onclick events to load_page
          * if they're already onclick, ignore
@@ -1955,6 +2101,58 @@ function set_defaults(data) {
     document.head.appendChild(css);
 }
 
+/* the html the markdown preprocessor produces for {{if(...)}} chains and {{script[...]}} */
+function run_page_directives(div) {
+    // each chain starts with an if, keep the first branch whose condition holds and drop the others
+    for (const first of div.querySelectorAll('.webber-if[data-branch="if"]')) {
+        if (!first.isConnected) {
+            continue; // inside a branch that was dropped
+        }
+
+        let taken = false;
+        let branch = first;
+        while (branch && branch.classList.contains('webber-if')) {
+            const type = branch.getAttribute('data-branch');
+            if (branch !== first && type === 'if') {
+                break;
+            }
+
+            const next = branch.nextElementSibling;
+            let take = false;
+            if (!taken) {
+                if (type === 'else') {
+                    take = true;
+                } else {
+                    try {
+                        take = Boolean(new Function('return (' + branch.getAttribute('data-condition') + ');')());
+                    } catch (error) {
+                        console.error('Condition failed:', error);
+                    }
+                }
+            }
+
+            if (take) {
+                taken = true;
+                branch.hidden = false;
+            } else {
+                branch.remove();
+            }
+
+            if (type === 'else') {
+                break;
+            }
+            branch = next;
+        }
+    }
+
+    // scripts added through innerHTML never run, replace each with one that does
+    for (const old of div.querySelectorAll('script')) {
+        const script = document.createElement('script');
+        script.textContent = old.textContent;
+        old.replaceWith(script);
+    }
+}
+
 function reinitialize_content() {
     const footer = document.querySelector('footer');
     const body = document.body;
@@ -2025,6 +2223,7 @@ document.addEventListener('DOMContentLoaded', function() {
     include("https://cdnjs.cloudflare.com/ajax/libs/highlight.js/11.9.0/highlight.min.js");
     include("https://kit.fontawesome.com/aa55cd1c33.js");
 
+    read_bootstrap();
     get_site_settings().then((data) => {
         main(data);
     });
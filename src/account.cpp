@@ -3,6 +3,8 @@
 #include <db_abstract.hpp>
 #include <nlohmann/json.hpp>
 #include <scrypto.hpp>
+#include <session.hpp>
+#include <trace.hpp>
 
 webber::UserType webber::get_user_type(database& database, const std::string& username) {
     for (const auto& it : database.query("SELECT user_type FROM users WHERE username = ?;", username)) {
@@ -91,13 +93,15 @@ void webber::insert_into_user_table(database& database, const std::string& usern
 }
 
 std::pair<bool, std::string> webber::is_logged_in(const limhamn::http::server::request& request, database& db, const std::string& _json ) {
+    const trace::span span{"is_logged_in"};
     std::string username{};
     std::string key{};
-    if (request.session.contains("username")) {
-        username = request.session.at("username");
+    const auto session = sessions.get(request);
+    if (session.contains("username")) {
+        username = session.at("username");
     }
-    if (request.session.contains("key")) {
-        key = request.session.at("key");
+    if (session.contains("key")) {
+        key = session.at("key");
     }
     for (auto& it : db.query("SELECT * FROM users WHERE username = ? AND key = ?;", username, key)) {
         if (it.empty()) {
@@ -197,11 +201,15 @@ webber::AccountCreationStatus webber::make_account(database& database, const std
         }
     }
 
+    const auto snapshot = current_settings();
+
+    const Settings& settings = *snapshot;
+
     if (username.empty()) {
         return webber::AccountCreationStatus::InvalidUsername;
-    } else if (username.size() < webber::settings.username_min_length) {
+    } else if (username.size() < settings.username_min_length) {
         return webber::AccountCreationStatus::UsernameTooShort;
-    } else if (username.size() > webber::settings.username_max_length) {
+    } else if (username.size() > settings.username_max_length) {
         return webber::AccountCreationStatus::UsernameTooLong;
     }
 
@@ -224,15 +232,15 @@ webber::AccountCreationStatus webber::make_account(database& database, const std
     }
 
     for (auto& c : username) {
-        if (std::ranges::find(webber::settings.allowed_characters.begin(), webber::settings.allowed_characters.end(), c) == webber::settings.allowed_characters.end() &&
-                webber::settings.allow_all_characters == false) {
+        if (std::ranges::find(settings.allowed_characters.begin(), settings.allowed_characters.end(), c) == settings.allowed_characters.end() &&
+                settings.allow_all_characters == false) {
             return webber::AccountCreationStatus::InvalidUsername;
         }
     }
 
-    if (password.empty() || password.size() < webber::settings.password_min_length) {
+    if (password.empty() || password.size() < settings.password_min_length) {
         return AccountCreationStatus::PasswordTooShort;
-    } else if (password.size() > webber::settings.password_max_length) {
+    } else if (password.size() > settings.password_max_length) {
         return AccountCreationStatus::PasswordTooLong;
     }
 
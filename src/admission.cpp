@@ -0,0 +1,60 @@
+#include <algorithm>
+#include <utility>
+#include <webber.hpp>
+#include <admission.hpp>
+
+webber::RouteClass webber::classify_request(const limhamn::http::server::request& request) {
+    // anything that isn't an api or bundled asset is served from disk or the database as a static asset
+    const Route* route = find_route(request.endpoint);
+    return route != nullptr ? route->route_class : RouteClass::Static;
+}
+
+std::string_view webber::get_route_class_name(const RouteClass route_class) {
+    switch (route_class) {
+        case RouteClass::Static: return "static";
+        case RouteClass::Page: return "page";
+        case RouteClass::Auth: return "auth";
+        case RouteClass::Upload: return "upload";
+        case RouteClass::Admin: return "admin";
+    }
+
+    return "unknown";
+}
+
+void webber::admission_controller::start(const std::array<AdmissionLimit, route_class_count>& limits, const std::size_t worker_count) {
+    this->limits = limits;
+    for (std::size_t i{0}; i < route_class_count; ++i) {
+        this->semaphores[i].reset();
+        if (limits[i].max_concurrent != 0) {
+            this->semaphores[i] = std::make_unique<std::counting_semaphore<>>(static_cast<std::ptrdiff_t>(limits[i].max_concurrent));
+        }
+    }
+
+    // with a single worker there is nothing to set aside
+    this->shared.reset();
+    if (worker_count > 1) {
+        const std::size_t reserved = std::max<std::size_t>(1, worker_count / 4);
+        this->shared = std::make_unique<std::counting_semaphore<>>(static_cast<std::ptrdiff_t>(worker_count - reserved));
+    }
+}
+
+std::optional<webber::admission_controller::ticket> webber::admission_controller::admit(const RouteClass route_class, const std::chrono::steady_clock::time_point deadline) {
+    auto& semaphore = this->semaphores.at(static_cast<std::size_t>(route_class));
+    if (semaphore && !semaphore->try_acquire_until(deadline)) {
+        return std::nullopt;
+    }
+
+    std::counting_semaphore<>* shared = route_class != RouteClass::Static ? this->shared.get() : nullptr;
+    if (shared && !shared->try_acquire_until(deadline)) {
+        if (semaphore) {
+            semaphore->release();
+        }
+        return std::nullopt;
+    }
+
+    return ticket{semaphore.get(), shared};
+}
+
+std::chrono::steady_clock::time_point webber::admission_controller::get_deadline(const RouteClass route_class, const std::chrono::steady_clock::time_point arrival) const {
+    return arrival + std::chrono::milliseconds(this->limits.at(static_cast<std::size_t>(route_class)).max_queue_time);
+}
@@ -1,5 +1,10 @@
+#include <cctype>
+#include <iomanip>
+#include <random>
 #include <sstream>
 #include <webber.hpp>
+#include <metrics.hpp>
+#include <trace.hpp>
 #include <db_abstract.hpp>
 #include <limhamn/http/http_server.hpp>
 #include <yaml-cpp/yaml.h>
@@ -37,6 +42,31 @@ void webber::setup_database(database& database) {
         throw std::runtime_error{"Error creating the pages table."};
     }
 
+    // page_dependencies -- which pages include (or use as a template) which, so that they can be re-rendered when it changes
+    // location: the location of the including page
+    // dependency: the location of the included page, which does not have to exist
+    if (!database.exec("CREATE TABLE IF NOT EXISTS page_dependencies (location TEXT NOT NULL, dependency TEXT NOT NULL);")) {
+        throw std::runtime_error{"Error creating the page_dependencies table."};
+    }
+    if (!database.exec("CREATE INDEX IF NOT EXISTS page_dependencies_location ON page_dependencies (location);") ||
+        !database.exec("CREATE INDEX IF NOT EXISTS page_dependencies_dependency ON page_dependencies (dependency);")) {
+        throw std::runtime_error{"Error indexing the page_dependencies table."};
+    }
+
+    // page_revisions -- replaced versions of pages, see revisions.hpp
+    // location: the location of the page
+    // revision: numbered from 1 per location
+    // snapshot: 1 if content holds the whole revision, 0 if it holds the edit from the previous one
+    // size: the size of content before it was compressed
+    // content: the edit script (or whole content) for the markdown and the html, zlib compressed and base64 encoded
+    // json: who saved the revision, when, and so on
+    if (!database.exec("CREATE TABLE IF NOT EXISTS page_revisions (" + primary + ", location TEXT NOT NULL, revision bigint NOT NULL, snapshot bigint NOT NULL, size bigint NOT NULL, content TEXT NOT NULL, json TEXT NOT NULL);")) {
+        throw std::runtime_error{"Error creating the page_revisions table."};
+    }
+    if (!database.exec("CREATE UNIQUE INDEX IF NOT EXISTS page_revisions_location_revision ON page_revisions (location, revision);")) {
+        throw std::runtime_error{"Error indexing the page_revisions table."};
+    }
+
     // files -- the file table
     // id: the file id
     // file_path: file path, also known as identifier
@@ -46,6 +76,30 @@ void webber::setup_database(database& database) {
     }
 }
 
+webber::transaction::transaction(database& db) : db(db) {
+    if (!this->db.exec(this->db.is_postgres() ? "BEGIN;" : "BEGIN IMMEDIATE;")) {
+        throw std::runtime_error{"Error starting a transaction."};
+    }
+}
+
+webber::transaction::~transaction() {
+    if (!this->done) {
+        this->db.exec("ROLLBACK;");
+    }
+}
+
+void webber::transaction::commit() {
+    this->done = true;
+    if (!this->db.exec("COMMIT;")) {
+        this->db.exec("ROLLBACK;");
+        throw std::runtime_error{"Error committing a transaction."};
+    }
+}
+
+std::string_view webber::transaction::get_lock_clause() const {
+    return this->db.is_postgres() ? " FOR UPDATE" : "";
+}
+
 std::string webber::get_json_from_table(database& db, const std::string& table, const std::string& key, const std::string& value) {
     if (!db.good()) {
         throw std::runtime_error{"Database is not good."};
@@ -76,4 +130,104 @@ bool webber::set_json_in_table(database& db, const std::string& table, const std
     }
 
     return db.exec("UPDATE ? SET json = ? WHERE ? = ?;", table, json, key, value);
-}
\ No newline at end of file
+}
+
+std::string webber::normalize_statement(const std::string_view statement) {
+    std::string ret{};
+    ret.reserve(statement.size());
+
+    // literals become placeholders, so that the same statement with different values is aggregated once
+    // and no values end up in the logs or metrics
+    for (std::size_t i{0}; i < statement.size(); ++i) {
+        const char c = statement[i];
+        if (c == '\'') {
+            ++i;
+            while (i < statement.size()) {
+                if (statement[i] == '\'' && i + 1 < statement.size() && statement[i + 1] == '\'') {
+                    i += 2;
+                    continue;
+                }
+                if (statement[i] == '\'') {
+                    break;
+                }
+                ++i;
+            }
+            ret += '?';
+        } else if (std::isdigit(static_cast<unsigned char>(c)) && (ret.empty() || !(std::isalnum(static_cast<unsigned char>(ret.back())) || ret.back() == '_'))) {
+            while (i + 1 < statement.size() && (std::isdigit(static_cast<unsigned char>(statement[i + 1])) || statement[i + 1] == '.')) {
+                ++i;
+            }
+            ret += '?';
+        } else if (std::isspace(static_cast<unsigned char>(c))) {
+            if (!ret.empty() && ret.back() != ' ') {
+                ret += ' ';
+            }
+        } else {
+            ret += c;
+        }
+    }
+
+    while (!ret.empty() && ret.back() == ' ') {
+        ret.pop_back();
+    }
+
+    return ret;
+}
+
+void webber::trace_query(const query_trace& trace) {
+    struct string_hash {
+        using is_transparent = void;
+        std::size_t operator()(const std::string_view str) const {
+            return std::hash<std::string_view>{}(str);
+        }
+    };
+
+    // statements are parameterized, so each thread only ever normalizes a few dozen of them
+    thread_local std::unordered_map<std::string, std::string, string_hash, std::equal_to<>> normalized{};
+    auto it = normalized.find(trace.statement);
+    if (it == normalized.end()) {
+        if (normalized.size() >= 1024) {
+            normalized.clear();
+        }
+        it = normalized.try_emplace(std::string{trace.statement}, normalize_statement(trace.statement)).first;
+    }
+    const std::string& statement = it->second;
+
+    metrics::record_query(statement, trace.duration, trace.rows, trace.bytes, !trace.ok);
+    if (trace::active()) {
+        const auto now = trace::clock::now();
+        trace::record("query", now - std::chrono::duration_cast<trace::clock::duration>(trace.duration), now);
+    }
+
+    const auto snapshot = current_settings();
+
+    const Settings& settings = *snapshot;
+    const bool slow = settings.slow_query_threshold >= 0 && trace.duration >= std::chrono::milliseconds(settings.slow_query_threshold);
+
+    bool sampled{false};
+    if (!slow && settings.query_trace_sample_rate > 0.0) {
+        thread_local std::minstd_rand rng{std::random_device{}()};
+        sampled = std::uniform_real_distribution<double>{0.0, 1.0}(rng) < settings.query_trace_sample_rate;
+    }
+
+    if (!slow && !sampled) {
+        return;
+    }
+
+    std::ostringstream ss{};
+    ss << (slow ? "Slow query" : "Query trace") << " (" << std::fixed << std::setprecision(3)
+       << std::chrono::duration<double, std::milli>(trace.duration).count() << " ms, "
+       << trace.rows << " rows, " << trace.bytes << " bytes, " << (trace.type ? "PostgreSQL" : "SQLite")
+       << (trace.ok ? "" : ", failed") << "): " << statement;
+
+    if (!trace.parameter_sizes.empty()) {
+        ss << " parameters: [";
+        for (std::size_t i{0}; i < trace.parameter_sizes.size(); ++i) {
+            ss << (i == 0 ? "" : ", ") << "<redacted, " << trace.parameter_sizes[i] << " bytes>";
+        }
+        ss << "]";
+    }
+    ss << "\n";
+
+    logger.write_to_log(slow ? limhamn::logger::type::warning : limhamn::logger::type::notice, ss.str());
+}
@@ -0,0 +1,132 @@
+#include <fstream>
+#include <iostream>
+#include <unordered_set>
+#include <webber.hpp>
+#include <export.hpp>
+
+namespace {
+    std::string get_document(const std::string& location, const webber::RetrievedPage& page) {
+        std::string html = webber::get_bootstrapped_index(location, webber::get_page_body(page));
+
+        const std::size_t pos = html.rfind("</body>");
+        html.insert(pos == std::string::npos ? html.size() : pos, "<noscript>" + page.output_content + "</noscript>");
+
+        return html;
+    }
+
+    // returns false if the page isn't public and shouldn't be exported
+    bool write_export(const std::string& location, const nlohmann::json& json) {
+        const auto file = webber::get_export_file(location);
+        if (!file) {
+            return false;
+        }
+
+        webber::RetrievedPage page{};
+        page.require_login = json.value("require_login", false);
+        page.require_admin = json.value("require_admin", false);
+        if (page.require_login || page.require_admin) {
+            std::filesystem::remove(*file);
+            return false;
+        }
+
+        page.input_content = json.value("input_content", "");
+        page.output_content = json.value("output_content", "");
+        page.input_content_type = json.value("input_content_type", "");
+        page.output_content_type = json.value("output_content_type", "");
+
+        std::filesystem::create_directories(file->parent_path());
+        webber::write_file(file->string(), get_document(location, page));
+        return true;
+    }
+}
+
+std::optional<std::filesystem::path> webber::get_export_file(const std::string& location) {
+    const std::string directory = current_settings()->export_directory;
+    if (directory.empty() || location.empty() || location.front() != '/' || location.find('\0') != std::string::npos) {
+        return std::nullopt;
+    }
+
+    // the location is appended to the directory, it must not be able to leave it
+    const std::filesystem::path relative = std::filesystem::path{location}.relative_path().lexically_normal();
+    for (const auto& it : relative) {
+        if (it == "..") {
+            return std::nullopt;
+        }
+    }
+
+    return std::filesystem::path{directory} / relative / "index.html";
+}
+
+void webber::update_export(const std::string& location, const nlohmann::json& page) {
+    try {
+        write_export(location, page);
+    } catch (const std::exception& e) {
+        logger.write_to_log(limhamn::logger::type::warning, "Failed to export ", location, ": ", e.what(), "\n");
+    }
+}
+
+void webber::remove_export(const std::string& location) {
+    try {
+        if (const auto file = get_export_file(location)) {
+            std::filesystem::remove(*file);
+        }
+    } catch (const std::exception& e) {
+        logger.write_to_log(limhamn::logger::type::warning, "Failed to remove the export of ", location, ": ", e.what(), "\n");
+    }
+}
+
+bool webber::export_pages() {
+    publish_settings(settings);
+
+    if (settings.export_directory.empty()) {
+        std::cerr << "pages.export_directory is not set.\n";
+        return false;
+    }
+
+    const auto db = open_database();
+
+    std::unordered_set<std::string> exported{};
+    std::size_t failed{0};
+
+    // a batch at a time, in id order, so that the whole table is never in memory at once
+    constexpr std::size_t batch_size{256};
+    std::string last_id{"0"};
+    while (true) {
+        const auto query = db->query("SELECT id, location, json FROM pages WHERE id > ? ORDER BY id LIMIT " + std::to_string(batch_size) + ";", last_id);
+        for (const auto& it : query) {
+            if (!it.contains("id") || !it.contains("location") || !it.contains("json")) {
+                continue;
+            }
+
+            last_id = it.at("id");
+            try {
+                if (write_export(it.at("location"), nlohmann::json::parse(it.at("json")))) {
+                    exported.insert(get_export_file(it.at("location"))->lexically_normal().string());
+                }
+            } catch (const std::exception& e) {
+                ++failed;
+                logger.write_to_log(limhamn::logger::type::error, "Failed to export ", it.at("location"), ": ", e.what(), "\n");
+            }
+        }
+
+        std::cerr << "\r" << exported.size() << " pages exported" << std::flush;
+        if (query.size() < batch_size) {
+            break;
+        }
+    }
+
+    // documents of pages that were removed while exports were off, or are no longer public
+    std::size_t removed{0};
+    std::error_code ec{};
+    for (auto it = std::filesystem::recursive_directory_iterator{settings.export_directory, ec}; !ec && it != std::filesystem::recursive_directory_iterator{}; it.increment(ec)) {
+        if (it->is_regular_file(ec) && it->path().filename() == "index.html" && !exported.contains(it->path().lexically_normal().string())) {
+            std::filesystem::remove(it->path(), ec);
+            ++removed;
+        }
+    }
+
+    std::cerr << "\nExported " << exported.size() << " pages, removed " << removed << " stale pages, " << failed << " failed.\n";
+    logger.write_to_log(limhamn::logger::type::notice, "Exported ", std::to_string(exported.size()), " pages to ", settings.export_directory, ".\n");
+
+    return failed == 0;
+}
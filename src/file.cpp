@@ -45,9 +45,9 @@ std::string webber::upload_file(database& db, const webber::FileConstruct& c) {
     std::string file_key = scrypto::generate_random_string(16);
     std::string key = scrypto::generate_random_string(16);
 
-    std::filesystem::remove(webber::settings.data_directory + "/" + key);
+    std::filesystem::remove(webber::current_settings()->data_directory + "/" + key);
 
-    std::filesystem::path dir{webber::settings.data_directory + "/" + key};
+    std::filesystem::path dir{webber::current_settings()->data_directory + "/" + key};
     if (!std::filesystem::is_directory(dir)) {
         std::filesystem::create_directories(dir);
     }
@@ -61,7 +61,7 @@ std::string webber::upload_file(database& db, const webber::FileConstruct& c) {
     json["path"] = dir;
     json["size"] = std::filesystem::file_size(dir);
 
-    if (std::filesystem::file_size(dir) <= webber::settings.max_file_size_hash) {
+    if (std::filesystem::file_size(dir) <= webber::current_settings()->max_file_size_hash) {
         json["sha256"] = scrypto::sha256hash_file(dir);
     }
 
@@ -0,0 +1,108 @@
+#include <charconv>
+#include <stdexcept>
+#include <arpa/inet.h>
+#include <ip_set.hpp>
+
+std::optional<webber::ip_set::address> webber::ip_set::parse_address(const std::string_view ip_address) {
+    const std::string str{ip_address};
+    address ret{};
+
+    if (in_addr v4{}; inet_pton(AF_INET, str.c_str(), &v4) == 1) {
+        ret[10] = 0xff;
+        ret[11] = 0xff;
+        const auto* bytes = reinterpret_cast<const uint8_t*>(&v4.s_addr);
+        std::copy(bytes, bytes + 4, ret.begin() + 12);
+        return ret;
+    }
+    if (in6_addr v6{}; inet_pton(AF_INET6, str.c_str(), &v6) == 1) {
+        std::copy(v6.s6_addr, v6.s6_addr + 16, ret.begin());
+        return ret;
+    }
+
+    return std::nullopt;
+}
+
+void webber::ip_set::insert(const std::string_view entry) {
+    const std::size_t slash = entry.find('/');
+    const std::string_view ip_address = entry.substr(0, slash);
+
+    const auto addr = parse_address(ip_address);
+    if (!addr) {
+        throw std::runtime_error{"Invalid IP address or range: " + std::string{entry}};
+    }
+
+    const bool v4 = ip_address.find(':') == std::string_view::npos;
+    std::size_t prefix = v4 ? 32 : 128;
+    if (slash != std::string_view::npos) {
+        const std::string_view length = entry.substr(slash + 1);
+        const auto [ptr, ec] = std::from_chars(length.data(), length.data() + length.size(), prefix);
+        if (ec != std::errc{} || ptr != length.data() + length.size() || prefix > (v4 ? 32u : 128u)) {
+            throw std::runtime_error{"Invalid prefix length: " + std::string{entry}};
+        }
+    }
+    if (v4) {
+        prefix += 96;
+    }
+
+    uint32_t current{0};
+    for (std::size_t i{0}; i < prefix; ++i) {
+        // a shorter range already covers everything below it
+        if (this->nodes[current].terminal) {
+            return;
+        }
+
+        const std::size_t bit = ((*addr)[i / 8] >> (7 - i % 8)) & 1;
+        if (this->nodes[current].children[bit] == 0) {
+            this->nodes[current].children[bit] = static_cast<uint32_t>(this->nodes.size());
+            this->nodes.emplace_back();
+        }
+        current = this->nodes[current].children[bit];
+    }
+
+    if (!this->nodes[current].terminal) {
+        // the longer ranges below it are covered by this one now, and no longer count as entries
+        std::vector<uint32_t> stack{this->nodes[current].children[0], this->nodes[current].children[1]};
+        while (!stack.empty()) {
+            const uint32_t it = stack.back();
+            stack.pop_back();
+            if (it == 0) {
+                continue;
+            }
+
+            if (this->nodes[it].terminal) {
+                --this->entries;
+            }
+            stack.push_back(this->nodes[it].children[0]);
+            stack.push_back(this->nodes[it].children[1]);
+        }
+
+        this->nodes[current].terminal = true;
+        this->nodes[current].children = {0, 0};
+        ++this->entries;
+    }
+}
+
+bool webber::ip_set::contains(const address& ip_address) const {
+    uint32_t current{0};
+    for (std::size_t i{0}; i < 128; ++i) {
+        if (this->nodes[current].terminal) {
+            return true;
+        }
+
+        current = this->nodes[current].children[(ip_address[i / 8] >> (7 - i % 8)) & 1];
+        if (current == 0) {
+            return false;
+        }
+    }
+
+    return this->nodes[current].terminal;
+}
+
+bool webber::ip_set::contains(const std::string_view ip_address) const {
+    if (this->entries == 0) {
+        return false;
+    }
+
+    const auto addr = parse_address(ip_address);
+    return addr && this->contains(*addr);
+}
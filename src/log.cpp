@@ -0,0 +1,627 @@
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <csignal>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <log.hpp>
+#include <log_hub.hpp>
+#include <log_reader.hpp>
+
+namespace {
+    constexpr std::array<std::string_view, 4> file_names{"access", "warning", "error", "notice"};
+
+    // lines written synchronously, while there is no writer
+    thread_local std::string direct_line{};
+
+    // the logger whose queued lines are written out if the process crashes
+    std::atomic<webber::async_logger*> crash_target{nullptr};
+
+    // writes every iovec, resuming after partial writes
+    void write_iovecs(const int fd, iovec* iov, int count) {
+        while (count > 0) {
+            const ssize_t written = writev(fd, iov, std::min(count, IOV_MAX));
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return;
+            }
+
+            auto remaining = static_cast<std::size_t>(written);
+            while (count > 0 && remaining >= iov->iov_len) {
+                remaining -= iov->iov_len;
+                ++iov;
+                --count;
+            }
+            if (count > 0) {
+                iov->iov_base = static_cast<char*>(iov->iov_base) + remaining;
+                iov->iov_len -= remaining;
+            }
+        }
+    }
+
+    // writes in.gz next to in through a temporary file, so that a half written archive is never mistaken for a segment
+    bool gzip_file(const std::filesystem::path& in, const std::filesystem::path& out) {
+        std::ifstream file{in, std::ios::binary};
+        if (!file.is_open()) {
+            return false;
+        }
+
+        const std::filesystem::path temp = out.string() + ".tmp";
+        gzFile gz = gzopen(temp.c_str(), "wb6");
+        if (gz == nullptr) {
+            return false;
+        }
+
+        std::array<char, 64 * 1024> buf{};
+        bool ok{true};
+        while (ok && file) {
+            file.read(buf.data(), buf.size());
+            if (const auto n = static_cast<unsigned>(file.gcount()); n != 0) {
+                ok = gzwrite(gz, buf.data(), n) == static_cast<int>(n);
+            }
+        }
+        ok = gzclose(gz) == Z_OK && ok;
+
+        std::error_code ec;
+        if (!ok) {
+            std::filesystem::remove(temp, ec);
+            return false;
+        }
+
+        std::filesystem::rename(temp, out, ec);
+        return !ec;
+    }
+
+    int64_t get_unix_milliseconds() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+}
+
+webber::async_logger::~async_logger() {
+    this->stop();
+    this->close_files();
+}
+
+std::size_t webber::async_logger::get_file(const limhamn::logger::type type) {
+    switch (type) {
+        case limhamn::logger::type::access: return 0;
+        case limhamn::logger::type::warning: return 1;
+        case limhamn::logger::type::error: return 2;
+        case limhamn::logger::type::notice: return 3;
+    }
+
+    return 3;
+}
+
+void webber::async_logger::format_prefix(std::string& out, const std::size_t file) {
+    timespec ts{};
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    std::array<char, 32> buf{};
+    auto* end = std::to_chars(buf.data(), buf.data() + buf.size(), static_cast<int64_t>(ts.tv_sec)).ptr;
+    const auto millis = static_cast<int>(ts.tv_nsec / 1000000);
+    *end++ = '.';
+    *end++ = static_cast<char>('0' + millis / 100);
+    *end++ = static_cast<char>('0' + millis / 10 % 10);
+    *end++ = static_cast<char>('0' + millis % 10);
+
+    out.clear();
+    out.append(buf.data(), end);
+    out.append(" [");
+    out.append(file_names[file]);
+    out.append("] ");
+}
+
+void webber::async_logger::override_properties(const limhamn::logger::logger_properties& properties, const std::size_t queue_size, const full_policy policy) {
+    this->stop();
+
+    {
+        std::lock_guard lock{this->files_mutex};
+        this->properties = properties;
+        this->configured = true;
+        this->close_files();
+        this->open_files();
+    }
+
+    this->policy = policy;
+    this->capacity = std::bit_ceil(std::max<std::size_t>(queue_size, 2));
+    this->slots = std::make_unique<slot[]>(this->capacity);
+    for (std::size_t i{0}; i < this->capacity; ++i) {
+        this->slots[i].sequence.store(i, std::memory_order_relaxed);
+        this->slots[i].text.reserve(256);
+    }
+    this->head.store(0, std::memory_order_relaxed);
+    this->tail.store(0, std::memory_order_relaxed);
+
+    this->running.store(true, std::memory_order_release);
+    this->writer = std::thread{[this]() { this->run(); }};
+
+    // catch up on segments rotated before the last shutdown but never compressed or pruned
+    {
+        std::lock_guard lock{this->compressor_mutex};
+        this->compressor_running = true;
+        for (std::size_t i{0}; i < file_count; ++i) {
+            this->compressor_queue.push_back(i);
+        }
+    }
+    this->compressor = std::thread{[this]() { this->run_compressor(); }};
+
+    // whatever is still queued when the process dies is what explains why it died
+    if (crash_target.exchange(this) == nullptr) {
+        // std::exit() runs this before destroying the globals that may still log while being destroyed
+        std::atexit([]() {
+            if (async_logger* l = crash_target.load(); l != nullptr) {
+                l->stop();
+            }
+        });
+
+        struct sigaction action{};
+        action.sa_handler = &async_logger::crash_handler;
+        action.sa_flags = static_cast<int>(SA_RESETHAND);
+        sigemptyset(&action.sa_mask);
+        for (const int signal : {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT}) {
+            sigaction(signal, &action, nullptr);
+        }
+    }
+}
+
+void webber::async_logger::open_files() {
+    const std::array<std::pair<const std::string*, bool>, file_count> files{{
+        {&this->properties.access_log_file, this->properties.log_access_to_file},
+        {&this->properties.warning_log_file, this->properties.log_warning_to_file},
+        {&this->properties.error_log_file, this->properties.log_error_to_file},
+        {&this->properties.notice_log_file, this->properties.log_notice_to_file},
+    }};
+
+    for (std::size_t i{0}; i < file_count; ++i) {
+        if (!files[i].second || files[i].first->empty()) {
+            continue;
+        }
+
+        this->fds[i] = open(files[i].first->c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (this->fds[i] < 0) {
+            const std::string error = "Failed to open the log file " + *files[i].first + ".\n";
+            this->write_all(STDERR_FILENO, error);
+            continue;
+        }
+
+        struct stat st{};
+        this->sizes[i].store(fstat(this->fds[i], &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0, std::memory_order_relaxed);
+        this->opened[i] = std::chrono::steady_clock::now();
+        this->open_index(i);
+    }
+}
+
+void webber::async_logger::open_index(const std::size_t file) {
+    this->indexed[file] = no_index;
+    this->index_fds[file] = open(logs::get_index_path(this->get_path(file)).c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (this->index_fds[file] < 0) {
+        return;
+    }
+
+    // an index that doesn't fit the file (torn write, file replaced behind our back) is started over
+    struct stat st{};
+    logs::index_entry last{};
+    if (fstat(this->index_fds[file], &st) != 0 || st.st_size % static_cast<off_t>(sizeof(last)) != 0 ||
+        (st.st_size != 0 && pread(this->index_fds[file], &last, sizeof(last), st.st_size - static_cast<off_t>(sizeof(last))) != sizeof(last)) ||
+        last.offset > this->sizes[file].load(std::memory_order_relaxed)) {
+        static_cast<void>(ftruncate(this->index_fds[file], 0));
+        return;
+    }
+
+    if (st.st_size != 0) {
+        this->indexed[file] = last.offset;
+    }
+}
+
+void webber::async_logger::write_index(const std::size_t file, const uint64_t offset, const std::string_view line) {
+    if (this->index_fds[file] < 0 || (this->indexed[file] != no_index && offset - this->indexed[file] < logs::index_interval)) {
+        return;
+    }
+
+    const auto timestamp = logs::get_timestamp(line);
+    if (!timestamp) {
+        return;
+    }
+
+    const logs::index_entry entry{*timestamp, offset};
+    if (write(this->index_fds[file], &entry, sizeof(entry)) == sizeof(entry)) {
+        this->indexed[file] = offset;
+    }
+}
+
+void webber::async_logger::close_files() {
+    for (auto& fd : this->fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        fd = -1;
+    }
+    for (auto& fd : this->index_fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        fd = -1;
+    }
+}
+
+void webber::async_logger::write_all(const int fd, std::string_view text) const {
+    while (!text.empty()) {
+        const ssize_t written = write(fd, text.data(), text.size());
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        text.remove_prefix(static_cast<std::size_t>(written));
+    }
+}
+
+std::string* webber::async_logger::begin_line(const std::size_t file, uint64_t& position) {
+    // not started yet or stopped: format into a buffer of our own and write it synchronously
+    if (!this->running.load(std::memory_order_acquire)) {
+        format_prefix(direct_line, file);
+        position = direct;
+        return &direct_line;
+    }
+
+    const std::size_t mask = this->capacity - 1;
+    position = this->tail.load(std::memory_order_relaxed);
+    slot* s{nullptr};
+    while (true) {
+        s = &this->slots[position & mask];
+        const uint64_t sequence = s->sequence.load(std::memory_order_acquire);
+        const auto diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(position);
+
+        if (diff == 0) {
+            if (this->tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // full: the writer hasn't caught up with this lap yet
+            if (this->policy == full_policy::drop) {
+                this->dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            std::this_thread::yield();
+            position = this->tail.load(std::memory_order_relaxed);
+        } else {
+            position = this->tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    s->file = file;
+    format_prefix(s->text, file);
+    return &s->text;
+}
+
+void webber::async_logger::end_line(const std::size_t file, const uint64_t position) {
+    if (position == direct) {
+        if (direct_line.back() != '\n') {
+            direct_line.push_back('\n');
+        }
+
+        std::lock_guard lock{this->files_mutex};
+        if (this->fds[file] >= 0) {
+            this->write_all(this->fds[file], direct_line);
+            this->sizes[file].fetch_add(direct_line.size(), std::memory_order_relaxed);
+        }
+        if (this->properties.output_to_std || !this->configured) {
+            this->write_all(file == 1 || file == 2 ? STDERR_FILENO : STDOUT_FILENO, direct_line);
+        }
+
+        return;
+    }
+
+    slot& s = this->slots[position & (this->capacity - 1)];
+    if (s.text.back() != '\n') {
+        s.text.push_back('\n');
+    }
+    s.sequence.store(position + 1, std::memory_order_release);
+
+    if (this->idle.load(std::memory_order_relaxed)) {
+        this->wake_cv.notify_one();
+    }
+}
+
+void webber::async_logger::write_to_log(const limhamn::logger::type type, const std::string_view message) {
+    uint64_t position{};
+    const std::size_t file = get_file(type);
+    if (std::string* out = this->begin_line(file, position); out != nullptr) {
+        out->append(message);
+        this->end_line(file, position);
+    }
+}
+
+std::size_t webber::async_logger::drain() {
+    const std::size_t mask = this->capacity - 1;
+    const uint64_t first = this->head.load(std::memory_order_relaxed);
+
+    std::size_t count{0};
+    while (count < max_batch) {
+        const slot& s = this->slots[(first + count) & mask];
+        if (s.sequence.load(std::memory_order_acquire) != first + count + 1) {
+            break;
+        }
+        ++count;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    {
+        std::lock_guard lock{this->files_mutex};
+        std::vector<iovec> iov{};
+        iov.reserve(count);
+
+        const auto write_lines = [&](const int fd, const auto& include) -> std::size_t {
+            std::size_t bytes{0};
+            iov.clear();
+            for (std::size_t i{0}; i < count; ++i) {
+                slot& s = this->slots[(first + i) & mask];
+                if (include(s.file)) {
+                    iov.push_back({s.text.data(), s.text.size()});
+                    bytes += s.text.size();
+                }
+            }
+            write_iovecs(fd, iov.data(), static_cast<int>(iov.size()));
+            return bytes;
+        };
+
+        for (std::size_t file{0}; file < file_count; ++file) {
+            if (this->fds[file] < 0) {
+                continue;
+            }
+
+            // the first line of the file in this batch starts where the file ends now
+            for (std::size_t i{0}; i < count; ++i) {
+                if (const slot& s = this->slots[(first + i) & mask]; s.file == file) {
+                    this->write_index(file, this->sizes[file].load(std::memory_order_relaxed), s.text);
+                    break;
+                }
+            }
+            this->sizes[file].fetch_add(write_lines(this->fds[file], [file](const std::size_t f) { return f == file; }), std::memory_order_relaxed);
+        }
+        if (this->properties.output_to_std) {
+            write_lines(STDOUT_FILENO, [](const std::size_t f) { return f == 0 || f == 3; });
+            write_lines(STDERR_FILENO, [](const std::size_t f) { return f == 1 || f == 2; });
+        }
+    }
+
+    // even with nobody subscribed, since a stream is between two requests most of the time and has to be able to
+    // pick up where it left off
+    {
+        std::vector<std::pair<std::size_t, std::string_view>> lines{};
+        lines.reserve(count);
+        for (std::size_t i{0}; i < count; ++i) {
+            const slot& s = this->slots[(first + i) & mask];
+            lines.emplace_back(s.file, std::string_view{s.text}.substr(0, s.text.size() - 1));
+        }
+        live_logs.publish(lines);
+    }
+
+    for (std::size_t i{0}; i < count; ++i) {
+        this->slots[(first + i) & mask].sequence.store(first + i + this->capacity, std::memory_order_release);
+    }
+    this->head.store(first + count, std::memory_order_release);
+
+    return count;
+}
+
+void webber::async_logger::run() {
+    while (true) {
+        const std::size_t written = this->drain();
+        this->rotate_if_needed();
+        if (written != 0) {
+            continue;
+        }
+        if (!this->running.load(std::memory_order_acquire)) {
+            // producers that saw running before it was cleared may still be finishing their lines
+            if (this->head.load(std::memory_order_relaxed) == this->tail.load(std::memory_order_acquire)) {
+                return;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock lock{this->wake_mutex};
+        this->idle.store(true, std::memory_order_relaxed);
+        this->wake_cv.wait_for(lock, std::chrono::milliseconds(20));
+        this->idle.store(false, std::memory_order_relaxed);
+    }
+}
+
+void webber::async_logger::flush() {
+    if (!this->running.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    const uint64_t target = this->tail.load(std::memory_order_acquire);
+    this->wake_cv.notify_one();
+    while (this->head.load(std::memory_order_acquire) < target && this->writer.joinable()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void webber::async_logger::stop() {
+    if (!this->running.exchange(false)) {
+        return;
+    }
+
+    this->wake_cv.notify_one();
+    if (this->writer.joinable()) {
+        this->writer.join();
+    }
+
+    // segments it doesn't get to are picked up by the next start
+    {
+        std::lock_guard lock{this->compressor_mutex};
+        this->compressor_running = false;
+    }
+    this->compressor_cv.notify_one();
+    if (this->compressor.joinable()) {
+        this->compressor.join();
+    }
+}
+
+void webber::async_logger::set_rotation(const rotation& r) {
+    this->max_size.store(r.max_size, std::memory_order_relaxed);
+    this->max_age.store(r.max_age, std::memory_order_relaxed);
+    this->keep.store(r.keep, std::memory_order_relaxed);
+    this->compress.store(r.compress, std::memory_order_relaxed);
+}
+
+uint64_t webber::async_logger::get_segment_size(const limhamn::logger::type type) const {
+    return this->sizes[get_file(type)].load(std::memory_order_relaxed);
+}
+
+const std::string& webber::async_logger::get_path(const std::size_t file) const {
+    switch (file) {
+        case 0: return this->properties.access_log_file;
+        case 1: return this->properties.warning_log_file;
+        case 2: return this->properties.error_log_file;
+        default: return this->properties.notice_log_file;
+    }
+}
+
+void webber::async_logger::rotate_if_needed() {
+    const int64_t size_limit = this->max_size.load(std::memory_order_relaxed);
+    const int64_t age_limit = this->max_age.load(std::memory_order_relaxed);
+    if (size_limit <= 0 && age_limit <= 0) {
+        return;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    for (std::size_t file{0}; file < file_count; ++file) {
+        if (this->fds[file] < 0 || this->sizes[file].load(std::memory_order_relaxed) == 0) {
+            continue;
+        }
+
+        if ((size_limit > 0 && this->sizes[file].load(std::memory_order_relaxed) >= static_cast<uint64_t>(size_limit)) ||
+            (age_limit > 0 && now - this->opened[file] >= std::chrono::seconds(age_limit))) {
+            this->rotate(file);
+        }
+    }
+}
+
+void webber::async_logger::rotate(const std::size_t file) {
+    const std::string& path = this->get_path(file);
+    const std::string rotated = path + "." + std::to_string(get_unix_milliseconds());
+
+    {
+        std::lock_guard lock{this->files_mutex};
+        this->opened[file] = std::chrono::steady_clock::now(); // also when it fails, so that it isn't retried in a loop
+
+        if (std::rename(path.c_str(), rotated.c_str()) != 0) {
+            return;
+        }
+
+        // lines keep going to the renamed file until the new one is open
+        const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd >= 0) {
+            close(this->fds[file]);
+            this->fds[file] = fd;
+            this->sizes[file].store(0, std::memory_order_relaxed);
+        }
+
+        // rotated segments are compressed, which makes their offsets useless, so only the current file is indexed
+        if (this->index_fds[file] >= 0) {
+            static_cast<void>(ftruncate(this->index_fds[file], 0));
+            this->indexed[file] = no_index;
+        }
+    }
+
+    {
+        std::lock_guard lock{this->compressor_mutex};
+        this->compressor_queue.push_back(file);
+    }
+    this->compressor_cv.notify_one();
+}
+
+void webber::async_logger::compress_segments(const std::size_t file) {
+    const std::filesystem::path path{this->get_path(file)};
+    if (path.empty()) {
+        return;
+    }
+
+    std::error_code ec;
+    auto segments = logs::get_segments(path.string());
+    for (auto& it : segments) {
+        if (it.path.extension() == ".gz" || !this->compress.load(std::memory_order_relaxed)) {
+            continue;
+        }
+
+        const std::filesystem::path archive = it.path.string() + ".gz";
+        if (gzip_file(it.path, archive)) {
+            std::filesystem::remove(it.path, ec);
+            it.path = archive;
+        }
+    }
+
+    const std::size_t limit = this->keep.load(std::memory_order_relaxed);
+    if (limit == 0 || segments.size() <= limit) {
+        return;
+    }
+
+    for (std::size_t i{0}; i < segments.size() - limit; ++i) {
+        std::filesystem::remove(segments[i].path, ec);
+    }
+}
+
+void webber::async_logger::run_compressor() {
+    // compressing competes with requests for cpu time, and it's never urgent
+    setpriority(PRIO_PROCESS, static_cast<id_t>(gettid()), 19);
+
+    while (true) {
+        std::size_t file{};
+        {
+            std::unique_lock lock{this->compressor_mutex};
+            this->compressor_cv.wait(lock, [this]() { return !this->compressor_running || !this->compressor_queue.empty(); });
+            if (!this->compressor_running) {
+                return;
+            }
+
+            file = this->compressor_queue.front();
+            this->compressor_queue.pop_front();
+        }
+
+        this->compress_segments(file);
+    }
+}
+
+std::size_t webber::async_logger::get_queue_depth() const {
+    return this->tail.load(std::memory_order_relaxed) - this->head.load(std::memory_order_relaxed);
+}
+
+void webber::async_logger::crash_handler(const int signal) {
+    // only async-signal-safe calls from here on: the lines are already formatted, they just need write(2)
+    if (async_logger* l = crash_target.load(); l != nullptr && l->slots) {
+        const std::size_t mask = l->capacity - 1;
+        const uint64_t end = l->tail.load(std::memory_order_acquire);
+        for (uint64_t i = l->head.load(std::memory_order_acquire); i < end; ++i) {
+            const slot& s = l->slots[i & mask];
+            if (s.sequence.load(std::memory_order_acquire) != i + 1) {
+                continue;
+            }
+
+            const int fd = l->fds[s.file] >= 0 ? l->fds[s.file] : STDERR_FILENO;
+            static_cast<void>(write(fd, s.text.data(), s.text.size()));
+        }
+    }
+
+    // SA_RESETHAND restored the default action, so this terminates the way the signal would have
+    raise(signal);
+}
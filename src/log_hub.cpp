@@ -0,0 +1,65 @@
+#include <algorithm>
+#include <log_hub.hpp>
+
+std::optional<webber::log_hub::subscription> webber::log_hub::subscribe(const std::size_t max_subscribers) {
+    std::size_t current = this->subscribers.load(std::memory_order_relaxed);
+    do {
+        if (current >= max_subscribers) {
+            return std::nullopt;
+        }
+    } while (!this->subscribers.compare_exchange_weak(current, current + 1));
+
+    return subscription{&this->subscribers};
+}
+
+void webber::log_hub::publish(const std::span<const std::pair<std::size_t, std::string_view>> lines) {
+    if (lines.empty()) {
+        return;
+    }
+
+    {
+        std::lock_guard lock{this->mutex};
+        for (const auto& [file, text] : lines) {
+            this->lines.push_back({this->next_id++, file, std::string{text}});
+        }
+        while (this->lines.size() > capacity) {
+            this->lines.pop_front();
+        }
+    }
+
+    this->cv.notify_all();
+}
+
+std::vector<webber::log_hub::line> webber::log_hub::wait(uint64_t& cursor, const unsigned file_mask, const std::size_t limit, const std::chrono::milliseconds timeout, bool& missed) {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::vector<line> ret{};
+
+    std::unique_lock lock{this->mutex};
+    // ids start over with the process, so a cursor from before a restart is from the future
+    cursor = std::min(cursor, this->next_id - 1);
+    while (true) {
+        missed = missed || (!this->lines.empty() && this->lines.front().id > cursor + 1);
+
+        // ids are consecutive, so the first line newer than the cursor can be found without a search
+        const uint64_t first = this->lines.empty() ? this->next_id : this->lines.front().id;
+        const std::size_t start = cursor + 1 > first ? static_cast<std::size_t>(cursor + 1 - first) : 0;
+        for (std::size_t i{start}; i < this->lines.size() && ret.size() < limit; ++i) {
+            const line& l = this->lines[i];
+            cursor = l.id;
+            if ((file_mask & (1u << l.file)) != 0) {
+                ret.push_back(l);
+            }
+        }
+
+        if (!ret.empty() || this->cv.wait_until(lock, deadline) == std::cv_status::timeout) {
+            break;
+        }
+    }
+
+    return ret;
+}
+
+uint64_t webber::log_hub::get_last_id() const {
+    std::lock_guard lock{this->mutex};
+    return this->next_id - 1;
+}
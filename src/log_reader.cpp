@@ -0,0 +1,330 @@
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <fstream>
+#include <limits>
+#include <queue>
+#include <tuple>
+#include <zlib.h>
+#include <log_reader.hpp>
+
+namespace {
+    constexpr std::size_t block_size{64 * 1024};
+
+    // lines are timestamped before they are queued, so they can be written slightly out of order
+    constexpr int64_t index_slack{1000};
+
+    std::vector<webber::logs::index_entry> read_index(const std::string& path) {
+        std::ifstream file{webber::logs::get_index_path(path), std::ios::binary | std::ios::ate};
+        if (!file.is_open()) {
+            return {};
+        }
+
+        const auto size = static_cast<std::size_t>(file.tellg());
+        std::vector<webber::logs::index_entry> entries(size / sizeof(webber::logs::index_entry));
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(webber::logs::index_entry)));
+        entries.resize(static_cast<std::size_t>(file.gcount()) / sizeof(webber::logs::index_entry));
+
+        return entries;
+    }
+
+    int64_t add_saturating(const int64_t a, const int64_t b) {
+        if (b > 0 && a > std::numeric_limits<int64_t>::max() - b) {
+            return std::numeric_limits<int64_t>::max();
+        }
+        if (b < 0 && a < std::numeric_limits<int64_t>::min() - b) {
+            return std::numeric_limits<int64_t>::min();
+        }
+
+        return a + b;
+    }
+
+    // true if the address occurs in the line as a whole word, so that 10.0.0.1 doesn't match 10.0.0.10
+    bool mentions(const std::string_view line, const std::string_view ip_address) {
+        const auto is_part = [](const char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '.' || c == ':'; };
+        for (std::size_t i = line.find(ip_address); i != std::string_view::npos; i = line.find(ip_address, i + 1)) {
+            const std::size_t end = i + ip_address.size();
+            if ((i == 0 || !is_part(line[i - 1])) && (end == line.size() || !is_part(line[end]))) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // lines from a segment compressed by the logger
+    class gzip_lines {
+    public:
+        explicit gzip_lines(const std::filesystem::path& path) : file(gzopen(path.c_str(), "rb")) {}
+        ~gzip_lines() { if (this->file != nullptr) gzclose(this->file); }
+        gzip_lines(const gzip_lines&) = delete;
+        gzip_lines& operator=(const gzip_lines&) = delete;
+
+        bool getline(std::string& line) {
+            line.clear();
+            if (this->file == nullptr) {
+                return false;
+            }
+
+            char buffer[4096];
+            while (gzgets(this->file, buffer, sizeof(buffer)) != nullptr) {
+                line += buffer;
+                if (line.ends_with('\n')) {
+                    line.pop_back();
+                    return true;
+                }
+            }
+
+            return !line.empty();
+        }
+    private:
+        gzFile file{nullptr};
+    };
+
+    // appends the matching lines read with getline until the limit or the end of the range; false once either is reached
+    template <typename F>
+    bool collect(F&& getline, const webber::logs::search_query& query, std::vector<std::string>& ret) {
+        std::string line{};
+        int64_t timestamp{0};
+        while (ret.size() < query.limit && getline(line)) {
+            // continuation lines belong to the message above them
+            if (const auto t = webber::logs::get_timestamp(line)) {
+                timestamp = *t;
+            }
+            if (timestamp > add_saturating(query.to, index_slack)) {
+                return false;
+            }
+            if (timestamp < query.from || timestamp > query.to) {
+                continue;
+            }
+            if (!query.contains.empty() && line.find(query.contains) == std::string::npos) {
+                continue;
+            }
+            if (!query.ip_address.empty() && !mentions(line, query.ip_address)) {
+                continue;
+            }
+
+            ret.push_back(line);
+        }
+
+        return ret.size() < query.limit;
+    }
+}
+
+std::vector<std::string> webber::logs::read_tail(const std::string& path, const std::size_t count) {
+    std::ifstream file{path, std::ios::binary | std::ios::ate};
+    if (!file.is_open() || count == 0) {
+        return {};
+    }
+
+    // blocks are collected back to front, and read until they hold count complete lines
+    const auto size = static_cast<std::size_t>(file.tellg());
+    std::vector<std::string> blocks{};
+    std::size_t position{size};
+    std::size_t newlines{0};
+    while (position > 0 && newlines <= count) {
+        const std::size_t length = std::min(block_size, position);
+        position -= length;
+
+        std::string block(length, '\0');
+        file.seekg(static_cast<std::streamoff>(position));
+        file.read(block.data(), static_cast<std::streamsize>(length));
+        block.resize(static_cast<std::size_t>(file.gcount()));
+
+        newlines += static_cast<std::size_t>(std::ranges::count(block, '\n'));
+        blocks.push_back(std::move(block));
+    }
+
+    std::string text{};
+    for (auto it = blocks.rbegin(); it != blocks.rend(); ++it) {
+        text += *it;
+    }
+    if (!text.empty() && text.back() == '\n') {
+        text.pop_back();
+    }
+    if (text.empty()) {
+        return {};
+    }
+
+    std::vector<std::string> lines{};
+    std::size_t start{0};
+    while (start <= text.size()) {
+        const std::size_t newline = std::min(text.find('\n', start), text.size());
+        lines.emplace_back(text.substr(start, newline - start));
+        start = newline + 1;
+    }
+
+    // unless the file starts there, the first line was cut off by the block boundary
+    if (position != 0 && !lines.empty()) {
+        lines.erase(lines.begin());
+    }
+    if (lines.size() > count) {
+        lines.erase(lines.begin(), lines.end() - static_cast<std::ptrdiff_t>(count));
+    }
+
+    return lines;
+}
+
+std::vector<std::string> webber::logs::read_head(const std::string& path, const std::size_t count) {
+    std::ifstream file{path};
+    std::vector<std::string> lines{};
+    std::string line{};
+    while (lines.size() < count && std::getline(file, line)) {
+        lines.push_back(std::move(line));
+    }
+
+    return lines;
+}
+
+std::string webber::logs::get_index_path(const std::string& path) {
+    return path + ".idx";
+}
+
+std::vector<webber::logs::segment> webber::logs::get_segments(const std::string& path) {
+    const std::filesystem::path file{path};
+    const std::string prefix = file.filename().string() + ".";
+    const std::filesystem::path directory = file.has_parent_path() ? file.parent_path() : std::filesystem::path{"."};
+
+    std::vector<segment> ret{};
+    std::error_code ec{};
+    for (auto it = std::filesystem::directory_iterator{directory, ec}; !ec && it != std::filesystem::directory_iterator{}; it.increment(ec)) {
+        const std::string name = it->path().filename().string();
+        if (!name.starts_with(prefix)) {
+            continue;
+        }
+
+        std::string_view stamp{name};
+        stamp.remove_prefix(prefix.size());
+        if (stamp.ends_with(".gz")) {
+            stamp.remove_suffix(3);
+        }
+
+        int64_t value{};
+        const auto [ptr, err] = std::from_chars(stamp.data(), stamp.data() + stamp.size(), value);
+        if (err != std::errc{} || ptr != stamp.data() + stamp.size()) {
+            continue;
+        }
+
+        ret.push_back({value, it->path()});
+    }
+
+    // a segment being compressed briefly exists as both, the uncompressed one sorts first
+    std::ranges::sort(ret, [](const segment& a, const segment& b) { return std::tie(a.rotated_at, a.path) < std::tie(b.rotated_at, b.path); });
+    return ret;
+}
+
+std::vector<std::string> webber::logs::search(const std::string& path, const search_query& query) {
+    if (query.limit == 0 || query.from > query.to) {
+        return {};
+    }
+
+    std::vector<std::string> ret{};
+
+    // a segment holds the lines logged after the one before it was rotated and before it was itself
+    const int64_t from = add_saturating(query.from, -index_slack);
+    const int64_t to = add_saturating(query.to, index_slack);
+    int64_t previous{std::numeric_limits<int64_t>::min()};
+    for (const auto& it : get_segments(path)) {
+        if (it.rotated_at == previous || it.rotated_at < from) {
+            previous = it.rotated_at;
+            continue;
+        }
+        if (previous > to) {
+            return ret;
+        }
+        previous = it.rotated_at;
+
+        bool more{};
+        if (it.path.extension() == ".gz") {
+            gzip_lines lines{it.path};
+            more = collect([&](std::string& line) { return lines.getline(line); }, query, ret);
+        } else {
+            std::ifstream file{it.path, std::ios::binary};
+            more = collect([&](std::string& line) { return static_cast<bool>(std::getline(file, line)); }, query, ret);
+        }
+        if (!more) {
+            return ret;
+        }
+    }
+    if (previous > to) {
+        return ret;
+    }
+
+    std::ifstream file{path, std::ios::binary};
+    if (!file.is_open()) {
+        return ret;
+    }
+
+    // start at the last indexed line logged before the range begins
+    const auto entries = read_index(path);
+    const auto start = std::ranges::partition_point(entries, [&](const index_entry& e) { return e.timestamp < from; });
+    if (start != entries.begin()) {
+        file.seekg(static_cast<std::streamoff>(std::prev(start)->offset));
+    }
+
+    collect([&](std::string& line) { return static_cast<bool>(std::getline(file, line)); }, query, ret);
+    return ret;
+}
+
+std::optional<int64_t> webber::logs::get_timestamp(const std::string_view line) {
+    // "<seconds>.<milliseconds> [type] message"
+    int64_t seconds{};
+    const char* end = line.data() + line.size();
+    const auto [ptr, ec] = std::from_chars(line.data(), end, seconds);
+    if (ec != std::errc{}) {
+        return std::nullopt;
+    }
+
+    int64_t milliseconds{0};
+    if (ptr != end && *ptr == '.') {
+        std::from_chars(ptr + 1, end, milliseconds);
+    }
+
+    return seconds * 1000 + milliseconds;
+}
+
+std::string webber::logs::merge(const std::vector<std::vector<std::string>>& files) {
+    struct cursor {
+        int64_t timestamp{};
+        std::size_t file{};
+        std::size_t line{};
+
+        bool operator>(const cursor& other) const {
+            return std::tie(this->timestamp, this->file) > std::tie(other.timestamp, other.file);
+        }
+    };
+
+    std::size_t size{0};
+    std::priority_queue<cursor, std::vector<cursor>, std::greater<>> queue{};
+    for (std::size_t i{0}; i < files.size(); ++i) {
+        for (const auto& it : files[i]) {
+            size += it.size() + 1;
+        }
+        if (!files[i].empty()) {
+            queue.push({get_timestamp(files[i].front()).value_or(0), i, 0});
+        }
+    }
+
+    std::string ret{};
+    ret.reserve(size);
+    while (!queue.empty()) {
+        cursor c = queue.top();
+        queue.pop();
+
+        // continuation lines (a multi-line message) have no timestamp of their own
+        const auto& lines = files[c.file];
+        do {
+            ret += lines[c.line];
+            ret += '\n';
+            ++c.line;
+        } while (c.line < lines.size() && !get_timestamp(lines[c.line]));
+
+        if (c.line < lines.size()) {
+            c.timestamp = *get_timestamp(lines[c.line]);
+            queue.push(c);
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <span>
+#include <spanstream>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <maddy/parser.h>
+#include <webber.hpp>
+#include <markdown.hpp>
+#include <trace.hpp>
+
+webber::markdown_renderer::markdown_renderer() : parser(std::make_unique<maddy::Parser>()) {}
+
+webber::markdown_renderer::~markdown_renderer() = default;
+
+std::string webber::markdown_renderer::render(const std::string_view markdown) const {
+    const trace::span span{"markdown_renderer::render"};
+
+    std::ispanstream stream{std::span<const char>{markdown.data(), markdown.size()}};
+    return this->parser->Parse(stream);
+}
+
+webber::markdown_renderer& webber::markdown_renderer::get_local() {
+    thread_local markdown_renderer renderer{};
+    return renderer;
+}
+
+webber::render_pool::~render_pool() {
+    this->stop();
+}
+
+void webber::render_pool::start(const std::size_t count) {
+    this->stop();
+
+    {
+        std::lock_guard lock{this->mutex};
+        this->running = true;
+    }
+    for (std::size_t i{0}; i < std::max<std::size_t>(1, count); ++i) {
+        this->threads.emplace_back([this]() { this->run(); });
+    }
+}
+
+void webber::render_pool::stop() {
+    {
+        std::lock_guard lock{this->mutex};
+        this->running = false;
+    }
+    this->cv.notify_all();
+
+    for (auto& it : this->threads) {
+        if (it.joinable()) {
+            it.join();
+        }
+    }
+
+    this->threads.clear();
+}
+
+bool webber::render_pool::is_running() const {
+    std::lock_guard lock{this->mutex};
+    return this->running;
+}
+
+void webber::render_pool::submit(std::function<void()> job) {
+    {
+        std::lock_guard lock{this->mutex};
+        if (!this->running) {
+            throw std::runtime_error{"The render pool is not running."};
+        }
+
+        this->queue.push_back(std::move(job));
+    }
+    this->cv.notify_one();
+}
+
+std::size_t webber::render_pool::get_queue_depth() const {
+    std::lock_guard lock{this->mutex};
+    return this->queue.size();
+}
+
+void webber::render_pool::run() {
+    // a page that is being rendered in the background is already saved, requests come first
+    setpriority(PRIO_PROCESS, static_cast<id_t>(gettid()), 10);
+
+    while (true) {
+        std::function<void()> job{};
+        {
+            std::unique_lock lock{this->mutex};
+            this->cv.wait(lock, [this]() { return !this->running || !this->queue.empty(); });
+            // finish what was submitted before stopping, those pages are waiting for their html
+            if (this->queue.empty()) {
+                return;
+            }
+
+            job = std::move(this->queue.front());
+            this->queue.pop_front();
+        }
+
+        try {
+            job();
+        } catch (const std::exception& e) {
+            logger.write_to_log(limhamn::logger::type::error, "Failed to render a page in the background: ", e.what(), "\n");
+        }
+    }
+}
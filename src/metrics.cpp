@@ -0,0 +1,423 @@
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+#include <webber.hpp>
+#include <metrics.hpp>
+#include <markdown.hpp>
+#include <session.hpp>
+
+namespace {
+    // label values beyond this are counted under the first label seen past the limit ("other")
+    constexpr std::size_t max_labels{128};
+
+    // nanoseconds
+    constexpr std::array<uint64_t, 14> duration_bounds{
+        100'000, 250'000, 500'000, 1'000'000, 2'500'000, 5'000'000, 10'000'000, 25'000'000,
+        50'000'000, 100'000'000, 250'000'000, 500'000'000, 1'000'000'000, 5'000'000'000,
+    };
+
+    // bytes
+    constexpr std::array<uint64_t, 10> size_bounds{
+        256, 1024, 4096, 16384, 65536, 262144, 1048576, 4194304, 16777216, 67108864,
+    };
+
+    template <std::size_t N>
+    struct histogram {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum{0};
+        std::array<std::atomic<uint64_t>, N + 1> buckets{};
+
+        void observe(const uint64_t value, const std::array<uint64_t, N>& bounds) {
+            std::size_t i{0};
+            while (i < N && value > bounds[i]) {
+                ++i;
+            }
+
+            // only the owning thread writes, relaxed is enough for the scraper to see a consistent enough view
+            this->buckets[i].fetch_add(1, std::memory_order_relaxed);
+            this->sum.fetch_add(value, std::memory_order_relaxed);
+            this->count.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+
+    using duration_histogram = histogram<duration_bounds.size()>;
+    using size_histogram = histogram<size_bounds.size()>;
+
+    struct shard {
+        std::array<duration_histogram, max_labels> request_duration{};
+        std::array<size_histogram, max_labels> response_size{};
+        std::array<duration_histogram, max_labels> query_duration{};
+        std::array<std::atomic<uint64_t>, max_labels> query_rows{};
+        std::array<std::atomic<uint64_t>, max_labels> query_bytes{};
+        std::array<std::atomic<uint64_t>, max_labels> query_failures{};
+        std::array<std::atomic<uint64_t>, max_labels> cache_hits{};
+        std::array<std::atomic<uint64_t>, max_labels> cache_misses{};
+        std::array<std::atomic<uint64_t>, max_labels> shed{};
+        std::array<std::atomic<uint64_t>, max_labels> rate_limited{};
+        std::array<std::atomic<uint64_t>, 6> status_classes{};
+        std::atomic<uint64_t> upload_bytes{0};
+        std::atomic<uint64_t> download_bytes{0};
+    };
+
+    enum class family : std::size_t {
+        route,
+        statement,
+        cache,
+        route_class,
+        count,
+    };
+
+    struct string_hash {
+        using is_transparent = void;
+        std::size_t operator()(const std::string_view str) const {
+            return std::hash<std::string_view>{}(str);
+        }
+    };
+
+    using label_map = std::unordered_map<std::string, std::size_t, string_hash, std::equal_to<>>;
+
+    struct registry {
+        std::mutex mutex{};
+        std::vector<std::unique_ptr<shard>> shards{};
+        std::vector<shard*> free_shards{};
+        std::array<std::vector<std::string>, static_cast<std::size_t>(family::count)> labels{};
+        std::array<label_map, static_cast<std::size_t>(family::count)> label_ids{};
+    };
+
+    registry& get_registry() {
+        static registry r{};
+        return r;
+    }
+
+    // shards outlive their threads; a thread that exits hands its shard (and its counts) to the next one
+    struct shard_handle {
+        shard* s{nullptr};
+
+        shard_handle() {
+            registry& r = get_registry();
+            std::lock_guard lock{r.mutex};
+            if (!r.free_shards.empty()) {
+                this->s = r.free_shards.back();
+                r.free_shards.pop_back();
+                return;
+            }
+
+            r.shards.push_back(std::make_unique<shard>());
+            this->s = r.shards.back().get();
+        }
+
+        ~shard_handle() {
+            registry& r = get_registry();
+            std::lock_guard lock{r.mutex};
+            r.free_shards.push_back(this->s);
+        }
+    };
+
+    shard& local_shard() {
+        thread_local shard_handle handle{};
+        return *handle.s;
+    }
+
+    std::size_t get_label(const family f, const std::string_view name) {
+        const auto index = static_cast<std::size_t>(f);
+
+        // the registry lock is only taken the first time a thread sees a label
+        thread_local std::array<label_map, static_cast<std::size_t>(family::count)> cache{};
+        if (const auto it = cache[index].find(name); it != cache[index].end()) {
+            return it->second;
+        }
+
+        registry& r = get_registry();
+        std::size_t id{};
+        {
+            std::lock_guard lock{r.mutex};
+            if (const auto it = r.label_ids[index].find(name); it != r.label_ids[index].end()) {
+                id = it->second;
+            } else if (r.labels[index].size() < max_labels - 1) {
+                id = r.labels[index].size();
+                r.labels[index].emplace_back(name);
+                r.label_ids[index].try_emplace(std::string{name}, id);
+            } else {
+                id = max_labels - 1;
+                if (r.labels[index].size() < max_labels) {
+                    r.labels[index].emplace_back("other");
+                }
+            }
+        }
+
+        cache[index].try_emplace(std::string{name}, id);
+        return id;
+    }
+
+    thread_local std::string_view current_route{};
+
+    std::string escape_label(const std::string_view str) {
+        std::string ret{};
+        ret.reserve(str.size());
+        for (const auto& c : str) {
+            if (c == '\\' || c == '"') {
+                ret += '\\';
+                ret += c;
+            } else if (c == '\n') {
+                ret += "\\n";
+            } else {
+                ret += c;
+            }
+        }
+
+        return ret;
+    }
+
+    template <std::size_t N>
+    void write_histogram(std::ostringstream& ss, const std::string& name, const std::string& labels,
+                         const std::vector<const histogram<N>*>& parts, const std::array<uint64_t, N>& bounds, const double scale) {
+        std::array<uint64_t, N + 1> buckets{};
+        uint64_t count{0};
+        uint64_t sum{0};
+        for (const auto& it : parts) {
+            for (std::size_t i{0}; i < N + 1; ++i) {
+                buckets[i] += it->buckets[i].load(std::memory_order_relaxed);
+            }
+            count += it->count.load(std::memory_order_relaxed);
+            sum += it->sum.load(std::memory_order_relaxed);
+        }
+
+        if (count == 0) {
+            return;
+        }
+
+        uint64_t cumulative{0};
+        for (std::size_t i{0}; i < N; ++i) {
+            cumulative += buckets[i];
+            ss << name << "_bucket{" << labels << ",le=\"" << static_cast<double>(bounds[i]) * scale << "\"} " << cumulative << "\n";
+        }
+        cumulative += buckets[N];
+        ss << name << "_bucket{" << labels << ",le=\"+Inf\"} " << cumulative << "\n";
+        ss << name << "_sum{" << labels << "} " << static_cast<double>(sum) * scale << "\n";
+        ss << name << "_count{" << labels << "} " << count << "\n";
+    }
+}
+
+void webber::metrics::set_route(const std::string_view route) {
+    current_route = route;
+}
+
+std::string_view webber::metrics::get_route() {
+    return current_route;
+}
+
+void webber::metrics::record_request(const std::string_view route, const int status, const std::chrono::nanoseconds duration, const std::size_t response_size) {
+    shard& s = local_shard();
+    const std::size_t id = get_label(family::route, route.empty() ? "unknown" : route);
+
+    s.request_duration[id].observe(static_cast<uint64_t>(std::max<int64_t>(0, duration.count())), duration_bounds);
+    s.response_size[id].observe(response_size, size_bounds);
+    s.status_classes[std::clamp(status / 100, 0, 5)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void webber::metrics::record_query(const std::string_view statement, const std::chrono::nanoseconds duration, const std::size_t rows, const std::size_t bytes, const bool failed) {
+    shard& s = local_shard();
+    const std::size_t id = get_label(family::statement, statement);
+
+    s.query_duration[id].observe(static_cast<uint64_t>(std::max<int64_t>(0, duration.count())), duration_bounds);
+    s.query_rows[id].fetch_add(rows, std::memory_order_relaxed);
+    s.query_bytes[id].fetch_add(bytes, std::memory_order_relaxed);
+    if (failed) {
+        s.query_failures[id].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void webber::metrics::record_cache(const std::string_view cache, const bool hit) {
+    shard& s = local_shard();
+    const std::size_t id = get_label(family::cache, cache);
+
+    (hit ? s.cache_hits : s.cache_misses)[id].fetch_add(1, std::memory_order_relaxed);
+}
+
+void webber::metrics::record_shed(const std::string_view route_class) {
+    local_shard().shed[get_label(family::route_class, route_class)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void webber::metrics::record_rate_limited(const std::string_view route_class) {
+    local_shard().rate_limited[get_label(family::route_class, route_class)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void webber::metrics::add_upload_bytes(const std::size_t bytes) {
+    local_shard().upload_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void webber::metrics::add_download_bytes(const std::size_t bytes) {
+    local_shard().download_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+std::string webber::metrics::scrape() {
+    registry& r = get_registry();
+
+    std::vector<const shard*> shards{};
+    std::array<std::vector<std::string>, static_cast<std::size_t>(family::count)> labels{};
+    {
+        std::lock_guard lock{r.mutex};
+        for (const auto& it : r.shards) {
+            shards.push_back(it.get());
+        }
+        labels = r.labels;
+    }
+
+    const auto& routes = labels[static_cast<std::size_t>(family::route)];
+    const auto& statements = labels[static_cast<std::size_t>(family::statement)];
+    const auto& caches = labels[static_cast<std::size_t>(family::cache)];
+    const auto& route_classes = labels[static_cast<std::size_t>(family::route_class)];
+
+    std::ostringstream ss{};
+
+    ss << "# HELP webber_http_request_duration_seconds Time spent handling requests, by route. The _count series is the request count.\n";
+    ss << "# TYPE webber_http_request_duration_seconds histogram\n";
+    for (std::size_t i{0}; i < routes.size(); ++i) {
+        std::vector<const duration_histogram*> parts{};
+        for (const auto& it : shards) {
+            parts.push_back(&it->request_duration[i]);
+        }
+        write_histogram(ss, "webber_http_request_duration_seconds", "route=\"" + escape_label(routes[i]) + "\"", parts, duration_bounds, 1e-9);
+    }
+
+    ss << "# HELP webber_http_response_size_bytes Size of response bodies, by route.\n";
+    ss << "# TYPE webber_http_response_size_bytes histogram\n";
+    for (std::size_t i{0}; i < routes.size(); ++i) {
+        std::vector<const size_histogram*> parts{};
+        for (const auto& it : shards) {
+            parts.push_back(&it->response_size[i]);
+        }
+        write_histogram(ss, "webber_http_response_size_bytes", "route=\"" + escape_label(routes[i]) + "\"", parts, size_bounds, 1.0);
+    }
+
+    ss << "# HELP webber_http_responses_total Responses sent, by status class.\n";
+    ss << "# TYPE webber_http_responses_total counter\n";
+    for (std::size_t i{1}; i < 6; ++i) {
+        uint64_t total{0};
+        for (const auto& it : shards) {
+            total += it->status_classes[i].load(std::memory_order_relaxed);
+        }
+        ss << "webber_http_responses_total{code=\"" << i << "xx\"} " << total << "\n";
+    }
+
+    ss << "# HELP webber_http_shed_total Requests turned away by admission control, by route class.\n";
+    ss << "# TYPE webber_http_shed_total counter\n";
+    for (std::size_t i{0}; i < route_classes.size(); ++i) {
+        uint64_t total{0};
+        for (const auto& it : shards) {
+            total += it->shed[i].load(std::memory_order_relaxed);
+        }
+        ss << "webber_http_shed_total{class=\"" << escape_label(route_classes[i]) << "\"} " << total << "\n";
+    }
+
+    ss << "# HELP webber_http_rate_limited_total Requests refused by the rate limiter, by route class.\n";
+    ss << "# TYPE webber_http_rate_limited_total counter\n";
+    for (std::size_t i{0}; i < route_classes.size(); ++i) {
+        uint64_t total{0};
+        for (const auto& it : shards) {
+            total += it->rate_limited[i].load(std::memory_order_relaxed);
+        }
+        ss << "webber_http_rate_limited_total{class=\"" << escape_label(route_classes[i]) << "\"} " << total << "\n";
+    }
+
+    ss << "# HELP webber_http_requests_in_flight Requests currently being handled.\n";
+    ss << "# TYPE webber_http_requests_in_flight gauge\n";
+    ss << "webber_http_requests_in_flight " << in_flight.load(std::memory_order_relaxed) << "\n";
+
+    ss << "# HELP webber_db_query_duration_seconds Time spent in database queries, by statement. The _count series is the query count.\n";
+    ss << "# TYPE webber_db_query_duration_seconds histogram\n";
+    for (std::size_t i{0}; i < statements.size(); ++i) {
+        std::vector<const duration_histogram*> parts{};
+        for (const auto& it : shards) {
+            parts.push_back(&it->query_duration[i]);
+        }
+        write_histogram(ss, "webber_db_query_duration_seconds", "statement=\"" + escape_label(statements[i]) + "\"", parts, duration_bounds, 1e-9);
+    }
+
+    const auto write_statement_counter = [&](const std::string& name, const std::string& help, std::array<std::atomic<uint64_t>, max_labels> shard::* member) {
+        ss << "# HELP " << name << " " << help << "\n";
+        ss << "# TYPE " << name << " counter\n";
+        for (std::size_t i{0}; i < statements.size(); ++i) {
+            uint64_t total{0};
+            for (const auto& it : shards) {
+                total += (it->*member)[i].load(std::memory_order_relaxed);
+            }
+            ss << name << "{statement=\"" << escape_label(statements[i]) << "\"} " << total << "\n";
+        }
+    };
+
+    write_statement_counter("webber_db_query_rows_total", "Rows returned, by statement.", &shard::query_rows);
+    write_statement_counter("webber_db_query_bytes_total", "Bytes returned, by statement.", &shard::query_bytes);
+    write_statement_counter("webber_db_query_failures_total", "Statements that reported failure, by statement.", &shard::query_failures);
+
+    ss << "# HELP webber_cache_hits_total Cache lookups that found an entry.\n";
+    ss << "# TYPE webber_cache_hits_total counter\n";
+    for (std::size_t i{0}; i < caches.size(); ++i) {
+        uint64_t total{0};
+        for (const auto& it : shards) {
+            total += it->cache_hits[i].load(std::memory_order_relaxed);
+        }
+        ss << "webber_cache_hits_total{cache=\"" << escape_label(caches[i]) << "\"} " << total << "\n";
+    }
+
+    ss << "# HELP webber_cache_misses_total Cache lookups that did not find an entry.\n";
+    ss << "# TYPE webber_cache_misses_total counter\n";
+    for (std::size_t i{0}; i < caches.size(); ++i) {
+        uint64_t total{0};
+        for (const auto& it : shards) {
+            total += it->cache_misses[i].load(std::memory_order_relaxed);
+        }
+        ss << "webber_cache_misses_total{cache=\"" << escape_label(caches[i]) << "\"} " << total << "\n";
+    }
+
+    ss << "# HELP webber_sessions Sessions currently held in memory.\n";
+    ss << "# TYPE webber_sessions gauge\n";
+    ss << "webber_sessions " << sessions.size() << "\n";
+
+    ss << "# HELP webber_log_dropped_total Log lines dropped because the log queue was full.\n";
+    ss << "# TYPE webber_log_dropped_total counter\n";
+    ss << "webber_log_dropped_total " << logger.get_dropped() << "\n";
+
+    ss << "# HELP webber_log_segment_bytes Size of the log file currently being written, by log.\n";
+    ss << "# TYPE webber_log_segment_bytes gauge\n";
+    for (const auto& [name, type] : std::initializer_list<std::pair<std::string_view, limhamn::logger::type>>{
+        {"access", limhamn::logger::type::access},
+        {"warning", limhamn::logger::type::warning},
+        {"error", limhamn::logger::type::error},
+        {"notice", limhamn::logger::type::notice},
+    }) {
+        ss << "webber_log_segment_bytes{log=\"" << name << "\"} " << logger.get_segment_size(type) << "\n";
+    }
+
+    ss << "# HELP webber_log_queue_depth Log lines waiting to be written.\n";
+    ss << "# TYPE webber_log_queue_depth gauge\n";
+    ss << "webber_log_queue_depth " << logger.get_queue_depth() << "\n";
+
+    ss << "# HELP webber_render_queue_depth Large pages waiting to be rendered in the background.\n";
+    ss << "# TYPE webber_render_queue_depth gauge\n";
+    ss << "webber_render_queue_depth " << renders.get_queue_depth() << "\n";
+
+    ss << "# HELP webber_uploads_in_flight Uploads currently being processed.\n";
+    ss << "# TYPE webber_uploads_in_flight gauge\n";
+    ss << "webber_uploads_in_flight " << uploads_in_flight.load(std::memory_order_relaxed) << "\n";
+
+    uint64_t upload_bytes{0};
+    uint64_t download_bytes{0};
+    for (const auto& it : shards) {
+        upload_bytes += it->upload_bytes.load(std::memory_order_relaxed);
+        download_bytes += it->download_bytes.load(std::memory_order_relaxed);
+    }
+
+    ss << "# HELP webber_upload_bytes_total Bytes received in uploaded files.\n";
+    ss << "# TYPE webber_upload_bytes_total counter\n";
+    ss << "webber_upload_bytes_total " << upload_bytes << "\n";
+    ss << "# HELP webber_download_bytes_total Bytes sent when serving files.\n";
+    ss << "# TYPE webber_download_bytes_total counter\n";
+    ss << "webber_download_bytes_total " << download_bytes << "\n";
+
+    return ss.str();
+}
@@ -2,7 +2,165 @@
 #include <db_abstract.hpp>
 #include <nlohmann/json.hpp>
 #include <scrypto.hpp>
-#include <maddy/parser.h>
+#include <markdown.hpp>
+#include <preprocessor.hpp>
+#include <export.hpp>
+#include <revisions.hpp>
+#include <worker.hpp>
+#include <trace.hpp>
+#include <mutex>
+#include <optional>
+
+namespace {
+    std::mutex background_renders_mutex{};
+    std::unordered_map<std::string, uint64_t> background_renders{}; // location -> the render whose result is stored
+    uint64_t last_background_render{0};
+
+    // visits to pages fetched on behalf of a concurrent request, written along with the next download_page() of the
+    // page, or by flush_visits() once there are many of them or they have waited too long
+    std::mutex pending_visits_mutex{};
+    std::unordered_map<std::string, std::vector<nlohmann::json>> pending_visits{};
+    std::size_t pending_visit_count{0};
+    std::chrono::steady_clock::time_point pending_visits_since{};
+    bool pending_visits_flush_scheduled{false};
+
+    // markdown this large is rendered by webber::renders once the page has been saved, see render_in_background()
+    bool is_background_render(const std::string& markdown) {
+        const int64_t threshold = webber::current_settings()->background_render_size;
+        return threshold > 0 && static_cast<int64_t>(markdown.size()) > threshold && webber::renders.is_running();
+    }
+
+    // a render that finishes after the page was saved (or rendered) again must not overwrite it
+    void supersede_background_render(const std::string& location) {
+        std::lock_guard lock{background_renders_mutex};
+        background_renders.erase(location);
+    }
+
+    // shown until the background render is done
+    std::string get_placeholder(const std::string_view markdown) {
+        return "<pre>" + webber::escape_html(markdown) + "</pre>";
+    }
+
+    // stores the html rendered from the markdown (hashed) with the access, unless the page has been saved with
+    // something else since it was read, in which case whatever saved it also rendered it
+    void store_rendered(webber::database& db, const std::string& location, const std::size_t input_hash, const webber::PageAccess& access, const std::string& html) {
+        webber::transaction t{db};
+        const auto query = db.query("SELECT json FROM pages WHERE location = ?" + std::string{t.get_lock_clause()} + ";", location);
+        if (query.empty() || !query.at(0).contains("json")) {
+            return; // removed while it was being rendered
+        }
+
+        auto json = nlohmann::json::parse(query.at(0).at("json"));
+        if (json.value("input_content_type", "") != "markdown" ||
+            std::hash<std::string>{}(json.value("input_content", "")) != input_hash ||
+            json.value("require_login", false) != access.require_login ||
+            json.value("require_admin", false) != access.require_admin) {
+            return;
+        }
+
+        json["output_content"] = html;
+        if (!db.exec("UPDATE pages SET json = ? WHERE location = ?;", json.dump(), location)) {
+            throw std::runtime_error{"Error updating the pages table."};
+        }
+        t.commit();
+
+        webber::update_export(location, json);
+    }
+
+    // called once the page has been saved, so that the result is never compared against the previous version
+    void render_in_background(const std::string& location, const std::string& markdown, const webber::PageAccess& access, webber::preprocessor::expanded expanded) {
+        uint64_t id{};
+        {
+            std::lock_guard lock{background_renders_mutex};
+            id = background_renders[location] = ++last_background_render;
+        }
+
+        webber::renders.submit([location, id, input_hash = std::hash<std::string>{}(markdown), access, expanded = std::move(expanded)]() {
+            std::string html = expanded.render();
+
+            // the pool has no database connection, the result is stored by a request worker
+            webber::workers.submit([location, id, input_hash, access, html = std::move(html)](webber::database& db) {
+                {
+                    std::lock_guard lock{background_renders_mutex};
+                    const auto it = background_renders.find(location);
+                    if (it == background_renders.end() || it->second != id) {
+                        return;
+                    }
+                    background_renders.erase(it);
+                }
+
+                try {
+                    store_rendered(db, location, input_hash, access, html);
+                } catch (const std::exception& e) {
+                    webber::logger.write_to_log(limhamn::logger::type::error, "Failed to store the rendered page ", location, ": ", e.what(), "\n");
+                }
+            });
+        });
+    }
+
+    // the html to store for the markdown now, or nothing if it is to be rendered in the background, in which case
+    // background is set and passed to render_in_background() once the page has been saved
+    std::optional<std::string> render(webber::database& db, const std::string& location, const std::string& markdown, const webber::PageAccess& access, std::vector<std::string>& dependencies, std::optional<webber::preprocessor::expanded>& background) {
+        webber::preprocessor preprocessor{db};
+        auto expanded = preprocessor.expand(location, markdown, access);
+        dependencies = expanded.dependencies;
+
+        if (is_background_render(markdown)) {
+            background = std::move(expanded);
+            return std::nullopt;
+        }
+
+        supersede_background_render(location);
+        return expanded.render();
+    }
+
+    void render_dependents(webber::database& db, const std::string& location) {
+        // shared by all of them, so that a page several of them include is only rendered once
+        webber::preprocessor preprocessor{db};
+
+        for (const auto& it : webber::get_page_dependents(db, location)) {
+            const auto query = db.query("SELECT json FROM pages WHERE location = ?;", it);
+            if (query.empty() || !query.at(0).contains("json")) {
+                continue;
+            }
+
+            const auto json = nlohmann::json::parse(query.at(0).at("json"));
+            if (json.value("input_content_type", "") != "markdown") {
+                continue;
+            }
+
+            const std::string markdown = json.value("input_content", "");
+            const webber::PageAccess access{
+                .require_login = json.value("require_login", false),
+                .require_admin = json.value("require_admin", false),
+            };
+
+            auto expanded = preprocessor.expand(it, markdown, access);
+            if (is_background_render(markdown)) {
+                render_in_background(it, markdown, access, std::move(expanded));
+            } else {
+                supersede_background_render(it);
+                store_rendered(db, it, std::hash<std::string>{}(markdown), access, expanded.render());
+            }
+        }
+    }
+
+    // re-renders every page that includes the page, on a request worker once the current request is done
+    void schedule_dependents(webber::database& db, const std::string& location) {
+        if (webber::workers.size() == 0) {
+            render_dependents(db, location);
+            return;
+        }
+
+        webber::workers.submit([location](webber::database& db) {
+            try {
+                render_dependents(db, location);
+            } catch (const std::exception& e) {
+                webber::logger.write_to_log(limhamn::logger::type::error, "Failed to re-render the pages including ", location, ": ", e.what(), "\n");
+            }
+        });
+    }
+}
 
 void webber::upload_page(database& db, const webber::PageConstruct& c) {
     enum class ContentType : bool {
@@ -33,9 +191,16 @@ void webber::upload_page(database& db, const webber::PageConstruct& c) {
     json["visits"] = 0;
     json["input_content_type"] = content_type ? "html" : "markdown";
     json["output_content_type"] = "html";
-    json["history"] = nlohmann::json::array();
     json["input_content"] = content_type ? c.html_content : c.markdown_content;
-    json["output_content"] = content_type ? c.html_content : markdown_to_html(c.markdown_content);
+    std::vector<std::string> dependencies{};
+    std::optional<preprocessor::expanded> background{};
+    const PageAccess access{.require_login = c.require_login, .require_admin = c.require_admin};
+    if (content_type) {
+        json["output_content"] = c.html_content;
+    } else {
+        auto html = render(db, c.virtual_path, c.markdown_content, access, dependencies, background);
+        json["output_content"] = html ? std::move(*html) : get_placeholder(c.markdown_content);
+    }
     json["visitors"] = nlohmann::json::array(); /* combine username, ip address, user agent and timestamp */
     json["require_admin"] = c.require_admin;
     json["require_login"] = c.require_login;
@@ -63,6 +228,15 @@ void webber::upload_page(database& db, const webber::PageConstruct& c) {
     if (!db.exec("INSERT INTO pages (location, json) VALUES (?, ?);", c.virtual_path, json.dump())) {
         throw std::runtime_error{"Error inserting into the pages table."};
     }
+
+    update_export(c.virtual_path, json);
+    if (background) {
+        render_in_background(c.virtual_path, c.markdown_content, access, std::move(*background));
+    }
+
+    // pages may have tried to include this one before it existed
+    set_page_dependencies(db, c.virtual_path, dependencies);
+    schedule_dependents(db, c.virtual_path);
 }
 
 bool webber::is_page(database& db, const std::string& location) {
@@ -100,6 +274,19 @@ void webber::remove_page(database& db, const std::string& location) {
     if (db.exec("DELETE FROM pages WHERE location = ?;", location) == false) {
         throw std::runtime_error{"Error deleting from the location table."};
     }
+
+    supersede_background_render(location);
+    {
+        std::lock_guard lock{pending_visits_mutex};
+        if (const auto it = pending_visits.find(location); it != pending_visits.end()) {
+            pending_visit_count -= it->second.size();
+            pending_visits.erase(it);
+        }
+    }
+    remove_export(location);
+    remove_page_revisions(db, location);
+    set_page_dependencies(db, location, {});
+    schedule_dependents(db, location);
 }
 
 void webber::update_page(database& db, const PageConstruct& c) {
@@ -114,16 +301,10 @@ void webber::update_page(database& db, const PageConstruct& c) {
         throw std::runtime_error{"Page does not exist."};
     }
 
-    const auto query = db.query("SELECT * FROM pages WHERE location = ?;", c.virtual_path);
-    if (query.empty() || !query.at(0).contains("json")) {
-        throw std::runtime_error{"Query is empty or JSON not found."};
-    }
     if (c.html_content.empty() && c.markdown_content.empty()) {
         throw std::runtime_error{"Content is empty."};
     }
 
-    auto json = nlohmann::json::parse(query.at(0).at("json"));
-
     enum class ContentType : bool {
         HTML = true,
         Markdown = false,
@@ -144,30 +325,31 @@ void webber::update_page(database& db, const PageConstruct& c) {
         throw std::runtime_error{"Content is empty."};
     }
 
-    // populate history
-    if (json.find("history") != json.end() && json.at("history").is_array()) {
-        nlohmann::json history;
-
-        if (json.contains("updated_at")) history["updated_at"] = json.at("updated_at");
-        if (json.contains("replaced_at")) history["replaced_at"] = scrypto::return_unix_timestamp();
-        if (json.contains("username")) history["username"] = json.at("username");
-        if (json.contains("ip_address")) history["ip_address"] = json.at("ip_address");
-        if (json.contains("user_agent")) history["user_agent"] = json.at("user_agent");
-        if (json.contains("replaced_by_username")) history["replaced_by_username"] = c.username;
-        if (json.contains("replaced_by_ip_address")) history["replaced_by_ip_address"] = c.ip_address;
-        if (json.contains("replaced_by_user_agent")) history["replaced_by_user_agent"] = c.user_agent;
-        if (json.contains("input_content_type")) history["input_content_type"] = json.at("input_content_type");
-        if (json.contains("output_content_type")) history["output_content_type"] = json.at("output_content_type");
-        if (json.contains("input_content")) history["input_content"] = json.at("input_content");
-        if (json.contains("output_content")) history["output_content"] = json.at("output_content");
-        if (json.contains("visitors_at_the_time")) history["visitors_at_the_time"] = json.at("visitors");
-        if (json.contains("visits_at_the_time")) history["visits_at_the_time"] = json.at("visits");
-        if (json.contains("require_admin")) history["require_admin"] = json.at("require_admin");
-        if (json.contains("require_login")) history["require_login"] = json.at("require_login");
+    // rendered before the page is locked, it doesn't depend on what is stored
+    std::optional<std::string> html{};
+    std::vector<std::string> dependencies{};
+    std::optional<preprocessor::expanded> background{};
+    const PageAccess access{.require_login = c.require_login, .require_admin = c.require_admin};
+    if (content_type) {
+        supersede_background_render(c.virtual_path);
+        html = c.html_content;
+    } else {
+        html = render(db, c.virtual_path, c.markdown_content, access, dependencies, background);
+    }
 
-        json["history"].push_back(history);
+    // the revision and the page are written together, and nothing else writes the page in between
+    transaction t{db};
+    const auto query = db.query("SELECT json FROM pages WHERE location = ?" + std::string{t.get_lock_clause()} + ";", c.virtual_path);
+    if (query.empty() || !query.at(0).contains("json")) {
+        throw std::runtime_error{"Query is empty or JSON not found."};
     }
 
+    auto json = nlohmann::json::parse(query.at(0).at("json"));
+
+    // pages saved before revisions were kept out of line still carry their history
+    migrate_page_history(db, c.virtual_path, json);
+    add_page_revision(db, c.virtual_path, json, c.username, c.ip_address, c.user_agent);
+
     if (!c.username.empty()) json["username"] = c.username;
     if (!c.ip_address.empty()) json["ip_address"] = c.ip_address;
     if (!c.user_agent.empty()) json["user_agent"] = c.user_agent;
@@ -179,113 +361,189 @@ void webber::update_page(database& db, const PageConstruct& c) {
     json["input_content_type"] = content_type ? "html" : "markdown";
     json["output_content_type"] = "html";
     json["input_content"] = content_type ? c.html_content : c.markdown_content;
-    json["output_content"] = content_type ? c.html_content : markdown_to_html(c.markdown_content);
+    if (html) {
+        json["output_content"] = std::move(*html);
+    } else if (!json.contains("output_content")) {
+        json["output_content"] = get_placeholder(c.markdown_content);
+    } // otherwise the previous version is shown until the background render is done
 
     if (!db.exec("UPDATE pages SET json = ? WHERE location = ?;", json.dump(), c.virtual_path)) {
         throw std::runtime_error{"Error updating the pages table."};
     }
-}
 
-webber::RetrievedPage webber::download_page(database& db, const webber::UserProperties& prop, const std::string& page, const bool get_json) {
-    if (!db.good()) {
-        throw std::runtime_error{"Database is not good."};
-    }
-    if (prop.ip_address.empty() || prop.user_agent.empty() || page.empty()) {
-        throw std::runtime_error{"IP address, user agent, or file key is empty."};
+    set_page_dependencies(db, c.virtual_path, dependencies);
+    t.commit();
+
+    update_export(c.virtual_path, json);
+    if (background) {
+        render_in_background(c.virtual_path, c.markdown_content, access, std::move(*background));
     }
+    schedule_dependents(db, c.virtual_path);
+}
 
-    nlohmann::json visitors;
+namespace {
+    nlohmann::json make_visitor(const webber::UserProperties& prop) {
+        nlohmann::json visitor;
 
-    visitors["username"] = prop.username;
-    visitors["ip_address"] = prop.ip_address;
-    visitors["user_agent"] = prop.user_agent;
-    visitors["timestamp"] = scrypto::return_unix_timestamp();
+        visitor["username"] = prop.username.empty() ? "_nouser_" : prop.username;
+        visitor["ip_address"] = prop.ip_address;
+        visitor["user_agent"] = prop.user_agent;
+        visitor["timestamp"] = scrypto::return_unix_timestamp();
 
-    if (prop.username.empty()) {
-        visitors["username"] = "_nouser_";
+        return visitor;
     }
+}
 
-    /* select all matching page */
-    const auto query = db.query("SELECT * FROM pages WHERE location = ?;", page);
-    if (query.empty()) {
-        throw std::runtime_error{"Query is empty."};
-    }
+void webber::record_visit(const std::string& page, const UserProperties& prop) {
+    {
+        std::lock_guard lock{pending_visits_mutex};
+        if (pending_visit_count == 0) {
+            pending_visits_since = std::chrono::steady_clock::now();
+        }
+        pending_visits[page].push_back(make_visitor(prop));
+        ++pending_visit_count;
 
-    // get json
-    nlohmann::json json;
-    try {
-        json = nlohmann::json::parse(query.at(0).at("json"));
-    } catch (const std::exception&) {
-        throw std::runtime_error{"Error parsing JSON."};
+        if (pending_visits_flush_scheduled || workers.size() == 0 || (pending_visit_count < 1024 && std::chrono::steady_clock::now() - pending_visits_since < std::chrono::seconds(60))) {
+            return;
+        }
+        pending_visits_flush_scheduled = true;
     }
 
-    if (json.find("visits") != json.end() && json.at("visits").is_number()) {
-        json["visits"] = json.at("visits").get<int>() + 1;
-    }
-    if (json.find("visitors") != json.end() && json.at("visitors").is_array()) {
-        json["visitors"].push_back(visitors);
+    workers.submit([](database& db) {
+        try {
+            flush_visits(db);
+        } catch (const std::exception& e) {
+            logger.write_to_log(limhamn::logger::type::error, "Failed to write the pending visits: ", e.what(), "\n");
+        }
+    });
+}
+
+void webber::flush_visits(database& db) {
+    std::unordered_map<std::string, std::vector<nlohmann::json>> visits{};
+    {
+        std::lock_guard lock{pending_visits_mutex};
+        visits.swap(pending_visits);
+        pending_visit_count = 0;
+        pending_visits_flush_scheduled = false;
     }
 
-    webber::RetrievedPage p;
-    if (json.find("input_content") == json.end() || !json.at("input_content").is_string()) {
-        throw std::runtime_error{"Input content not found."};
+    for (auto& [location, visitors] : visits) {
+        transaction t{db};
+        const auto query = db.query("SELECT json FROM pages WHERE location = ?" + std::string{t.get_lock_clause()} + ";", location);
+        if (query.empty() || !query.at(0).contains("json")) {
+            continue; // removed since
+        }
+
+        auto json = nlohmann::json::parse(query.at(0).at("json"));
+        if (json.contains("visits") && json.at("visits").is_number()) {
+            json["visits"] = json.at("visits").get<int>() + static_cast<int>(visitors.size());
+        }
+        if (json.contains("visitors") && json.at("visitors").is_array()) {
+            for (auto& it : visitors) {
+                json["visitors"].push_back(std::move(it));
+            }
+        }
+
+        if (!db.exec("UPDATE pages SET json = ? WHERE location = ?;", json.dump(), location)) {
+            throw std::runtime_error{"Error updating the pages table."};
+        }
+        t.commit();
     }
-    if (json.find("output_content") == json.end() || !json.at("output_content").is_string()) {
-        throw std::runtime_error{"Output content not found."};
+}
+
+webber::RetrievedPage webber::download_page(database& db, const webber::UserProperties& prop, const std::string& page, const bool get_json) {
+    const trace::span span{"download_page"};
+    if (!db.good()) {
+        throw std::runtime_error{"Database is not good."};
     }
-    if (json.find("input_content_type") == json.end() || !json.at("input_content_type").is_string()) {
-        throw std::runtime_error{"Input content type not found."};
+    if (prop.ip_address.empty() || prop.user_agent.empty() || page.empty()) {
+        throw std::runtime_error{"IP address, user agent, or file key is empty."};
     }
-    if (json.find("output_content_type") == json.end() || !json.at("output_content_type").is_string()) {
-        throw std::runtime_error{"Output content type not found."};
+
+    std::vector<nlohmann::json> visitors{make_visitor(prop)};
+    {
+        std::lock_guard lock{pending_visits_mutex};
+        if (const auto it = pending_visits.find(page); it != pending_visits.end()) {
+            visitors.insert(visitors.end(), std::make_move_iterator(it->second.begin()), std::make_move_iterator(it->second.end()));
+            pending_visit_count -= it->second.size();
+            pending_visits.erase(it);
+        }
     }
 
-    p.output_content = json.at("output_content").get<std::string>();
-    p.input_content = json.at("input_content").get<std::string>();
-    p.input_content_type = json.at("input_content_type").get<std::string>();
-    p.output_content_type = json.at("output_content_type").get<std::string>();
-    if (json.contains("require_admin")) p.require_admin = json.at("require_admin").get<bool>();
-    if (json.contains("require_login")) p.require_login = json.at("require_login").get<bool>();
+    try {
+        // the visit is written back with the rest of the page, which nothing else may change in between
+        transaction t{db};
+        const auto query = db.query("SELECT json FROM pages WHERE location = ?" + std::string{t.get_lock_clause()} + ";", page);
+        if (query.empty()) {
+            throw std::runtime_error{"Query is empty."};
+        }
 
-    if (get_json) {
-        p.json = json.dump();
-    }
+        // get json
+        nlohmann::json json;
+        try {
+            json = nlohmann::json::parse(query.at(0).at("json"));
+        } catch (const std::exception&) {
+            throw std::runtime_error{"Error parsing JSON."};
+        }
 
-    if (!db.exec("UPDATE pages SET json = ? WHERE location = ?;", json.dump(), page)) {
-        throw std::runtime_error{"Error updating the pages table."};
-    }
+        if (json.find("visits") != json.end() && json.at("visits").is_number()) {
+            json["visits"] = json.at("visits").get<int>() + static_cast<int>(visitors.size());
+        }
+        if (json.find("visitors") != json.end() && json.at("visitors").is_array()) {
+            for (const auto& it : visitors) {
+                json["visitors"].push_back(it); // copied, they are buffered again if the write fails
+            }
+        }
+
+        webber::RetrievedPage p;
+        if (json.find("input_content") == json.end() || !json.at("input_content").is_string()) {
+            throw std::runtime_error{"Input content not found."};
+        }
+        if (json.find("output_content") == json.end() || !json.at("output_content").is_string()) {
+            throw std::runtime_error{"Output content not found."};
+        }
+        if (json.find("input_content_type") == json.end() || !json.at("input_content_type").is_string()) {
+            throw std::runtime_error{"Input content type not found."};
+        }
+        if (json.find("output_content_type") == json.end() || !json.at("output_content_type").is_string()) {
+            throw std::runtime_error{"Output content type not found."};
+        }
+
+        p.output_content = json.at("output_content").get<std::string>();
+        p.input_content = json.at("input_content").get<std::string>();
+        p.input_content_type = json.at("input_content_type").get<std::string>();
+        p.output_content_type = json.at("output_content_type").get<std::string>();
+        if (json.contains("require_admin")) p.require_admin = json.at("require_admin").get<bool>();
+        if (json.contains("require_login")) p.require_login = json.at("require_login").get<bool>();
+
+        if (get_json) {
+            p.json = json.dump();
+        }
 
-    return p;
+        if (!db.exec("UPDATE pages SET json = ? WHERE location = ?;", json.dump(), page)) {
+            throw std::runtime_error{"Error updating the pages table."};
+        }
+        t.commit();
+
+        return p;
+    } catch (...) {
+        // the visits buffered for other requests were not written, keep them for the next write
+        if (visitors.size() > 1) {
+            std::lock_guard lock{pending_visits_mutex};
+            if (pending_visit_count == 0) {
+                pending_visits_since = std::chrono::steady_clock::now();
+            }
+            auto& pending = pending_visits[page];
+            pending.insert(pending.end(), std::make_move_iterator(visitors.begin() + 1), std::make_move_iterator(visitors.end()));
+            pending_visit_count += visitors.size() - 1;
+        }
+        throw;
+    }
 }
 
-std::string webber::markdown_to_html(const std::string& markdown) {
-    maddy::Parser parser;
-
-    /* preprocessor list:
-     *
-     * {{meta.title=...}}
-     * {{meta.description=...}}
-     * {{meta.keywords=...}}
-     * ...
-     * {{script[...]}}
-     * {{style[...]}}
-     * ...
-     * {{include[...]}}
-     * ...
-     * {{window.redirect=...}}
-     * ...
-     * {{template.spoiler[...]}}
-     * ...
-     * {{if(x)[...]}}
-     * {{else[...]}}
-     * {{else_if(x)[...]}}
-     *
-     * x - javascript to execute. if it returns true, the ... is to be included
-     * ... - HTML
-     *
-     * TODO: implement
-     */
-
-    std::istringstream stream{markdown};
-    return parser.Parse(stream);
-}
\ No newline at end of file
+std::string webber::markdown_to_html(const std::string_view markdown) {
+    const trace::span span{"markdown_to_html"};
+
+    // without the directives, see preprocessor.hpp
+    return markdown_renderer::get_local().render(markdown);
+}
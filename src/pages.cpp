@@ -1,21 +1,89 @@
+#include <cctype>
+#include <charconv>
+#include <cstdio>
+#include <mutex>
+#include <variant>
+#include <openssl/crypto.h>
 #include <webber.hpp>
 #include <prebuilt.hpp>
 #include <limhamn/http/http_server.hpp>
 #include <nlohmann/json.hpp>
+#include <metrics.hpp>
+#include <trace.hpp>
+#include <single_flight.hpp>
+#include <log_reader.hpp>
+#include <log_hub.hpp>
+#include <revisions.hpp>
+
+std::string webber::get_bootstrapped_index(const std::string& path, const std::string& page) {
+    std::string html = open_file(current_settings()->data_directory + "/index.html");
+
+    std::string bootstrap{"{\"settings\":"};
+    try {
+        bootstrap += get_client_settings()->body;
+    } catch (const std::exception&) {
+        bootstrap += "null";
+    }
+    bootstrap += ",\"page\":{\"path\":" + nlohmann::json(path).dump() + ",\"response\":" + page + "}}";
+
+    // json has no < outside of strings, and escaping it keeps </script> and <!-- in the content from ending the element
+    std::string element{"<script id=\"webber-bootstrap\" type=\"application/json\">"};
+    element.reserve(element.size() + bootstrap.size() + 16);
+    for (const char c : bootstrap) {
+        if (c == '<') {
+            element += "\\u003c";
+        } else {
+            element += c;
+        }
+    }
+    element += "</script>";
+
+    // before main.js, and after the charset which has to be in the first kilobyte
+    std::size_t pos = html.find("<script");
+    if (pos == std::string::npos) {
+        pos = html.find("</head>");
+    }
+    html.insert(pos == std::string::npos ? 0 : pos, element);
+
+    return html;
+}
 
 limhamn::http::server::response webber::get_index_page(const limhamn::http::server::request& request, database& db) {
-    return {
+    // what main.js would fetch right after loading, embedded so that the first paint doesn't wait for two more round trips.
+    // a page goes through get_api_get_page(), so it gets the same access checks and counts the visit the same way; any
+    // other path (a 404, a probe) costs one lookup and gets the answer main.js would get, without a session check or a write
+    const trace::span span{"bootstrap"};
+
+    const std::string path = request.endpoint.substr(0, request.endpoint.find('?'));
+    std::string page{};
+    if (!path.empty() && is_page(db, path)) {
+        limhamn::http::server::request page_request = request;
+        page_request.body = nlohmann::json{{"page", path}}.dump();
+        page = get_api_get_page(page_request, db).body;
+    } else {
+        nlohmann::json json;
+        json["error"] = "WEBBER_PAGE_NOT_FOUND";
+        json["error_str"] = "Page not found.";
+        page = json.dump();
+    }
+
+    limhamn::http::server::response response{
         .http_status = 200,
         .content_type = "text/html",
-        .body = open_file(settings.data_directory + "/index.html"),
+        .body = get_bootstrapped_index(path, page),
     };
+
+    // it depends on who is asking
+    response.headers.push_back({"Cache-Control", "private, no-cache"});
+
+    return response;
 }
 
 limhamn::http::server::response webber::get_stylesheet(const limhamn::http::server::request& request, database& db) {
     return {
         .http_status = 200,
         .content_type = "text/css",
-        .body = open_file(settings.data_directory + "/style.css"),
+        .body = open_file(current_settings()->data_directory + "/style.css"),
     };
 }
 
@@ -29,7 +97,7 @@ limhamn::http::server::response webber::get_script(const limhamn::http::server::
     // a project like this. But I simply cannot be bothered to write a JS minifier myself, nor
     // am I aware of any C++ library for doing such a thing, and I am therefore just going to call uglifyjs.
     const auto uglify_file = [](const std::string& path) -> std::string {
-        static const std::string temp_file = settings.temp_directory + "/ff_temp.js";
+        static const std::string temp_file = current_settings()->temp_directory + "/ff_temp.js";
         if (std::filesystem::is_regular_file(temp_file)) {
             return temp_file;
         }
@@ -48,9 +116,9 @@ limhamn::http::server::response webber::get_script(const limhamn::http::server::
     };
 
 #if WEBBER_DEBUG
-    response.body = open_file(settings.data_directory + "/script.js");
+    response.body = open_file(current_settings()->data_directory + "/script.js");
 #else
-    std::string path = uglify_file(settings.data_directory + "/script.js");
+    std::string path = uglify_file(current_settings()->data_directory + "/script.js");
     response.body = open_file(path);
 #endif
 
@@ -61,7 +129,7 @@ limhamn::http::server::response webber::get_setup_page(const limhamn::http::serv
     return {
         .http_status = 200,
         .content_type = "text/html",
-        .body = open_file(settings.data_directory + "/setup.html"),
+        .body = open_file(current_settings()->data_directory + "/setup.html"),
     };
 }
 
@@ -385,19 +453,72 @@ limhamn::http::server::response webber::get_api_try_setup(const limhamn::http::s
     }
 }
 
-// TODO: Implement the following functions
-limhamn::http::server::response webber::get_api_get_settings(const limhamn::http::server::request& request, database& db) {
-    limhamn::http::server::response response{};
+namespace {
+    std::atomic<std::shared_ptr<const webber::ClientSettings>> client_settings{};
+    std::mutex client_settings_mutex{}; // held while settings.json is read or written
 
-    try {
-        nlohmann::json file_json = nlohmann::json::parse(open_file(settings.data_directory + "/settings.json"));
-        nlohmann::json default_json = nlohmann::json::parse(default_settings);
-        for (const auto& it : default_json.items()) {
+    std::shared_ptr<const webber::ClientSettings> make_client_settings(nlohmann::json file_json) {
+        for (const auto& it : nlohmann::json::parse(webber::default_settings).items()) {
             if (!file_json.contains(it.key())) {
                 file_json[it.key()] = it.value();
             }
         }
-        response.body = file_json.dump();
+
+        auto ret = std::make_shared<webber::ClientSettings>();
+        ret->body = file_json.dump();
+
+        char hash[17]{};
+        std::snprintf(hash, sizeof(hash), "%016zx", std::hash<std::string>{}(ret->body));
+        ret->etag = "\"" + std::string{hash} + "\"";
+
+        return ret;
+    }
+
+    bool has_etag(const limhamn::http::server::request& request, const std::string& etag) {
+        for (const auto& it : request.headers) {
+            if (it.name.size() == 13 && std::ranges::equal(it.name, std::string_view{"if-none-match"}, [](const char a, const char b) { return std::tolower(a) == b; })) {
+                return it.data == etag || it.data == "W/" + etag;
+            }
+        }
+
+        return false;
+    }
+}
+
+std::shared_ptr<const webber::ClientSettings> webber::get_client_settings() {
+    if (auto ret = client_settings.load(std::memory_order_acquire)) {
+        return ret;
+    }
+
+    std::lock_guard lock{client_settings_mutex};
+    if (auto ret = client_settings.load(std::memory_order_acquire)) {
+        return ret;
+    }
+
+    auto ret = make_client_settings(nlohmann::json::parse(open_file(current_settings()->data_directory + "/settings.json")));
+    client_settings.store(ret, std::memory_order_release);
+    return ret;
+}
+
+void webber::reset_client_settings() {
+    std::lock_guard lock{client_settings_mutex};
+    client_settings.store(nullptr, std::memory_order_release);
+}
+
+limhamn::http::server::response webber::get_api_get_settings(const limhamn::http::server::request& request, database& db) {
+    limhamn::http::server::response response{};
+
+    try {
+        const auto snapshot = get_client_settings();
+        // revalidated on every load, which costs a 304 and no body once the browser has them
+        response.headers.push_back({"ETag", snapshot->etag});
+        response.headers.push_back({"Cache-Control", "no-cache"});
+        if (has_etag(request, snapshot->etag)) {
+            response.http_status = 304;
+            return response;
+        }
+
+        response.body = snapshot->body;
         response.http_status = 200;
     } catch (const std::exception&) {
         nlohmann::json json;
@@ -433,7 +554,11 @@ limhamn::http::server::response webber::get_api_update_settings(const limhamn::h
 
     try {
         nlohmann::json input_json = nlohmann::json::parse(request.body);
-        nlohmann::json file_json = nlohmann::json::parse(open_file(settings.data_directory + "/settings.json"));
+
+        // so that two updates at once can't each drop the other's changes
+        std::lock_guard lock{client_settings_mutex};
+        const std::string path = current_settings()->data_directory + "/settings.json";
+        nlohmann::json file_json = nlohmann::json::parse(open_file(path));
         for (const auto& it : input_json.items()) {
             if (it.key() == "username" || it.key() == "key") {
                 continue;
@@ -446,9 +571,8 @@ limhamn::http::server::response webber::get_api_update_settings(const limhamn::h
             file_json[it.key()] = it.value();
         }
 
-        std::ofstream file(settings.data_directory + "/settings.json", std::ios::trunc);
-        file << file_json.dump();
-        file.close();
+        write_file(path, file_json.dump());
+        client_settings.store(make_client_settings(std::move(file_json)), std::memory_order_release);
 
         return {
             .http_status = 204,
@@ -463,6 +587,20 @@ limhamn::http::server::response webber::get_api_update_settings(const limhamn::h
     }
 }
 
+std::string webber::get_page_body(const RetrievedPage& page) {
+    const trace::span span{"serialize"};
+
+    nlohmann::json json;
+    if (!page.input_content.empty()) json["input_content"] = page.input_content;
+    if (!page.output_content.empty()) json["output_content"] = page.output_content;
+    if (!page.input_content_type.empty()) json["input_content_type"] = page.input_content_type;
+    if (!page.output_content_type.empty()) json["output_content_type"] = page.output_content_type;
+    json["require_login"] = page.require_login;
+    json["require_admin"] = page.require_admin;
+
+    return json.dump();
+}
+
 limhamn::http::server::response webber::get_api_get_page(const limhamn::http::server::request& request, database& db) {
     limhamn::http::server::response response{};
 
@@ -510,19 +648,41 @@ limhamn::http::server::response webber::get_api_get_page(const limhamn::http::se
     }
 
     const std::string page = json.at("page").get<std::string>();
-    if (!is_page(db, page)) {
-        nlohmann::json return_json;
-        response.http_status = 400;
-        return_json["error"] = "WEBBER_PAGE_NOT_FOUND";
-        return_json["error_str"] = "Page not found.";
-        response.body = return_json.dump();
-        return response;
-    }
+    const bool get_json = json_requested && is_admin;
+    const UserProperties prop{
+        .username = stat.second,
+        .ip_address = request.ip_address,
+        .user_agent = request.user_agent,
+    };
+
+    // a popular page is fetched once for everyone asking for it at the same time; besides the location,
+    // the result only depends on whether an administrator asked for the json, the login checks below are per request
+    static single_flight<std::optional<RetrievedPage>> flights{};
 
     try {
-        const RetrievedPage ret = download_page(db,
-            { .ip_address = request.ip_address, .user_agent = request.user_agent, .username = stat.second},
-            page, (json_requested && is_admin));
+        const auto flight = flights.run(page + (get_json ? "\njson" : "\n"), [&]() -> std::optional<RetrievedPage> {
+            if (!is_page(db, page)) {
+                return std::nullopt;
+            }
+
+            return download_page(db, prop, page, get_json);
+        });
+
+        if (!flight.value) {
+            nlohmann::json return_json;
+            response.http_status = 400;
+            return_json["error"] = "WEBBER_PAGE_NOT_FOUND";
+            return_json["error_str"] = "Page not found.";
+            response.body = return_json.dump();
+            return response;
+        }
+
+        // the visit was not recorded by the request that did the work
+        if (flight.shared) {
+            record_visit(page, prop);
+        }
+
+        const RetrievedPage& ret = *flight.value;
 
         if (ret.require_login && !stat.first) {
             response.http_status = 400;
@@ -549,16 +709,7 @@ limhamn::http::server::response webber::get_api_get_page(const limhamn::http::se
         } else {
             response.content_type = "application/json";
             response.http_status = 200;
-            nlohmann::json response_json;
-
-            if (!ret.input_content.empty()) response_json["input_content"] = ret.input_content;
-            if (!ret.output_content.empty()) response_json["output_content"] = ret.output_content;
-            if (!ret.input_content_type.empty()) response_json["input_content_type"] = ret.input_content_type;
-            if (!ret.output_content_type.empty()) response_json["output_content_type"] = ret.output_content_type;
-            response_json["require_login"] = ret.require_login;
-            response_json["require_admin"] = ret.require_admin;
-
-            response.body = response_json.dump();
+            response.body = get_page_body(ret);
             return response;
         }
     } catch (const std::exception&) {
@@ -872,9 +1023,18 @@ limhamn::http::server::response webber::get_api_upload_file(const limhamn::http:
         return response;
     }
 
-    const UploadStatus status = upload_file(request, database);
+    metrics::uploads_in_flight.fetch_add(1, std::memory_order_relaxed);
+    UploadStatus status{UploadStatus::Failure};
+    try {
+        status = upload_file(request, database);
+    } catch (const std::exception&) {
+        metrics::uploads_in_flight.fetch_sub(1, std::memory_order_relaxed);
+        throw;
+    }
+    metrics::uploads_in_flight.fetch_sub(1, std::memory_order_relaxed);
 
     if (status == UploadStatus::Success) {
+        metrics::add_upload_bytes(request.raw_body.size());
         response.http_status = 204;
         return response;
     } else {
@@ -1049,6 +1209,133 @@ limhamn::http::server::response webber::get_api_get_hierarchy(const limhamn::htt
     return response;
 }
 
+namespace {
+    // the page from the request body of the revision apis, or the error to send back
+    std::variant<std::string, limhamn::http::server::response> get_revision_page(const limhamn::http::server::request& request, webber::database& db, nlohmann::json& json) {
+        limhamn::http::server::response response{};
+        response.http_status = 400;
+
+        const auto stat = webber::is_logged_in(request, db);
+        if (!stat.first || stat.second.empty()) {
+            nlohmann::json return_json;
+            return_json["error"] = "WEBBER_INVALID_CREDS";
+            return_json["error_str"] = "Invalid credentials.";
+            response.body = return_json.dump();
+            return response;
+        }
+        // they hold the ip address and user agent of everyone who edited the page
+        if (webber::get_user_type(db, stat.second) != webber::UserType::Administrator) {
+            nlohmann::json return_json;
+            return_json["error"] = "WEBBER_NOT_ADMIN";
+            return_json["error_str"] = "Not an administrator.";
+            response.body = return_json.dump();
+            return response;
+        }
+
+        try {
+            json = nlohmann::json::parse(request.body);
+        } catch (const std::exception&) {
+            nlohmann::json return_json;
+            return_json["error"] = "WEBBER_INVALID_JSON";
+            return_json["error_str"] = "Invalid JSON.";
+            response.body = return_json.dump();
+            return response;
+        }
+
+        if (json.contains("page") == false || json.at("page").is_string() == false) {
+            nlohmann::json return_json;
+            return_json["error"] = "WEBBER_MISSING_PAGE";
+            return_json["error_str"] = "Page missing.";
+            response.body = return_json.dump();
+            return response;
+        }
+
+        return json.at("page").get<std::string>();
+    }
+}
+
+limhamn::http::server::response webber::get_api_get_revisions(const limhamn::http::server::request& request, database& db) {
+    nlohmann::json json;
+    const auto page = get_revision_page(request, db, json);
+    if (const auto* response = std::get_if<limhamn::http::server::response>(&page)) {
+        return *response;
+    }
+
+    const std::string& location = std::get<std::string>(page);
+    limhamn::http::server::response response{};
+
+    try {
+        // the history of a page that hasn't been saved since revisions were kept out of line is still in its json.
+        // locked, so that a save in between isn't undone and two of these don't both move the same history
+        transaction t{db};
+        if (const auto query = db.query("SELECT json FROM pages WHERE location = ?" + std::string{t.get_lock_clause()} + ";", location); !query.empty() && query.at(0).contains("json")) {
+            auto page_json = nlohmann::json::parse(query.at(0).at("json"));
+            if (migrate_page_history(db, location, page_json) && !db.exec("UPDATE pages SET json = ? WHERE location = ?;", page_json.dump(), location)) {
+                throw std::runtime_error{"Error updating the pages table."};
+            }
+        }
+        t.commit();
+
+        nlohmann::json return_json;
+        return_json["revisions"] = list_page_revisions(db, location);
+        response.body = return_json.dump();
+        response.http_status = 200;
+    } catch (const std::exception&) {
+        nlohmann::json return_json;
+        return_json["error"] = "WEBBER_FAILURE";
+        return_json["error_str"] = "Failed to get the revisions.";
+        response.body = return_json.dump();
+        response.http_status = 400;
+    }
+
+    return response;
+}
+
+limhamn::http::server::response webber::get_api_get_revision(const limhamn::http::server::request& request, database& db) {
+    nlohmann::json json;
+    const auto page = get_revision_page(request, db, json);
+    if (const auto* response = std::get_if<limhamn::http::server::response>(&page)) {
+        return *response;
+    }
+
+    limhamn::http::server::response response{};
+    if (json.contains("revision") == false || json.at("revision").is_number_integer() == false) {
+        nlohmann::json return_json;
+        response.http_status = 400;
+        return_json["error"] = "WEBBER_MISSING_REVISION";
+        return_json["error_str"] = "Revision missing.";
+        response.body = return_json.dump();
+        return response;
+    }
+
+    try {
+        const auto revision = get_page_revision(db, std::get<std::string>(page), json.at("revision").get<int64_t>());
+        if (!revision) {
+            nlohmann::json return_json;
+            response.http_status = 400;
+            return_json["error"] = "WEBBER_REVISION_NOT_FOUND";
+            return_json["error_str"] = "Revision not found.";
+            response.body = return_json.dump();
+            return response;
+        }
+
+        nlohmann::json return_json = revision->metadata;
+        return_json["revision"] = revision->revision;
+        return_json["input_content"] = revision->input_content;
+        return_json["output_content"] = revision->output_content;
+        response.body = return_json.dump();
+        response.http_status = 200;
+    } catch (const std::exception&) {
+        nlohmann::json return_json;
+        return_json["error"] = "WEBBER_FAILURE";
+        return_json["error_str"] = "Failed to get the revision.";
+        response.body = return_json.dump();
+        response.http_status = 400;
+    }
+
+    return response;
+}
+
 limhamn::http::server::response webber::get_api_get_logs(const limhamn::http::server::request& request, database& db) {
     limhamn::http::server::response response{};
 
@@ -1125,94 +1412,316 @@ limhamn::http::server::response webber::get_api_get_logs(const limhamn::http::se
         }
     }
 
-    for (const auto& it : {webber::settings.access_file, webber::settings.error_file, webber::settings.notice_file, webber::settings.warning_file}) {
-        if (!s.get_access && it == webber::settings.access_file) {
-            continue;
-        } else if (!s.get_errors && it == webber::settings.error_file) {
-            continue;
-        } else if (!s.get_notices && it == webber::settings.notice_file) {
-            continue;
-        } else if (!s.get_warnings && it == webber::settings.warning_file) {
-            continue;
-        }
+    // every line is read into memory, so don't let a single request ask for an unbounded amount of them
+    const auto count = static_cast<std::size_t>(std::clamp<int64_t>(s.backlog, 0, 100000));
 
-        std::ifstream file(it);
-        if (!file.is_open()) {
+    const auto snapshot = webber::current_settings();
+
+    const Settings& config = *snapshot;
+    std::vector<std::vector<std::string>> files{};
+    for (const auto& [path, enabled] : {
+        std::pair{&config.access_file, s.get_access},
+        std::pair{&config.error_file, s.get_errors},
+        std::pair{&config.notice_file, s.get_notices},
+        std::pair{&config.warning_file, s.get_warnings},
+    }) {
+        if (!enabled) {
             continue;
         }
 
-        std::vector<std::string> lines;
-        std::string line;
-        while (std::getline(file, line)) {
-            lines.push_back(line);
-        }
+        files.push_back(s.direction == direction::down ? logs::read_tail(*path, count) : logs::read_head(*path, count));
+    }
 
-        if (s.direction == direction::down) {
-            std::ranges::reverse(lines);
-        }
+    response.body = logs::merge(files);
 
-        int i{0};
-        for (const auto& l : lines) {
-            response.body += l + "\n";
-            ++i;
-            if (i >= s.backlog) {
-                break;
-            }
-        }
+    return response;
+}
+
+limhamn::http::server::response webber::get_api_reload_settings(const limhamn::http::server::request& request, database& db) {
+    limhamn::http::server::response response{};
+
+    const auto stat = is_logged_in(request, db);
+    if (!stat.first || stat.second.empty()) {
+        response.http_status = 400;
+        nlohmann::json json;
+        json["error"] = "WEBBER_INVALID_CREDS";
+        json["error_str"] = "Invalid credentials.";
+        response.body = json.dump();
+        return response;
+    }
 
-        response.body += "\n";
+    if (get_user_type(db, stat.second) != UserType::Administrator) {
+        response.http_status = 400;
+        nlohmann::json json;
+        json["error"] = "WEBBER_NOT_ADMIN";
+        json["error_str"] = "Not an administrator.";
+        response.body = json.dump();
+        return response;
+    }
+
+    if (!reload_settings()) {
+        response.http_status = 400;
+        nlohmann::json json;
+        json["error"] = "WEBBER_FAILURE";
+        json["error_str"] = "Failed to reload the configuration file. The previous settings are still in use.";
+        response.body = json.dump();
+        return response;
     }
 
-    const auto extract_numbers = [](const std::string& str) -> std::vector<int> {
-        std::vector<int> numbers;
-        std::stringstream ss(str);
-        std::string temp;
-        int found;
-        while (!ss.eof()) {
-            ss >> temp;
-            if (std::stringstream(temp) >> found) {
-                numbers.push_back(found);
+    response.http_status = 204;
+    return response;
+}
+
+limhamn::http::server::response webber::get_api_metrics(const limhamn::http::server::request& request, database& db) {
+    limhamn::http::server::response response{};
+
+    // scrapers usually can't log in, so they may send the metrics token instead; the address proves nothing,
+    // since it may come from X-Forwarded-For
+    bool has_token{false};
+    if (const std::string token = current_settings()->metrics_token; !token.empty()) {
+        const std::string expected = "Bearer " + token;
+        for (const auto& it : request.headers) {
+            if (it.name.size() == 13 && std::ranges::equal(it.name, std::string_view{"authorization"}, [](const char a, const char b) { return std::tolower(a) == b; })) {
+                has_token = it.data.size() == expected.size() && CRYPTO_memcmp(it.data.data(), expected.data(), expected.size()) == 0;
             }
-            temp = "";
         }
-        return numbers;
-    };
+    }
 
-    const auto sort_string_numerically = [&extract_numbers](const std::string& string) -> std::string {
-        // split the string into lines
-        std::vector<std::string> strings;
-        std::stringstream ss(string);
-        std::string line;
-        while (std::getline(ss, line, '\n')) {
-            strings.push_back(line);
+    if (!has_token) {
+        const auto stat = is_logged_in(request, db);
+        if (!stat.first || stat.second.empty()) {
+            response.http_status = 400;
+            nlohmann::json json;
+            json["error"] = "WEBBER_INVALID_CREDS";
+            json["error_str"] = "Invalid credentials.";
+            response.body = json.dump();
+            return response;
         }
 
-        std::vector<std::pair<int, std::string>> numbered_strings;
-        for (const auto& str : strings) {
-            std::vector<int> numbers = extract_numbers(str);
-            if (!numbers.empty()) {
-                numbered_strings.emplace_back(numbers.front(), str);
-            }
+        if (get_user_type(db, stat.second) != UserType::Administrator) {
+            response.http_status = 400;
+            nlohmann::json json;
+            json["error"] = "WEBBER_NOT_ADMIN";
+            json["error_str"] = "Not an administrator.";
+            response.body = json.dump();
+            return response;
         }
+    }
 
-        std::sort(numbered_strings.begin(), numbered_strings.end(), [](const auto& a, const auto& b) {
-            return a.first < b.first;
-        });
+    response.http_status = 200;
+    response.content_type = "text/plain; version=0.0.4";
+    response.body = metrics::scrape();
 
-        std::vector<std::string> sorted_strings;
-        for (const auto& pair : numbered_strings) {
-            sorted_strings.push_back(pair.second);
+    return response;
+}
+
+limhamn::http::server::response webber::get_api_get_trace(const limhamn::http::server::request& request, database& db) {
+    limhamn::http::server::response response{};
+
+    const auto stat = is_logged_in(request, db);
+    if (!stat.first || stat.second.empty()) {
+        response.http_status = 400;
+        nlohmann::json json;
+        json["error"] = "WEBBER_INVALID_CREDS";
+        json["error_str"] = "Invalid credentials.";
+        response.body = json.dump();
+        return response;
+    }
+
+    if (get_user_type(db, stat.second) != UserType::Administrator) {
+        response.http_status = 400;
+        nlohmann::json json;
+        json["error"] = "WEBBER_NOT_ADMIN";
+        json["error_str"] = "Not an administrator.";
+        response.body = json.dump();
+        return response;
+    }
+
+    int64_t seconds{10};
+    try {
+        const auto json = nlohmann::json::parse(request.body.empty() ? "{}" : request.body);
+        if (json.contains("seconds") && json.at("seconds").is_number_integer()) {
+            seconds = std::clamp<int64_t>(json.at("seconds").get<int64_t>(), 1, 3600);
         }
+    } catch (const std::exception&) {
+        response.http_status = 400;
+        nlohmann::json json;
+        json["error"] = "WEBBER_INVALID_JSON";
+        json["error_str"] = "Invalid JSON.";
+        response.body = json.dump();
+        return response;
+    }
+
+    response.http_status = 200;
+    response.content_type = "application/json";
+    response.headers.push_back({"Content-Disposition", "attachment; filename=\"trace.json\""});
+    response.body = trace::dump(std::chrono::seconds(seconds));
+
+    return response;
+}
 
-        std::string result;
-        for (const auto& str : sorted_strings) {
-            result += str + "\n";
+limhamn::http::server::response webber::get_api_stream_logs(const limhamn::http::server::request& request, database& db) {
+    limhamn::http::server::response response{};
+
+    const auto stat = is_logged_in(request, db);
+    if (!stat.first || stat.second.empty()) {
+        response.http_status = 400;
+        nlohmann::json json;
+        json["error"] = "WEBBER_INVALID_CREDS";
+        json["error_str"] = "Invalid credentials.";
+        response.body = json.dump();
+        return response;
+    }
+
+    if (get_user_type(db, stat.second) != UserType::Administrator) {
+        response.http_status = 400;
+        nlohmann::json json;
+        json["error"] = "WEBBER_NOT_ADMIN";
+        json["error_str"] = "Not an administrator.";
+        response.body = json.dump();
+        return response;
+    }
+
+    // EventSource can't send a body, so the logs to follow are part of the path: /api/stream_logs/access,error
+    static constexpr std::array<std::string_view, 4> types{"access", "warning", "error", "notice"};
+    unsigned mask{0};
+    const std::size_t filter = request.endpoint.find("/api/stream_logs/");
+    for (std::size_t i{0}; i < types.size(); ++i) {
+        if (filter == std::string::npos || request.endpoint.find(types[i], filter) != std::string::npos) {
+            mask |= 1u << i;
+        }
+    }
+
+    // EventSource sends the id of the last event it got when it reconnects; without one, start at the current line
+    uint64_t cursor{live_logs.get_last_id()};
+    for (const auto& it : request.headers) {
+        if (it.name.size() == 13 && std::ranges::equal(it.name, std::string_view{"last-event-id"}, [](const char a, const char b) { return std::tolower(a) == b; })) {
+            std::from_chars(it.data.data(), it.data.data() + it.data.size(), cursor);
         }
+    }
+
+    const auto snapshot = current_settings();
 
-        return result;
+    const Settings& settings = *snapshot;
+    const auto subscription = live_logs.subscribe(settings.log_stream_max_subscribers);
+    if (!subscription) {
+        response.http_status = 503;
+        nlohmann::json json;
+        json["error"] = "WEBBER_TOO_MANY_SUBSCRIBERS";
+        json["error_str"] = "Too many clients are following the logs already.";
+        response.body = json.dump();
+        return response;
+    }
+
+    // the server can't hold a response open, so every request is one long poll: it waits for lines,
+    // returns them as events, and EventSource reconnects to wait for the next ones
+    bool missed{false};
+    const auto lines = live_logs.wait(cursor, mask, 1000, std::chrono::milliseconds(settings.log_stream_timeout), missed);
+
+    response.http_status = 200;
+    response.content_type = "text/event-stream";
+    response.headers.push_back({"Cache-Control", "no-cache"});
+    response.body = "retry: 500\n\n";
+    if (missed) {
+        response.body += "event: missed\ndata: Some lines were logged faster than they could be sent.\n\n";
+    }
+    for (const auto& it : lines) {
+        response.body += "id: " + std::to_string(it.id) + "\nevent: " + std::string{types[it.file]} + "\ndata: " + it.text + "\n\n";
+    }
+    // also moves the client past lines it filtered out
+    response.body += "id: " + std::to_string(cursor) + "\n\n";
+
+    return response;
+}
+
+limhamn::http::server::response webber::get_api_search_logs(const limhamn::http::server::request& request, database& db) {
+    limhamn::http::server::response response{};
+
+    const auto stat = is_logged_in(request, db);
+    if (!stat.first || stat.second.empty()) {
+        response.http_status = 400;
+        nlohmann::json json;
+        json["error"] = "WEBBER_INVALID_CREDS";
+        json["error_str"] = "Invalid credentials.";
+        response.body = json.dump();
+        return response;
+    }
+
+    if (get_user_type(db, stat.second) != UserType::Administrator) {
+        response.http_status = 400;
+        nlohmann::json json;
+        json["error"] = "WEBBER_NOT_ADMIN";
+        json["error_str"] = "Not an administrator.";
+        response.body = json.dump();
+        return response;
+    }
+
+    const auto snapshot = current_settings();
+
+    const Settings& config = *snapshot;
+    std::vector<std::pair<std::string, const std::string*>> types{
+        {"access", &config.access_file},
+        {"warning", &config.warning_file},
+        {"error", &config.error_file},
+        {"notice", &config.notice_file},
     };
 
-    response.body = sort_string_numerically(response.body);
+    logs::search_query query{};
+    try {
+        const auto json = nlohmann::json::parse(request.body.empty() ? "{}" : request.body);
+
+        // times are in (fractional) seconds since the epoch, like the timestamps in the log files;
+        // clamped well inside int64_t, out of range doubles can't be converted
+        const auto get_milliseconds = [&](const char* key) {
+            return static_cast<int64_t>(std::clamp(json.at(key).get<double>() * 1000.0, -9.0e18, 9.0e18));
+        };
+        if (json.contains("from") && json.at("from").is_number()) {
+            query.from = get_milliseconds("from");
+        }
+        if (json.contains("to") && json.at("to").is_number()) {
+            query.to = get_milliseconds("to");
+        }
+        if (json.contains("contains") && json.at("contains").is_string()) {
+            query.contains = json.at("contains").get<std::string>();
+        }
+        if (json.contains("ip_address") && json.at("ip_address").is_string()) {
+            query.ip_address = json.at("ip_address").get<std::string>();
+        }
+        if (json.contains("limit") && json.at("limit").is_number_integer()) {
+            query.limit = static_cast<std::size_t>(std::clamp<int64_t>(json.at("limit").get<int64_t>(), 1, 100000));
+        }
+        if (json.contains("types") && json.at("types").is_array()) {
+            const auto& selected = json.at("types");
+            std::erase_if(types, [&](const auto& it) {
+                return std::find(selected.begin(), selected.end(), it.first) == selected.end();
+            });
+        }
+    } catch (const std::exception&) {
+        response.http_status = 400;
+        nlohmann::json json;
+        json["error"] = "WEBBER_INVALID_JSON";
+        json["error_str"] = "Invalid JSON.";
+        response.body = json.dump();
+        return response;
+    }
+
+    std::vector<std::vector<std::string>> files{};
+    for (const auto& [type, path] : types) {
+        files.push_back(logs::search(*path, query));
+    }
+
+    // each file is limited on its own, the merged result is cut to the limit again
+    std::string body = logs::merge(files);
+    std::size_t end{0};
+    for (std::size_t i{0}; i < query.limit && end < body.size(); ++i) {
+        end = body.find('\n', end);
+        end = end == std::string::npos ? body.size() : end + 1;
+    }
+    body.resize(end);
+
+    response.http_status = 200;
+    response.content_type = "text/plain";
+    response.body = std::move(body);
 
     return response;
-}
\ No newline at end of file
+}
@@ -0,0 +1,344 @@
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <deque>
+#include <unordered_set>
+#include <nlohmann/json.hpp>
+#include <webber.hpp>
+#include <markdown.hpp>
+#include <preprocessor.hpp>
+#include <trace.hpp>
+
+namespace {
+    // surrounds the index of a directive in the expanded markdown; stripped from anything the user wrote
+    constexpr char marker{'\x1a'};
+    constexpr std::size_t max_depth{16};
+    constexpr std::string_view name_characters{"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_."};
+
+    void append_text(std::string& out, const std::string_view text) {
+        for (std::size_t i{0}; i < text.size();) {
+            const std::size_t next = std::min(text.find(marker, i), text.size());
+            out.append(text.substr(i, next - i));
+            i = next + 1;
+        }
+    }
+
+    void append_directive(webber::preprocessor::expanded& out, std::string html) {
+        out.markdown += marker;
+        out.markdown += std::to_string(out.directives.size());
+        out.markdown += marker;
+        out.directives.push_back(std::move(html));
+    }
+
+    // the position after the bracket closing the one at open, or npos if they aren't balanced
+    std::size_t find_close(const std::string_view str, const std::size_t open, const char opening, const char closing) {
+        std::size_t depth{0};
+        for (std::size_t i{open}; i < str.size(); ++i) {
+            if (str[i] == opening) {
+                ++depth;
+            } else if (str[i] == closing && --depth == 0) {
+                return i + 1;
+            }
+        }
+
+        return std::string_view::npos;
+    }
+
+    std::string_view trim(std::string_view str) {
+        while (!str.empty() && std::isspace(static_cast<unsigned char>(str.front()))) str.remove_prefix(1);
+        while (!str.empty() && std::isspace(static_cast<unsigned char>(str.back()))) str.remove_suffix(1);
+        return str;
+    }
+
+    std::string get_comment(const std::string& message) {
+        return "<!-- " + webber::escape_html(message) + " -->";
+    }
+
+    bool is_more_restricted(const webber::PageAccess& page, const webber::PageAccess& than) {
+        if (page.require_admin) {
+            return !than.require_admin;
+        }
+
+        return page.require_login && !than.require_login && !than.require_admin;
+    }
+
+    void replace_all(std::string& str, const std::string_view from, const std::string_view to) {
+        for (std::size_t pos = str.find(from); pos != std::string::npos; pos = str.find(from, pos + to.size())) {
+            str.replace(pos, from.size(), to);
+        }
+    }
+}
+
+std::string webber::escape_html(const std::string_view str) {
+    std::string ret{};
+    ret.reserve(str.size());
+    for (const char c : str) {
+        switch (c) {
+            case '<': ret += "&lt;"; break;
+            case '>': ret += "&gt;"; break;
+            case '&': ret += "&amp;"; break;
+            case '"': ret += "&quot;"; break;
+            case '\'': ret += "&#39;"; break;
+            default: ret += c;
+        }
+    }
+
+    return ret;
+}
+
+std::string webber::preprocessor::expanded::render() const {
+    std::string html = markdown_renderer::get_local().render(this->markdown);
+    if (this->directives.empty()) {
+        return html;
+    }
+
+    const trace::span span{"preprocessor::substitute"};
+
+    std::string ret{};
+    ret.reserve(html.size());
+    for (std::size_t i{0}; i < html.size();) {
+        const std::size_t start = html.find(marker, i);
+        const std::size_t end = start == std::string::npos ? start : html.find(marker, start + 1);
+        if (end == std::string::npos) {
+            ret.append(html, i);
+            break;
+        }
+
+        ret.append(html, i, start - i);
+        i = end + 1;
+
+        std::size_t index{};
+        if (const auto [ptr, ec] = std::from_chars(html.data() + start + 1, html.data() + end, index); ec != std::errc{} || ptr != html.data() + end || index >= this->directives.size()) {
+            continue;
+        }
+
+        // a directive on a line of its own is wrapped in a paragraph, which can't hold most of them
+        if (ret.ends_with("<p>") && html.compare(i, 4, "</p>") == 0) {
+            ret.resize(ret.size() - 3);
+            i += 4;
+        }
+
+        ret += this->directives.at(index);
+    }
+
+    return ret;
+}
+
+webber::preprocessor::expanded webber::preprocessor::expand(const std::string& location, const std::string_view markdown, const PageAccess& access) {
+    const trace::span span{"preprocessor::expand"};
+
+    expanded ret{};
+    this->stack.push_back(location);
+    try {
+        this->expand_into(ret, markdown, access);
+    } catch (...) {
+        this->stack.pop_back();
+        throw;
+    }
+    this->stack.pop_back();
+
+    std::sort(ret.dependencies.begin(), ret.dependencies.end());
+    ret.dependencies.erase(std::unique(ret.dependencies.begin(), ret.dependencies.end()), ret.dependencies.end());
+
+    return ret;
+}
+
+void webber::preprocessor::expand_into(expanded& out, const std::string_view markdown, const PageAccess& access) {
+    out.markdown.reserve(out.markdown.size() + markdown.size());
+
+    for (std::size_t i{0}; i < markdown.size();) {
+        const std::size_t start = markdown.find("{{", i);
+        if (start == std::string_view::npos) {
+            append_text(out.markdown, markdown.substr(i));
+            break;
+        }
+
+        append_text(out.markdown, markdown.substr(i, start - i));
+        if (const std::size_t end = this->expand_directive(out, markdown, start, access); end != std::string_view::npos) {
+            i = end;
+        } else {
+            out.markdown += "{{";
+            i = start + 2;
+        }
+    }
+}
+
+std::size_t webber::preprocessor::expand_directive(expanded& out, const std::string_view markdown, const std::size_t start, const PageAccess& access) {
+    std::size_t pos = markdown.find_first_not_of(name_characters, start + 2);
+    if (pos == std::string_view::npos || pos == start + 2) {
+        return std::string_view::npos;
+    }
+
+    const std::string_view name = markdown.substr(start + 2, pos - start - 2);
+
+    if (markdown[pos] == '=') {
+        const std::size_t close = markdown.find("}}", pos + 1);
+        if (close == std::string_view::npos) {
+            return std::string_view::npos;
+        }
+
+        const std::string_view value = trim(markdown.substr(pos + 1, close - pos - 1));
+        if (name == "meta.title") {
+            append_directive(out, "<title>" + escape_html(value) + "</title>");
+        } else if (name.starts_with("meta.") && name.size() > 5) {
+            append_directive(out, "<meta name=\"" + escape_html(name.substr(5)) + "\" content=\"" + escape_html(value) + "\">");
+        } else if (name == "window.redirect") {
+            append_directive(out, "<script>window.location.href = " + nlohmann::json(std::string{value}).dump() + ";</script>");
+        } else {
+            return std::string_view::npos;
+        }
+
+        return close + 2;
+    }
+
+    std::string_view condition{};
+    const bool conditional = name == "if" || name == "else_if";
+    if (conditional) {
+        if (markdown[pos] != '(') {
+            return std::string_view::npos;
+        }
+
+        const std::size_t close = find_close(markdown, pos, '(', ')');
+        if (close == std::string_view::npos) {
+            return std::string_view::npos;
+        }
+
+        condition = trim(markdown.substr(pos + 1, close - pos - 2));
+        pos = close;
+    }
+
+    if (pos >= markdown.size() || markdown[pos] != '[') {
+        return std::string_view::npos;
+    }
+
+    const std::size_t close = find_close(markdown, pos, '[', ']');
+    if (close == std::string_view::npos || markdown.substr(close, 2) != "}}") {
+        return std::string_view::npos;
+    }
+
+    const std::string_view content = markdown.substr(pos + 1, close - pos - 2);
+
+    if (name == "include") {
+        append_directive(out, this->include(out, std::string{trim(content)}, access));
+    } else if (name == "script") {
+        append_directive(out, "<script>" + std::string{content} + "</script>");
+    } else if (name == "style") {
+        append_directive(out, "<style>" + std::string{content} + "</style>");
+    } else if (conditional || name == "else") {
+        std::string html = "<div class=\"webber-if\" data-branch=\"" + std::string{name} + "\"";
+        if (conditional) {
+            html += " data-condition=\"" + escape_html(condition) + "\"";
+        }
+        html += " hidden>" + this->render_block(out, content, access) + "</div>";
+
+        append_directive(out, std::move(html));
+    } else if (name == "template.spoiler") {
+        append_directive(out, "<details class=\"webber-spoiler\"><summary>Spoiler</summary>" + this->render_block(out, content, access) + "</details>");
+    } else if (name.starts_with("template.") && name.size() > 9) {
+        std::string html = this->include(out, "/template/" + std::string{name.substr(9)}, access);
+        const std::string inner = this->render_block(out, content, access);
+        replace_all(html, "<p>{{content}}</p>", inner);
+        replace_all(html, "{{content}}", inner);
+
+        append_directive(out, std::move(html));
+    } else {
+        return std::string_view::npos;
+    }
+
+    return close + 2;
+}
+
+std::string webber::preprocessor::render_block(expanded& out, const std::string_view markdown, const PageAccess& access) {
+    expanded block{};
+    this->expand_into(block, markdown, access);
+    out.dependencies.insert(out.dependencies.end(), block.dependencies.begin(), block.dependencies.end());
+
+    return block.render();
+}
+
+std::string webber::preprocessor::include(expanded& out, const std::string& location, const PageAccess& access) {
+    out.dependencies.push_back(location);
+
+    if (std::find(this->stack.begin(), this->stack.end(), location) != this->stack.end()) {
+        ++this->cycles;
+        return get_comment(location + " includes itself");
+    }
+    if (this->stack.size() >= max_depth) {
+        ++this->cycles;
+        return get_comment(location + " is nested too deeply");
+    }
+
+    const fragment* f = this->get_fragment(location);
+    if (f == nullptr || !f->found) {
+        return get_comment(location + " does not exist");
+    }
+    if (is_more_restricted(f->access, access)) {
+        return get_comment(location + " is more restricted than this page");
+    }
+
+    return f->html;
+}
+
+const webber::preprocessor::fragment* webber::preprocessor::get_fragment(const std::string& location) {
+    if (const auto it = this->fragments.find(location); it != this->fragments.end()) {
+        return &it->second;
+    }
+
+    fragment f{};
+    const std::size_t cycles_before = this->cycles;
+
+    const auto query = this->db.query("SELECT json FROM pages WHERE location = ?;", location);
+    if (!query.empty() && query.at(0).contains("json")) {
+        const auto json = nlohmann::json::parse(query.at(0).at("json"));
+
+        f.found = true;
+        f.access.require_login = json.value("require_login", false);
+        f.access.require_admin = json.value("require_admin", false);
+
+        const std::string input = json.value("input_content", "");
+        if (json.value("input_content_type", "") == "markdown") {
+            f.html = this->expand(location, input, f.access).render();
+        } else {
+            f.html = input;
+        }
+    }
+
+    // what a page renders to inside a cycle depends on where the cycle was entered
+    if (this->cycles != cycles_before) {
+        this->uncached = std::move(f);
+        return &this->uncached;
+    }
+
+    return &this->fragments.emplace(location, std::move(f)).first->second;
+}
+
+void webber::set_page_dependencies(database& db, const std::string& location, const std::vector<std::string>& dependencies) {
+    if (!db.exec("DELETE FROM page_dependencies WHERE location = ?;", location)) {
+        throw std::runtime_error{"Error deleting from the page_dependencies table."};
+    }
+
+    for (const auto& it : dependencies) {
+        if (!db.exec("INSERT INTO page_dependencies (location, dependency) VALUES (?, ?);", location, it)) {
+            throw std::runtime_error{"Error inserting into the page_dependencies table."};
+        }
+    }
+}
+
+std::vector<std::string> webber::get_page_dependents(database& db, const std::string& location) {
+    std::vector<std::string> ret{};
+    std::unordered_set<std::string> seen{location};
+    std::deque<std::string> queue{location};
+
+    while (!queue.empty()) {
+        for (const auto& it : db.query("SELECT location FROM page_dependencies WHERE dependency = ?;", queue.front())) {
+            if (const auto dependent = it.find("location"); dependent != it.end() && seen.insert(dependent->second).second) {
+                ret.push_back(dependent->second);
+                queue.push_back(dependent->second);
+            }
+        }
+
+        queue.pop_front();
+    }
+
+    return ret;
+}
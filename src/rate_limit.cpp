@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <functional>
+#include <webber.hpp>
+#include <rate_limit.hpp>
+
+webber::rate_limiter::shard& webber::rate_limiter::get_shard(const std::string& key) {
+    return this->shards[std::hash<std::string>{}(key) % shard_count];
+}
+
+void webber::rate_limiter::make_room(shard& s, const std::chrono::steady_clock::time_point now) {
+    // a bucket that is full again can be forgotten without changing anything; one still in debt can't. the oldest
+    // are first in line, so the sweep stops at the first one updated within the last minute, and it runs at most
+    // once a second so that a flood of new keys doesn't walk the same buckets over and over
+    if (now - s.swept >= std::chrono::seconds(1)) {
+        s.swept = now;
+        for (auto it = s.order.begin(); it != s.order.end();) {
+            const auto b = s.buckets.find(*it);
+            const double elapsed = std::chrono::duration<double>(now - b->second.updated).count();
+            if (elapsed < 60.0) {
+                break;
+            }
+
+            if (b->second.tokens + elapsed * b->second.tokens_per_minute / 60.0 < b->second.tokens_per_minute) {
+                ++it;
+                continue;
+            }
+
+            s.buckets.erase(b);
+            it = s.order.erase(it);
+        }
+    }
+
+    while (s.buckets.size() >= max_buckets_per_shard && !s.order.empty()) {
+        s.buckets.erase(s.order.front());
+        s.order.pop_front();
+    }
+}
+
+webber::rate_limiter::bucket& webber::rate_limiter::get_bucket(shard& s, const std::string& key, const double tokens_per_minute, const std::chrono::steady_clock::time_point now) {
+    if (const auto it = s.buckets.find(key); it != s.buckets.end()) {
+        bucket& b = it->second;
+        const double elapsed = std::chrono::duration<double>(now - b.updated).count();
+        b.tokens = std::min(tokens_per_minute, b.tokens + elapsed * tokens_per_minute / 60.0);
+        b.tokens_per_minute = tokens_per_minute;
+        b.updated = now;
+        s.order.splice(s.order.end(), s.order, b.order);
+
+        return b;
+    }
+
+    if (s.buckets.size() >= max_buckets_per_shard) {
+        make_room(s, now);
+    }
+
+    s.order.push_back(key);
+    bucket& b = s.buckets.try_emplace(key, bucket{tokens_per_minute, tokens_per_minute, now, std::prev(s.order.end())}).first->second;
+    return b;
+}
+
+double webber::rate_limiter::acquire(const std::string& key, const double tokens_per_minute, const double cost) {
+    if (tokens_per_minute <= 0.0) {
+        return 0.0;
+    }
+
+    shard& s = this->get_shard(key);
+    std::lock_guard lock{s.mutex};
+    bucket& b = get_bucket(s, key, tokens_per_minute, std::chrono::steady_clock::now());
+
+    // a request costing more than the bucket holds is let through when the bucket is full and paid off afterwards
+    const double required = std::min(cost, tokens_per_minute);
+    if (b.tokens < required) {
+        return (required - b.tokens) * 60.0 / tokens_per_minute;
+    }
+
+    b.tokens -= cost;
+    return 0.0;
+}
+
+void webber::rate_limiter::charge(const std::string& key, const double tokens_per_minute, const double cost) {
+    if (tokens_per_minute <= 0.0 || cost <= 0.0) {
+        return;
+    }
+
+    shard& s = this->get_shard(key);
+    std::lock_guard lock{s.mutex};
+    get_bucket(s, key, tokens_per_minute, std::chrono::steady_clock::now()).tokens -= cost;
+}
+
+void webber::rate_limiter::refund(const std::string& key, const double tokens_per_minute, const double cost) {
+    if (tokens_per_minute <= 0.0 || cost <= 0.0) {
+        return;
+    }
+
+    shard& s = this->get_shard(key);
+    std::lock_guard lock{s.mutex};
+    bucket& b = get_bucket(s, key, tokens_per_minute, std::chrono::steady_clock::now());
+    b.tokens = std::min(tokens_per_minute, b.tokens + cost);
+}
+
+double webber::get_request_cost(const limhamn::http::server::request& request) {
+    const auto settings = current_settings();
+    for (const auto& it : settings->route_costs) {
+        if (!match_path(request.endpoint, it.path, true)) {
+            continue;
+        }
+
+        double cost = it.cost;
+        if (it.bytes_per_token > 0) {
+            // uploads arrive as multipart in raw_body, with nothing in body
+            cost += static_cast<double>(std::max(request.raw_body.size(), request.body.size())) / static_cast<double>(it.bytes_per_token);
+        }
+
+        return cost;
+    }
+
+    return 1.0;
+}
@@ -0,0 +1,257 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include <webber.hpp>
+#include <db_abstract.hpp>
+#include <preprocessor.hpp>
+#include <export.hpp>
+
+namespace {
+    constexpr std::size_t batch_size{256}; // pages per select and per transaction
+    constexpr std::size_t queue_size{4 * batch_size};
+
+    // a bounded queue between the reader, the renderers and the writer; pop() returns nothing once it is closed and empty
+    template <typename T>
+    class channel {
+    public:
+        void push(T value) {
+            std::unique_lock lock{this->mutex};
+            this->not_full.wait(lock, [this]() { return this->queue.size() < queue_size; });
+            this->queue.push_back(std::move(value));
+            lock.unlock();
+            this->not_empty.notify_one();
+        }
+
+        std::optional<T> pop() {
+            std::unique_lock lock{this->mutex};
+            this->not_empty.wait(lock, [this]() { return this->closed || !this->queue.empty(); });
+            if (this->queue.empty()) {
+                return std::nullopt;
+            }
+
+            T value = std::move(this->queue.front());
+            this->queue.pop_front();
+            lock.unlock();
+            this->not_full.notify_one();
+            return value;
+        }
+
+        void close() {
+            {
+                std::lock_guard lock{this->mutex};
+                this->closed = true;
+            }
+            this->not_empty.notify_all();
+        }
+    private:
+        std::mutex mutex{};
+        std::condition_variable not_empty{};
+        std::condition_variable not_full{};
+        std::deque<T> queue{};
+        bool closed{false};
+    };
+
+    struct page {
+        std::string location{};
+        std::string json{};
+    };
+
+    struct rendered {
+        std::string location{};
+        std::size_t input_hash{0}; // of the markdown it was rendered from
+        webber::PageAccess access{}; // it was rendered with
+        std::string html{};
+        std::vector<std::string> dependencies{};
+    };
+
+    // stores the html without touching anything else in the page; skips pages saved again since they were read
+    void write_batch(webber::database& db, const std::vector<rendered>& batch) {
+        // so that a running server can't write a page between it being read here and written
+        webber::transaction t{db};
+
+        std::vector<std::pair<std::string, nlohmann::json>> written{};
+        for (const auto& it : batch) {
+            const auto query = db.query("SELECT json FROM pages WHERE location = ?" + std::string{t.get_lock_clause()} + ";", it.location);
+            if (query.empty() || !query.at(0).contains("json")) {
+                continue;
+            }
+
+            auto json = nlohmann::json::parse(query.at(0).at("json"));
+            if (json.value("input_content_type", "") != "markdown" ||
+                std::hash<std::string>{}(json.value("input_content", "")) != it.input_hash ||
+                json.value("require_login", false) != it.access.require_login ||
+                json.value("require_admin", false) != it.access.require_admin) {
+                continue;
+            }
+
+            json["output_content"] = it.html;
+            if (!db.exec("UPDATE pages SET json = ? WHERE location = ?;", json.dump(), it.location)) {
+                throw std::runtime_error{"Error updating the pages table."};
+            }
+
+            webber::set_page_dependencies(db, it.location, it.dependencies);
+            written.emplace_back(it.location, std::move(json));
+        }
+
+        t.commit();
+
+        // only what was committed is exported
+        for (const auto& [location, json] : written) {
+            webber::update_export(location, json);
+        }
+    }
+}
+
+bool webber::rerender_pages() {
+    publish_settings(settings);
+
+    const auto db = open_database();
+    setup_database(*db);
+
+    std::size_t total{0};
+    if (const auto query = db->query("SELECT COUNT(*) AS count FROM pages;"); !query.empty() && query.at(0).contains("count")) {
+        total = std::stoull(query.at(0).at("count"));
+    }
+
+    const std::size_t thread_count = settings.workers > 0 ? static_cast<std::size_t>(settings.workers) : std::max(1U, std::thread::hardware_concurrency());
+    std::cerr << "Re-rendering " << total << " pages with " << thread_count << " threads.\n";
+
+    channel<page> pages{};
+    channel<rendered> results{};
+    std::atomic<std::size_t> failed{0};
+    std::atomic<std::size_t> skipped{0}; // html pages, which aren't rendered
+    std::atomic<std::size_t> running{thread_count};
+
+    std::vector<std::thread> renderers{};
+    for (std::size_t i{0}; i < thread_count; ++i) {
+        renderers.emplace_back([&]() {
+            try {
+                const auto connection = open_database();
+                // kept for the whole run, so a page many others include is only rendered once per thread
+                preprocessor preprocessor{*connection};
+
+                while (auto it = pages.pop()) {
+                    try {
+                        const auto json = nlohmann::json::parse(it->json);
+                        if (json.value("input_content_type", "") != "markdown") {
+                            skipped.fetch_add(1, std::memory_order_relaxed);
+                            continue;
+                        }
+
+                        const std::string markdown = json.value("input_content", "");
+                        const PageAccess access{
+                            .require_login = json.value("require_login", false),
+                            .require_admin = json.value("require_admin", false),
+                        };
+
+                        auto expanded = preprocessor.expand(it->location, markdown, access);
+                        results.push({
+                            .location = std::move(it->location),
+                            .input_hash = std::hash<std::string>{}(markdown),
+                            .access = access,
+                            .html = expanded.render(),
+                            .dependencies = std::move(expanded.dependencies),
+                        });
+                    } catch (const std::exception& e) {
+                        failed.fetch_add(1, std::memory_order_relaxed);
+                        logger.write_to_log(limhamn::logger::type::error, "Failed to re-render ", it->location, ": ", e.what(), "\n");
+                    }
+                }
+            } catch (const std::exception& e) {
+                logger.write_to_log(limhamn::logger::type::error, "A re-render thread failed: ", e.what(), "\n");
+                // nobody else may be left to take the pages off the queue
+                while (pages.pop()) {
+                    failed.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+
+            if (running.fetch_sub(1) == 1) {
+                results.close();
+            }
+        });
+    }
+
+    std::size_t written{0};
+    std::thread writer{[&]() {
+        std::shared_ptr<database> connection{};
+        try {
+            connection = open_database();
+        } catch (const std::exception& e) {
+            logger.write_to_log(limhamn::logger::type::error, "Failed to open the database for writing: ", e.what(), "\n");
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<rendered> batch{};
+        const auto flush = [&]() {
+            if (batch.empty()) {
+                return;
+            }
+
+            try {
+                if (!connection) {
+                    throw std::runtime_error{"The database is not open."};
+                }
+
+                write_batch(*connection, batch);
+                written += batch.size();
+            } catch (const std::exception& e) {
+                failed.fetch_add(batch.size(), std::memory_order_relaxed);
+                logger.write_to_log(limhamn::logger::type::error, "Failed to write ", std::to_string(batch.size()), " re-rendered pages: ", e.what(), "\n");
+            }
+            batch.clear();
+
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            const std::size_t done = written + skipped.load() + failed.load();
+            std::cerr << "\r" << done << "/" << total << " pages, " << static_cast<std::size_t>(static_cast<double>(written) / std::max(seconds, 0.001)) << " pages/s" << std::flush;
+        };
+
+        while (auto it = results.pop()) {
+            batch.push_back(std::move(*it));
+            if (batch.size() >= batch_size) {
+                flush();
+            }
+        }
+        flush();
+    }};
+
+    // pages are read in id order, a batch at a time, so that the whole table is never in memory at once
+    std::string last_id{"0"};
+    try {
+        while (true) {
+            const auto query = db->query("SELECT id, location, json FROM pages WHERE id > ? ORDER BY id LIMIT " + std::to_string(batch_size) + ";", last_id);
+            for (const auto& it : query) {
+                if (!it.contains("id") || !it.contains("location") || !it.contains("json")) {
+                    continue;
+                }
+
+                last_id = it.at("id");
+                pages.push({it.at("location"), it.at("json")});
+            }
+
+            if (query.size() < batch_size) {
+                break;
+            }
+        }
+    } catch (const std::exception& e) {
+        logger.write_to_log(limhamn::logger::type::error, "Failed to read the pages: ", e.what(), "\n");
+        failed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    pages.close();
+    for (auto& it : renderers) {
+        it.join();
+    }
+    writer.join();
+
+    std::cerr << "\nRe-rendered " << written << " pages, skipped " << skipped.load() << " html pages, " << failed.load() << " failed.\n";
+    logger.write_to_log(limhamn::logger::type::notice, "Re-rendered ", std::to_string(written), " pages, ", std::to_string(failed.load()), " failed.\n");
+
+    return failed.load() == 0;
+}
@@ -0,0 +1,229 @@
+#include <charconv>
+#include <stdexcept>
+#include <zlib.h>
+#include <openssl/evp.h>
+#include <scrypto.hpp>
+#include <revisions.hpp>
+
+namespace {
+    constexpr int64_t snapshot_interval{32};
+
+    struct content {
+        std::string input{};
+        std::string output{};
+    };
+
+    // an edit is "<prefix> <suffix> <size>\n<size bytes>": keep prefix bytes from the start of the previous
+    // text and suffix bytes from its end, with the bytes in between. a snapshot is an edit of the empty string
+    void append_edit(std::string& out, const std::string& from, const std::string& to) {
+        std::size_t prefix{0};
+        while (prefix < from.size() && prefix < to.size() && from[prefix] == to[prefix]) {
+            ++prefix;
+        }
+
+        std::size_t suffix{0};
+        while (suffix < from.size() - prefix && suffix < to.size() - prefix && from[from.size() - suffix - 1] == to[to.size() - suffix - 1]) {
+            ++suffix;
+        }
+
+        const std::size_t size = to.size() - prefix - suffix;
+        out += std::to_string(prefix) + " " + std::to_string(suffix) + " " + std::to_string(size) + "\n";
+        out.append(to, prefix, size);
+    }
+
+    std::size_t read_number(const std::string& in, std::size_t& pos, const char end) {
+        std::size_t ret{};
+        const auto [ptr, ec] = std::from_chars(in.data() + pos, in.data() + in.size(), ret);
+        if (ec != std::errc{} || ptr == in.data() + in.size() || *ptr != end) {
+            throw std::runtime_error{"Invalid page revision."};
+        }
+
+        pos = ptr - in.data() + 1;
+        return ret;
+    }
+
+    std::string apply_edit(const std::string& from, const std::string& in, std::size_t& pos) {
+        const std::size_t prefix = read_number(in, pos, ' ');
+        const std::size_t suffix = read_number(in, pos, ' ');
+        const std::size_t size = read_number(in, pos, '\n');
+        if (prefix + suffix > from.size() || size > in.size() - pos) {
+            throw std::runtime_error{"Invalid page revision."};
+        }
+
+        std::string ret{};
+        ret.reserve(prefix + size + suffix);
+        ret.append(from, 0, prefix);
+        ret.append(in, pos, size);
+        ret.append(from, from.size() - suffix, suffix);
+
+        pos += size;
+        return ret;
+    }
+
+    // zlib, then base64 so that it fits in a text column in both databases
+    std::string compress(const std::string& in) {
+        uLongf size = compressBound(in.size());
+        std::string compressed(size, '\0');
+        if (compress2(reinterpret_cast<Bytef*>(compressed.data()), &size, reinterpret_cast<const Bytef*>(in.data()), in.size(), Z_BEST_COMPRESSION) != Z_OK) {
+            throw std::runtime_error{"Error compressing a page revision."};
+        }
+
+        std::string ret(4 * ((size + 2) / 3), '\0');
+        ret.resize(EVP_EncodeBlock(reinterpret_cast<unsigned char*>(ret.data()), reinterpret_cast<const unsigned char*>(compressed.data()), static_cast<int>(size)));
+        return ret;
+    }
+
+    std::string decompress(const std::string& in, const std::size_t size) {
+        std::string compressed(3 * (in.size() / 4), '\0');
+        const int decoded = EVP_DecodeBlock(reinterpret_cast<unsigned char*>(compressed.data()), reinterpret_cast<const unsigned char*>(in.data()), static_cast<int>(in.size()));
+        if (decoded < 0) {
+            throw std::runtime_error{"Invalid page revision."};
+        }
+        // EVP_DecodeBlock counts the padding as zero bytes
+        compressed.resize(decoded - (in.ends_with("==") ? 2 : in.ends_with("=") ? 1 : 0));
+
+        std::string ret(size, '\0');
+        uLongf length = size;
+        if (uncompress(reinterpret_cast<Bytef*>(ret.data()), &length, reinterpret_cast<const Bytef*>(compressed.data()), compressed.size()) != Z_OK || length != size) {
+            throw std::runtime_error{"Error decompressing a page revision."};
+        }
+
+        return ret;
+    }
+
+    // the content of the revision, from the last snapshot at or before it
+    std::optional<content> get_content(webber::database& db, const std::string& location, const int64_t revision) {
+        const auto query = db.query("SELECT revision, snapshot, size, content FROM page_revisions WHERE location = ? AND revision <= ? AND revision >= "
+            "(SELECT MAX(revision) FROM page_revisions WHERE location = ? AND revision <= ? AND snapshot = 1) ORDER BY revision;",
+            location, revision, location, revision);
+        if (query.empty() || !query.back().contains("revision") || std::stoll(query.back().at("revision")) != revision) {
+            return std::nullopt;
+        }
+
+        content ret{};
+        for (const auto& it : query) {
+            if (!it.contains("size") || !it.contains("content")) {
+                throw std::runtime_error{"Invalid page revision."};
+            }
+
+            const std::string edits = decompress(it.at("content"), std::stoull(it.at("size")));
+            std::size_t pos{0};
+            ret.input = apply_edit(ret.input, edits, pos);
+            ret.output = apply_edit(ret.output, edits, pos);
+        }
+
+        return ret;
+    }
+
+    int64_t get_last_revision(webber::database& db, const std::string& location) {
+        const auto query = db.query("SELECT COALESCE(MAX(revision), 0) AS revision FROM page_revisions WHERE location = ?;", location);
+        if (query.empty() || !query.at(0).contains("revision")) {
+            return 0;
+        }
+
+        return std::stoll(query.at(0).at("revision"));
+    }
+
+    void insert_revision(webber::database& db, const std::string& location, const content& c, const nlohmann::json& metadata) {
+        const int64_t revision = get_last_revision(db, location) + 1;
+        bool snapshot = (revision - 1) % snapshot_interval == 0;
+
+        content previous{};
+        if (!snapshot) {
+            if (auto it = get_content(db, location, revision - 1)) {
+                previous = std::move(*it);
+            } else {
+                snapshot = true;
+            }
+        }
+
+        std::string edits{};
+        append_edit(edits, previous.input, c.input);
+        append_edit(edits, previous.output, c.output);
+
+        if (!db.exec("INSERT INTO page_revisions (location, revision, snapshot, size, content, json) VALUES (?, ?, ?, ?, ?, ?);",
+                location, revision, static_cast<int64_t>(snapshot), static_cast<int64_t>(edits.size()), compress(edits), metadata.dump())) {
+            throw std::runtime_error{"Error inserting into the page_revisions table."};
+        }
+    }
+}
+
+void webber::add_page_revision(database& db, const std::string& location, const nlohmann::json& page, const std::string& username, const std::string& ip_address, const std::string& user_agent) {
+    nlohmann::json metadata{};
+    for (const auto& it : {"username", "ip_address", "user_agent", "updated_at", "input_content_type", "output_content_type", "require_admin", "require_login"}) {
+        if (page.contains(it)) {
+            metadata[it] = page.at(it);
+        }
+    }
+    if (page.contains("visits")) {
+        metadata["visits_at_the_time"] = page.at("visits");
+    }
+    metadata["replaced_at"] = scrypto::return_unix_timestamp();
+    metadata["replaced_by_username"] = username;
+    metadata["replaced_by_ip_address"] = ip_address;
+    metadata["replaced_by_user_agent"] = user_agent;
+
+    insert_revision(db, location, {page.value("input_content", ""), page.value("output_content", "")}, metadata);
+}
+
+std::vector<nlohmann::json> webber::list_page_revisions(database& db, const std::string& location) {
+    std::vector<nlohmann::json> ret{};
+    for (const auto& it : db.query("SELECT revision, json FROM page_revisions WHERE location = ? ORDER BY revision;", location)) {
+        if (!it.contains("revision") || !it.contains("json")) {
+            continue;
+        }
+
+        auto json = nlohmann::json::parse(it.at("json"));
+        json["revision"] = std::stoll(it.at("revision"));
+        ret.push_back(std::move(json));
+    }
+
+    return ret;
+}
+
+std::optional<webber::PageRevision> webber::get_page_revision(database& db, const std::string& location, const int64_t revision) {
+    const auto query = db.query("SELECT json FROM page_revisions WHERE location = ? AND revision = ?;", location, revision);
+    if (query.empty() || !query.at(0).contains("json")) {
+        return std::nullopt;
+    }
+
+    auto c = get_content(db, location, revision);
+    if (!c) {
+        return std::nullopt;
+    }
+
+    return PageRevision{
+        .revision = revision,
+        .metadata = nlohmann::json::parse(query.at(0).at("json")),
+        .input_content = std::move(c->input),
+        .output_content = std::move(c->output),
+    };
+}
+
+void webber::remove_page_revisions(database& db, const std::string& location) {
+    if (!db.exec("DELETE FROM page_revisions WHERE location = ?;", location)) {
+        throw std::runtime_error{"Error deleting from the page_revisions table."};
+    }
+}
+
+bool webber::migrate_page_history(database& db, const std::string& location, nlohmann::json& page) {
+    if (!page.contains("history")) {
+        return false;
+    }
+
+    if (page.at("history").is_array()) {
+        for (auto& it : page.at("history")) {
+            if (!it.is_object()) {
+                continue;
+            }
+
+            const content c{it.value("input_content", ""), it.value("output_content", "")};
+            it.erase("input_content");
+            it.erase("output_content");
+            insert_revision(db, location, c, it);
+        }
+    }
+
+    page.erase("history");
+    return true;
+}
@@ -0,0 +1,1358 @@
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <charconv>
+#include <webber.hpp>
+#include <db_abstract.hpp>
+// prebuilt is generated by CMake; creating the build directory should resolve any errors here
+#include <prebuilt.hpp> // NOLINT
+#include <limhamn/http/http_server.hpp>
+#include <limhamn/http/http_utils.hpp>
+#include <yaml-cpp/yaml.h>
+#include <nlohmann/json.hpp>
+#include <csignal>
+#include <thread>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <session.hpp>
+#include <worker.hpp>
+#include <metrics.hpp>
+#include <trace.hpp>
+#include <admission.hpp>
+#include <markdown.hpp>
+#include <export.hpp>
+#include <rate_limit.hpp>
+#include <single_flight.hpp>
+
+// the http server sets SO_REUSEADDR on its listening socket and has no way to set SO_REUSEPORT, which an instance
+// started with --upgrade needs to listen on the port while the one it takes over from is still accepting on it.
+// this takes the place of the C library's setsockopt for the whole process
+extern "C" int setsockopt(const int fd, const int level, const int name, const void* value, const socklen_t length) noexcept {
+    const long ret = syscall(SYS_setsockopt, fd, level, name, value, length);
+    if (ret == 0 && level == SOL_SOCKET && name == SO_REUSEADDR && webber::upgrade.load()) {
+        const int enable{1};
+        syscall(SYS_setsockopt, fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable));
+    }
+
+    return static_cast<int>(ret);
+}
+
+namespace {
+    // counts requests being handled so that drain() knows when it is safe to exit
+    struct in_flight_guard {
+        in_flight_guard() { webber::in_flight.fetch_add(1); }
+        ~in_flight_guard() { webber::in_flight.fetch_sub(1); }
+        in_flight_guard(const in_flight_guard&) = delete;
+        in_flight_guard& operator=(const in_flight_guard&) = delete;
+    };
+
+    // the http server doesn't hand out its listening socket, so it is found among the open descriptors
+    std::vector<int> find_listeners(const int port) {
+        std::vector<int> ret{};
+        std::error_code ec{};
+        for (auto it = std::filesystem::directory_iterator{"/proc/self/fd", ec}; !ec && it != std::filesystem::directory_iterator{}; it.increment(ec)) {
+            int fd{-1};
+            const std::string name = it->path().filename().string();
+            if (std::from_chars(name.data(), name.data() + name.size(), fd).ec != std::errc{}) {
+                continue;
+            }
+
+            int listening{0};
+            socklen_t length = sizeof(listening);
+            if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &length) != 0 || listening == 0) {
+                continue;
+            }
+
+            sockaddr_storage address{};
+            length = sizeof(address);
+            if (getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+                continue;
+            }
+
+            int bound{-1};
+            if (address.ss_family == AF_INET) {
+                bound = ntohs(reinterpret_cast<const sockaddr_in*>(&address)->sin_port);
+            } else if (address.ss_family == AF_INET6) {
+                bound = ntohs(reinterpret_cast<const sockaddr_in6*>(&address)->sin6_port);
+            }
+
+            if (bound == port) {
+                ret.push_back(fd);
+            }
+        }
+
+        return ret;
+    }
+
+    // lets the instance taking over bind the port while this one is still accepting on it
+    void set_reuse_port(const int port, const bool enable) {
+        const int value = enable ? 1 : 0;
+        for (const int fd : find_listeners(port)) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &value, sizeof(value));
+        }
+    }
+
+    // the connections waiting in the accept queue of a listening socket
+    uint32_t get_accept_queue(const int fd) {
+        tcp_info info{};
+        socklen_t length = sizeof(info);
+        if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &length) != 0) {
+            return 0;
+        }
+
+        return info.tcpi_unacked; // for a listening socket, the length of its accept queue
+    }
+
+    // shutting the listening socket down makes the kernel stop handing it new connections, while connections
+    // that were already accepted keep being served. the ones still in its accept queue would be reset, so the
+    // queue is given a moment to empty first; one arriving in between is still lost
+    std::size_t stop_listening(const int port) {
+        const auto fds = find_listeners(port);
+        for (const int fd : fds) {
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+            while (get_accept_queue(fd) > 0 && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+
+            shutdown(fd, SHUT_RDWR);
+        }
+
+        return fds.size();
+    }
+
+    // whether an instance taking over has written its pid to the pid file, which it does once it is listening
+    bool has_successor() {
+        pid_t pid{0};
+        std::ifstream file{webber::settings.pid_file};
+        return (file >> pid) && pid > 0 && pid != getpid() && kill(pid, 0) == 0;
+    }
+
+    // once draining, the server may return or throw because its socket was shut down; it must not be started again
+    [[noreturn]] void wait_for_drain() {
+        while (true) {
+            pause(); // drain() exits the process when the last request is done
+        }
+    }
+
+    limhamn::http::server::response get_overloaded_response() {
+        nlohmann::json json;
+        json["error"] = "WEBBER_OVERLOADED";
+        json["error_str"] = "The server is too busy to handle the request. Try again shortly.";
+
+        limhamn::http::server::response response{
+            .http_status = 503,
+            .content_type = "application/json",
+            .body = json.dump(),
+        };
+        response.headers.push_back({"Retry-After", "1"});
+
+        return response;
+    }
+
+    limhamn::http::server::response get_forbidden_response() {
+        nlohmann::json json;
+        json["error"] = "WEBBER_FORBIDDEN";
+        json["error_str"] = "Forbidden.";
+
+        return {
+            .http_status = 403,
+            .content_type = "application/json",
+            .body = json.dump(),
+        };
+    }
+
+    limhamn::http::server::response get_rate_limited_response(const double retry_after) {
+        nlohmann::json json;
+        json["error"] = "WEBBER_RATE_LIMITED";
+        json["error_str"] = "Too many requests. Try again later.";
+
+        limhamn::http::server::response response{
+            .http_status = 429,
+            .content_type = "application/json",
+            .body = json.dump(),
+        };
+        response.headers.push_back({"Retry-After", std::to_string(std::max<int64_t>(1, static_cast<int64_t>(std::ceil(retry_after))))});
+
+        return response;
+    }
+
+    // takes the cost of the request from the buckets of its ip address and its user, 0 if both had enough
+    double acquire_rate_limit(const limhamn::http::server::request& request, const std::string& username, const double cost) {
+        const auto snapshot = webber::current_settings();
+        const webber::Settings& s = *snapshot;
+        if (s.whitelist->contains(request.ip_address)) {
+            return 0.0;
+        }
+
+        const std::string ip_key = "ip:" + request.ip_address;
+        if (const double wait = webber::rate_limits.acquire(ip_key, s.rate_limit, cost); wait > 0.0) {
+            return wait;
+        }
+        if (username.empty()) {
+            return 0.0;
+        }
+
+        if (const double wait = webber::rate_limits.acquire("user:" + username, s.user_rate_limit, cost); wait > 0.0) {
+            webber::rate_limits.refund(ip_key, s.rate_limit, cost);
+            return wait;
+        }
+
+        return 0.0;
+    }
+
+    // downloads are charged by size once it is known
+    void charge_download(const limhamn::http::server::request& request, const std::string& username, const std::size_t bytes) {
+        const auto snapshot = webber::current_settings();
+        const webber::Settings& s = *snapshot;
+        if (s.download_bytes_per_token <= 0 || s.whitelist->contains(request.ip_address)) {
+            return;
+        }
+
+        const double cost = static_cast<double>(bytes) / static_cast<double>(s.download_bytes_per_token);
+        webber::rate_limits.charge("ip:" + request.ip_address, s.rate_limit, cost);
+        if (!username.empty()) {
+            webber::rate_limits.charge("user:" + username, s.user_rate_limit, cost);
+        }
+    }
+}
+
+std::string webber::open_file(const std::string& file_path) {
+    const trace::span span{"open_file"};
+    std::ifstream file{file_path};
+    std::string content{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    file.close();
+    return content;
+}
+
+void webber::write_file(const std::string& file_path, const std::string& content) {
+    // unique per call, since several threads (and, during a takeover, processes) may write the same file at once
+    static std::atomic<uint64_t> counter{0};
+    const std::string temp = file_path + ".tmp" + std::to_string(getpid()) + "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + "." + std::to_string(counter.fetch_add(1));
+    {
+        std::ofstream file{temp, std::ios::binary | std::ios::trunc};
+        file << content;
+        if (!file.good()) {
+            std::filesystem::remove(temp);
+            throw std::runtime_error{"Error writing " + temp + "."};
+        }
+    }
+
+    std::filesystem::rename(temp, file_path);
+}
+
+std::shared_ptr<webber::database> webber::open_database() {
+    std::shared_ptr<database> database = std::make_shared<webber::database>(settings.enabled_database, trace_query);
+
+    if (settings.enabled_database) {
+#ifdef WEBBER_ENABLE_POSTGRESQL
+        database->get_postgres().open(settings.psql_host,
+            settings.psql_username,
+            settings.psql_password,
+            settings.psql_database,
+            settings.psql_port);
+#endif
+    } else {
+#ifdef WEBBER_ENABLE_SQLITE
+        database->get_sqlite().open(settings.sqlite_database_file);
+#endif
+    }
+
+    if (!database->good()) {
+        fatal = true;
+        throw std::runtime_error{"Error opening the database file."};
+    }
+
+    // every worker has its own connection to the same file, so wait for locks held by the others instead of failing,
+    // and let readers proceed while another connection writes
+    if (!settings.enabled_database) {
+        database->exec("PRAGMA journal_mode = WAL;");
+        database->exec("PRAGMA busy_timeout = 5000;");
+    }
+
+    return database;
+}
+
+bool webber::match_path(const std::string_view endpoint, const std::string_view path, const bool prefix) {
+    const std::string_view p = endpoint.substr(0, endpoint.find('?'));
+    if (p == path) {
+        return true;
+    }
+
+    // on a path boundary, so that /api/get_revision is not below /api/get_revisions or the other way around
+    return prefix && p.size() > path.size() && p.starts_with(path) && p[path.size()] == '/';
+}
+
+const webber::Route* webber::find_route(const std::string_view endpoint) {
+    // the route class decides which admission limits a request is held to, see admission.hpp
+    static const std::unordered_map<std::string_view, Route> routes{[]() {
+        std::unordered_map<std::string_view, Route> ret{};
+        for (const auto& it : std::initializer_list<Route>{
+            {"/css/main.css", RouteClass::Static, get_stylesheet},
+            {"/js/main.js", RouteClass::Static, get_script},
+            {"/api/try_login", RouteClass::Auth, get_api_try_login},
+            {"/api/try_register", RouteClass::Auth, get_api_try_register},
+            {"/api/try_setup", RouteClass::Auth, nullptr}, // only while setup is needed, see handle_request
+            {"/api/user_exists", RouteClass::Auth, get_api_user_exists},
+            {"/api/get_settings", RouteClass::Page, get_api_get_settings},
+            {"/api/update_settings", RouteClass::Admin, get_api_update_settings},
+            {"/api/get_page", RouteClass::Page, get_api_get_page},
+            {"/api/create_page", RouteClass::Page, get_api_create_page},
+            {"/api/delete_page", RouteClass::Page, get_api_delete_page},
+            {"/api/update_page", RouteClass::Page, get_api_update_page},
+            {"/api/upload_file", RouteClass::Upload, get_api_upload_file},
+            {"/api/delete_file", RouteClass::Upload, get_api_delete_file},
+            {"/api/get_hierarchy", RouteClass::Page, get_api_get_hierarchy},
+            {"/api/get_revisions", RouteClass::Page, get_api_get_revisions},
+            {"/api/get_revision", RouteClass::Page, get_api_get_revision},
+            {"/api/get_logs", RouteClass::Admin, get_api_get_logs},
+            {"/api/reload_settings", RouteClass::Admin, get_api_reload_settings},
+            {"/api/metrics", RouteClass::Admin, get_api_metrics},
+            {"/api/get_trace", RouteClass::Admin, get_api_get_trace},
+            {"/api/stream_logs", RouteClass::Admin, get_api_stream_logs, true},
+            {"/api/search_logs", RouteClass::Admin, get_api_search_logs},
+        }) {
+            ret.emplace(it.path, it);
+        }
+        return ret;
+    }()};
+
+    // the exact path, one route may be a prefix of another
+    if (const auto it = routes.find(endpoint.substr(0, endpoint.find('?'))); it != routes.end()) {
+        return &it->second;
+    }
+
+    for (const auto& [path, route] : routes) {
+        if (route.prefix && match_path(endpoint, path, true)) {
+            return &route;
+        }
+    }
+
+    return nullptr;
+}
+
+limhamn::http::server::response webber::handle_request(const limhamn::http::server::request& request, database& db) {
+    logger.write_to_log(limhamn::logger::type::access, "Request received from ", request.ip_address, " to ", request.endpoint, " received, handling it.\n");
+
+    const auto snapshot = current_settings();
+
+    const Settings& settings = *snapshot;
+
+    // if setup needed, return setup page or setup api
+    if (needs_setup.load()) {
+        metrics::set_route("setup");
+        return request.endpoint != "/api/try_setup" ? get_setup_page(request, db) : get_api_try_setup(request, db);
+    }
+
+    // standard pages
+    if (const Route* route = find_route(request.endpoint); route != nullptr && route->handler != nullptr) {
+        metrics::set_route(route->path);
+        return route->handler(request, db);
+    }
+
+    // handle custom paths
+    if (const auto it = settings.custom_path_table.find(request.endpoint); it != settings.custom_path_table.end() && std::filesystem::is_regular_file(it->second)) {
+        metrics::set_route("custom");
+
+        limhamn::http::server::response response{};
+
+        response.body = open_file(it->second);
+        response.http_status = 200;
+        response.content_type = limhamn::http::utils::get_appropriate_content_type(it->first);
+
+        return response;
+    }
+
+    // exported pages are served without touching the database, so an exported page hides a file at the same location
+    if (settings.serve_exports) {
+        std::error_code ec{};
+        if (const auto file = get_export_file(request.endpoint.substr(0, request.endpoint.find('?'))); file && std::filesystem::is_regular_file(*file, ec)) {
+            metrics::set_route("export");
+
+            return {
+                .http_status = 200,
+                .content_type = "text/html",
+                .body = open_file(file->string()),
+            };
+        }
+    }
+
+    // a link shared somewhere busy brings many identical lookups at once, only one of them needs to reach the database
+    static single_flight<bool> file_lookups{};
+    if (file_lookups.run(request.endpoint, [&]() { return is_file(db, request.endpoint); }).value) {
+        metrics::set_route("file");
+
+        const auto session = sessions.get(request);
+        const auto& h = webber::download_file(db, webber::UserProperties{
+            .username = session.contains("username") ? session.at("username") : "",
+            .ip_address = request.ip_address,
+            .user_agent = request.user_agent,
+        }, request.endpoint);
+
+        if (h.require_login || h.require_admin) {
+            const auto login = is_logged_in(request, db);
+            if (!login.first || login.second.empty()) {
+                goto r;
+            }
+
+            if (h.require_admin && get_user_type(db, login.second) != UserType::Administrator) {
+                goto r;
+            }
+        }
+
+        limhamn::http::server::response response{};
+
+        response.body = open_file(h.path);
+        response.http_status = 200;
+        response.content_type = limhamn::http::utils::get_appropriate_content_type(h.name);
+
+        if (settings.preview_files) {
+            response.headers.push_back({"Content-Disposition", "inline; filename=\"" + h.name + "\""});
+        } else {
+            response.headers.push_back({"Content-Disposition", "attachment; filename=\"" + h.name + "\""});
+        }
+
+        metrics::add_download_bytes(response.body.size());
+
+        return response;
+    }
+
+    r:
+    metrics::set_route("fallback");
+
+    // fallback is index, javascript will handle the rest, such as 404 and pages
+    return get_index_page(request, db);
+}
+
+void webber::server_init() {
+    std::chrono::steady_clock::time_point takeover_deadline{};
+    bool taking_over{false};
+    bool initialized{false};
+
+    // the server is restarted in place after recoverable errors; this used to recurse and grow the stack with every restart
+    while (true) {
+        try {
+            if (!initialized) {
+#ifdef WEBBER_ENABLE_SQLITE
+#ifndef WEBBER_ENABLE_POSTGRESQL
+                settings.enabled_database = false;
+#endif
+#endif
+
+#ifdef WEBBER_ENABLE_POSTGRESQL
+#ifndef WEBBER_ENABLE_SQLITE
+                settings.enabled_database = true;
+#endif
+#endif
+
+                publish_settings(settings);
+                trace::set_buffer_size(settings.trace_buffer_size);
+
+#if WEBBER_DEBUG
+                logger.write_to_log(limhamn::logger::type::notice, "Using database type: " + std::string(settings.enabled_database ? "PostgreSQL" : "SQLite") + "\n");
+#endif
+
+                const auto database = open_database();
+
+                setup_database(*database);
+
+                // CHANGEME if 1 no longer corresponds to the admin user type
+                needs_setup = database->query("SELECT * FROM users WHERE user_type = 1;").empty();
+
+#ifdef WEBBER_DEBUG
+                logger.write_to_log(limhamn::logger::type::notice, "Needs setup: " + std::to_string(needs_setup.load()) + "\n");
+#endif
+
+                workers.start(static_cast<std::size_t>(std::max(0, settings.workers)), settings.pin_workers);
+                renders.start(static_cast<std::size_t>(settings.render_threads));
+                warm_up(*database);
+
+                // everything that can be done while the old instance is still serving is done; let it drain
+                if (upgrade) {
+                    taking_over = take_over();
+                    // counted from here, warming up may have taken a while
+                    takeover_deadline = std::chrono::steady_clock::now() + std::chrono::seconds(settings.drain_timeout + 5);
+                }
+
+                sessions.start(settings.session_directory + "/sessions.bin", settings.session_ttl, settings.session_snapshot_interval);
+                admission.start(settings.admission_limits, workers.size());
+                if (!taking_over) {
+                    write_pid_file(); // otherwise once listening, see take_over()
+                }
+
+                initialized = true;
+            }
+
+            limhamn::http::server::server(limhamn::http::server::server_settings{
+              .port = settings.port,
+              .enable_session = false, // sessions are kept in memory by webber::sessions instead
+              .max_request_size = settings.max_request_size,
+              .rate_limits = {}, // enforced by webber::rate_limits, weighted by what each route costs
+              .blacklisted_ips = {}, // enforced before anything else in the callback, so that the list can be reloaded
+              .whitelisted_ips = settings.whitelisted_ips,
+              .default_rate_limit = 0,
+              .trust_x_forwarded_for = settings.trust_x_forwarded_for,
+              }, [&](const limhamn::http::server::request& request) -> limhamn::http::server::response {
+                  const in_flight_guard guard{};
+
+                  // refused before any work is done on it, and before it takes a rate limit token or an admission slot
+                  if (current_settings()->blacklist->contains(request.ip_address)) {
+                      auto response = get_forbidden_response();
+                      metrics::record_request("forbidden", response.http_status, std::chrono::nanoseconds{0}, response.body.size());
+                      return response;
+                  }
+
+                  const RouteClass route_class = classify_request(request);
+                  const auto session = sessions.get(request);
+                  const std::string username = session.contains("username") ? session.at("username") : "";
+                  if (const double wait = acquire_rate_limit(request, username, get_request_cost(request)); wait > 0.0) {
+                      metrics::record_rate_limited(get_route_class_name(route_class));
+                      return get_rate_limited_response(wait);
+                  }
+
+                  // cheap requests keep being served while expensive ones queue for their own slots or are turned away
+                  const auto enqueued = std::chrono::steady_clock::now();
+                  const auto deadline = admission.get_deadline(route_class, enqueued);
+                  const auto ticket = admission.admit(route_class, deadline);
+                  if (!ticket) {
+                      metrics::record_shed(get_route_class_name(route_class));
+                      return get_overloaded_response();
+                  }
+
+                  auto response = workers.submit([&request, &username, enqueued, deadline, route_class](webber::database& db) {
+                      const auto start = std::chrono::steady_clock::now();
+
+                      // admitted, but waited for a worker until nobody is listening anymore
+                      if (start > deadline) {
+                          metrics::record_shed(get_route_class_name(route_class));
+                          return get_overloaded_response();
+                      }
+
+                      metrics::set_route({});
+                      trace::begin_request(current_settings()->trace_sample_rate);
+                      trace::record("queue", enqueued, start);
+
+                      limhamn::http::server::response response{};
+                      {
+                          trace::span span{"handle_request"};
+                          response = handle_request(request, db);
+                          span.set_detail(metrics::get_route());
+                      }
+                      metrics::record_request(metrics::get_route(), response.http_status, std::chrono::steady_clock::now() - start, response.body.size());
+                      if (metrics::get_route() == "file") {
+                          charge_download(request, username, response.body.size());
+                      }
+                      trace::end_request();
+
+                      return response;
+                  }, route_class == RouteClass::Static).get();
+                  sessions.update(request, response);
+
+                  // ask keep-alive clients to reconnect, which will land them on the instance taking over
+                  if (draining.load()) {
+                      response.headers.push_back({"Connection", "close"});
+                  }
+
+                  return response;
+              });
+
+            if (draining.load()) {
+                wait_for_drain();
+            }
+
+            return;
+        } catch (const std::exception& e) {
+            if (draining.load()) {
+                wait_for_drain();
+            }
+
+            if (std::string(e.what()).find("Address already in use") != std::string::npos) {
+                // while taking over, the old instance may not have let the port be shared yet
+                if (upgrade && std::chrono::steady_clock::now() < takeover_deadline) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                    continue;
+                }
+
+                fatal = true;
+                logger.write_to_log(limhamn::logger::type::error, "The port is already in use. Please try again later.\n");
+            } else {
+                logger.write_to_log(limhamn::logger::type::error, "An error occurred: " + std::string{e.what()} + "\n");
+            }
+
+            if (fatal) {
+                logger.write_to_log(limhamn::logger::type::error, "The last error was too severe to recover, and the server will now halt.\n");
+                std::exit(EXIT_FAILURE);
+            }
+
+            if (settings.halt_on_error) {
+                logger.write_to_log(limhamn::logger::type::error, "Halting the server due to an error.\n");
+                std::exit(EXIT_FAILURE);
+            }
+        }
+    }
+}
+
+void webber::warm_up(database& db) {
+    // pull the static files and the tables the first requests will hit into the page cache
+    for (const auto& it : {"/index.html", "/setup.html", "/style.css", "/script.js", "/settings.json"}) {
+        static_cast<void>(open_file(settings.data_directory + it));
+    }
+
+    static_cast<void>(db.query("SELECT location, json FROM pages;"));
+    static_cast<void>(db.query("SELECT file_path FROM files;"));
+    static_cast<void>(db.query("SELECT username, key, user_type FROM users;"));
+}
+
+bool webber::take_over() {
+    pid_t pid{0};
+    std::ifstream file{settings.pid_file};
+    if (!(file >> pid) || pid <= 0 || pid == getpid() || kill(pid, 0) != 0) {
+        logger.write_to_log(limhamn::logger::type::notice, "No running instance to take over from, starting normally.\n");
+        return false;
+    }
+
+    // the old instance lets the port be shared and keeps accepting on it until this one listens on it too
+    logger.write_to_log(limhamn::logger::type::notice, "Taking over from process " + std::to_string(pid) + ".\n");
+    if (kill(pid, SIGUSR2) != 0) {
+        logger.write_to_log(limhamn::logger::type::warning, "Failed to signal process " + std::to_string(pid) + ".\n");
+        return false;
+    }
+
+    std::thread{[pid]() {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(settings.drain_timeout);
+        while (find_listeners(settings.port).empty()) {
+            if (std::chrono::steady_clock::now() >= deadline) {
+                logger.write_to_log(limhamn::logger::type::error, "Never started listening, process " + std::to_string(pid) + " keeps serving.\n");
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+
+        // tells the old instance that it can stop accepting
+        write_pid_file();
+
+        const auto exit_deadline = std::chrono::steady_clock::now() + std::chrono::seconds(settings.drain_timeout + 5);
+        while (kill(pid, 0) == 0 && std::chrono::steady_clock::now() < exit_deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        // sessions the old instance created or used since the snapshot was loaded were saved as it exited
+        if (!sessions.load()) {
+            logger.write_to_log(limhamn::logger::type::warning, "Failed to restore the sessions saved by process " + std::to_string(pid) + ".\n");
+        }
+        upgrade = false;
+        logger.write_to_log(limhamn::logger::type::notice, "Took over from process " + std::to_string(pid) + ".\n");
+    }}.detach();
+
+    return true;
+}
+
+void webber::write_pid_file() {
+    if (settings.pid_file.empty()) {
+        return;
+    }
+
+    const std::string temp_file = settings.pid_file + ".tmp";
+    {
+        std::ofstream file{temp_file, std::ios::trunc};
+        file << getpid() << "\n";
+    }
+
+    std::error_code ec{};
+    std::filesystem::rename(temp_file, settings.pid_file, ec);
+    if (ec) {
+        logger.write_to_log(limhamn::logger::type::warning, "Failed to write the pid file " + settings.pid_file + ": " + ec.message() + "\n");
+    }
+}
+
+void webber::drain(const bool handover) {
+    draining = true;
+
+    // new connections keep being accepted until the instance taking over accepts them too
+    if (handover) {
+        set_reuse_port(settings.port, true);
+
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(settings.drain_timeout);
+        while (!has_successor()) {
+            if (std::chrono::steady_clock::now() >= deadline) {
+                logger.write_to_log(limhamn::logger::type::warning, "The instance taking over never started listening, serving as before.\n");
+                set_reuse_port(settings.port, false);
+                draining = false;
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+
+    // without this, new connections keep coming in and in_flight may never reach 0
+    if (stop_listening(settings.port) == 0) {
+        logger.write_to_log(limhamn::logger::type::warning, "Failed to find the listening socket, new connections will still be accepted while draining.\n");
+    }
+    logger.write_to_log(limhamn::logger::type::notice, "Draining " + std::to_string(in_flight.load()) + " in-flight requests.\n");
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(settings.drain_timeout);
+    while (in_flight.load() > 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    if (const int64_t left = in_flight.load(); left > 0) {
+        logger.write_to_log(limhamn::logger::type::warning, "Drain timeout reached, exiting with " + std::to_string(left) + " requests still in flight.\n");
+    }
+
+    // pages still rendering in the background are stored by the workers, which are still running
+    renders.stop();
+    sessions.stop();
+
+    // visits buffered by record_visit() would be lost otherwise
+    try {
+        flush_visits(*open_database());
+    } catch (const std::exception& e) {
+        logger.write_to_log(limhamn::logger::type::error, "Failed to write the pending visits: " + std::string{e.what()} + "\n");
+    }
+
+    // the pid file belongs to whoever wrote it last, which may already be the instance taking over
+    pid_t pid{0};
+    if (std::ifstream file{settings.pid_file}; (file >> pid) && pid == getpid()) {
+        std::filesystem::remove(settings.pid_file);
+    }
+
+    logger.write_to_log(limhamn::logger::type::notice, "Drained, exiting.\n");
+    std::exit(EXIT_SUCCESS);
+}
+
+webber::Settings webber::load_settings(const std::string& _config) {
+    std::string config = _config;
+    if (config.empty()) {
+        const char* env = std::getenv("WEBBER_CONFIG_FILE");
+
+        if (env != nullptr) {
+            config = env;
+        }
+    } else {
+    #ifdef WEBBER_DEBUG
+        config = "./config.yaml";
+    #else
+        config = "/etc/webber/config.yaml";
+    #endif
+    }
+
+    if (!std::filesystem::exists(config)) {
+        std::cerr << "Warning: The configuration file does not exist. Using default settings:\n";
+        const auto remove_all_comments = [](const std::string& str) -> std::string {
+            std::string ret;
+            std::istringstream ss{str};
+            std::string line;
+            while (std::getline(ss, line)) {
+                if (line.find('#') != std::string::npos) {
+                    line = line.substr(0, line.find('#'));
+                }
+                ret += line + "\n";
+            }
+            while (ret.find("\n\n") != std::string::npos) {
+                ret = ret.substr(0, ret.find("\n\n")) + ret.substr(ret.find("\n\n") + 1);
+            }
+            return ret;
+        };
+
+        std::cerr << remove_all_comments(get_default_config());
+        return {};
+    }
+
+#ifdef WEBBER_DEBUG
+    std::cout << "Loading configuration file: " << config << "\n";
+#endif
+
+    config_path = config;
+
+    try {
+        Settings settings = parse_settings(config);
+        validate_settings(settings);
+        return settings;
+    } catch (const YAML::Exception& e) {
+        std::cerr << "Error loading the configuration file: " << e.what() << "\n";
+        std::exit(EXIT_FAILURE);
+    } catch (const std::exception& e) {
+        std::cerr << "Invalid configuration file: " << e.what() << "\n";
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+// throws on anything that cannot be parsed, so that a reload can keep the running settings
+webber::Settings webber::parse_settings(const std::string& config) {
+    Settings settings{};
+
+    {
+        YAML::Node y = YAML::LoadFile(config);
+
+        if (y["logger"]["output_to_std"]) settings.output_to_std = y["logger"]["output_to_std"].as<bool>();
+        if (y["logger"]["halt_on_error"]) settings.halt_on_error = y["logger"]["halt_on_error"].as<bool>();
+        if (y["logger"]["log_access_to_file"]) settings.log_access_to_file = y["logger"]["log_access_to_file"].as<bool>();
+        if (y["logger"]["log_warning_to_file"]) settings.log_warning_to_file = y["logger"]["log_warning_to_file"].as<bool>();
+        if (y["logger"]["log_error_to_file"]) settings.log_error_to_file = y["logger"]["log_error_to_file"].as<bool>();
+        if (y["logger"]["log_notice_to_file"]) settings.log_notice_to_file = y["logger"]["log_notice_to_file"].as<bool>();
+        if (y["logger"]["queue_size"]) settings.log_queue_size = y["logger"]["queue_size"].as<std::size_t>();
+        if (y["logger"]["when_full"]) settings.log_when_full = y["logger"]["when_full"].as<std::string>();
+        if (y["logger"]["max_size"]) settings.log_max_size = y["logger"]["max_size"].as<int64_t>();
+        if (y["logger"]["max_age"]) settings.log_max_age = y["logger"]["max_age"].as<int64_t>();
+        if (y["logger"]["keep"]) settings.log_keep = y["logger"]["keep"].as<std::size_t>();
+        if (y["logger"]["compress"]) settings.log_compress = y["logger"]["compress"].as<bool>();
+        if (y["logger"]["stream_max_subscribers"]) settings.log_stream_max_subscribers = y["logger"]["stream_max_subscribers"].as<std::size_t>();
+        if (y["logger"]["stream_timeout"]) settings.log_stream_timeout = y["logger"]["stream_timeout"].as<int64_t>();
+        if (y["account"]["username_min_length"]) settings.username_min_length = y["account"]["username_min_length"].as<std::size_t>();
+        if (y["account"]["username_max_length"]) settings.username_max_length = y["account"]["username_max_length"].as<std::size_t>();
+        if (y["account"]["password_min_length"]) settings.password_min_length = y["account"]["password_min_length"].as<std::size_t>();
+        if (y["account"]["password_max_length"]) settings.password_max_length = y["account"]["password_max_length"].as<std::size_t>();
+        if (y["account"]["allowed_characters"]) settings.allowed_characters = y["account"]["allowed_characters"].as<std::string>();
+        if (y["account"]["allow_all_characters"]) settings.allow_all_characters = y["account"]["allow_all_characters"].as<bool>();
+        if (y["filesystem"]["session_directory"]) settings.session_directory = y["filesystem"]["session_directory"].as<std::string>();
+        if (y["filesystem"]["data_directory"]) settings.data_directory = y["filesystem"]["data_directory"].as<std::string>();
+        if (y["filesystem"]["temp_directory"]) settings.temp_directory = y["filesystem"]["temp_directory"].as<std::string>();
+        if (y["filesystem"]["access_file"]) settings.access_file = y["filesystem"]["access_file"].as<std::string>();
+        if (y["filesystem"]["warning_file"]) settings.warning_file = y["filesystem"]["warning_file"].as<std::string>();
+        if (y["filesystem"]["error_file"]) settings.error_file = y["filesystem"]["error_file"].as<std::string>();
+        if (y["filesystem"]["notice_file"]) settings.notice_file = y["filesystem"]["notice_file"].as<std::string>();
+        if (y["filesystem"]["pid_file"]) settings.pid_file = y["filesystem"]["pid_file"].as<std::string>();
+        if (y["database"]["type"]) settings.enabled_database = y["database"]["type"].as<std::string>() == "postgresql";
+        if (y["sqlite3"]["sqlite_database_file"]) settings.sqlite_database_file = y["sqlite3"]["sqlite_database_file"].as<std::string>();
+        if (y["database"]["slow_query_threshold"]) settings.slow_query_threshold = y["database"]["slow_query_threshold"].as<int64_t>();
+        if (y["database"]["query_trace_sample_rate"]) settings.query_trace_sample_rate = y["database"]["query_trace_sample_rate"].as<double>();
+        if (y["postgresql"]["database"]) settings.psql_database = y["postgresql"]["database"].as<std::string>();
+        if (y["postgresql"]["username"]) settings.psql_username = y["postgresql"]["username"].as<std::string>();
+        if (y["postgresql"]["password"]) settings.psql_password = y["postgresql"]["password"].as<std::string>();
+        if (y["postgresql"]["host"]) settings.psql_host = y["postgresql"]["host"].as<std::string>();
+        if (y["postgresql"]["port"]) settings.psql_port = y["postgresql"]["port"].as<int>();
+        if (y["client"]["session_cookie_name"]) settings.session_cookie_name = y["client"]["session_cookie_name"].as<std::string>();
+        if (y["session"]["ttl"]) settings.session_ttl = y["session"]["ttl"].as<int64_t>();
+        if (y["session"]["snapshot_interval"]) settings.session_snapshot_interval = y["session"]["snapshot_interval"].as<int64_t>();
+        if (y["trace"]["sample_rate"]) settings.trace_sample_rate = y["trace"]["sample_rate"].as<double>();
+        if (y["trace"]["buffer_size"]) settings.trace_buffer_size = y["trace"]["buffer_size"].as<std::size_t>();
+        if (y["trace"]["metrics_token"]) settings.metrics_token = y["trace"]["metrics_token"].as<std::string>();
+        if (y["site"]["url"]) settings.site_url = y["site"]["url"].as<std::string>();
+        if (y["upload"]["max_request_size"]) settings.max_request_size = y["upload"]["max_request_size"].as<int64_t>();
+        if (y["upload"]["max_file_size_hash"]) settings.max_file_size_hash = y["upload"]["max_file_size_hash"].as<int64_t>();
+        if (y["download"]["preview_files"]) settings.preview_files = y["download"]["preview_files"].as<bool>();
+        if (y["pages"]["render_threads"]) settings.render_threads = y["pages"]["render_threads"].as<int>();
+        if (y["pages"]["background_render_size"]) settings.background_render_size = y["pages"]["background_render_size"].as<int64_t>();
+        if (y["pages"]["export_directory"]) settings.export_directory = y["pages"]["export_directory"].as<std::string>();
+        if (y["pages"]["serve_exports"]) settings.serve_exports = y["pages"]["serve_exports"].as<bool>();
+        if (y["http"]["port"]) settings.port = y["http"]["port"].as<int>();
+        if (y["http"]["trust_x_forwarded_for"]) settings.trust_x_forwarded_for = y["http"]["trust_x_forwarded_for"].as<bool>();
+        if (y["http"]["max_requests_per_ip_per_minute"]) settings.rate_limit = y["http"]["max_requests_per_ip_per_minute"].as<int>();
+        if (y["http"]["max_requests_per_user_per_minute"]) settings.user_rate_limit = y["http"]["max_requests_per_user_per_minute"].as<int>();
+        if (y["http"]["download_bytes_per_token"]) settings.download_bytes_per_token = y["http"]["download_bytes_per_token"].as<int64_t>();
+        if (y["http"]["route_costs"]) {
+            settings.route_costs.clear();
+            for (const auto& it : y["http"]["route_costs"]) {
+                RouteCost cost{.path = it["path"].as<std::string>()};
+                if (it["cost"]) cost.cost = it["cost"].as<double>();
+                if (it["bytes_per_token"]) cost.bytes_per_token = it["bytes_per_token"].as<int64_t>();
+                settings.route_costs.push_back(std::move(cost));
+            }
+        }
+        if (y["http"]["workers"]) settings.workers = y["http"]["workers"].as<int>();
+        if (y["http"]["pin_workers"]) settings.pin_workers = y["http"]["pin_workers"].as<bool>();
+        if (y["http"]["drain_timeout"]) settings.drain_timeout = y["http"]["drain_timeout"].as<int64_t>();
+        for (std::size_t i{0}; i < route_class_count; ++i) {
+            const std::string name{get_route_class_name(static_cast<RouteClass>(i))};
+            if (y["http"]["admission"][name]["max_concurrent"]) settings.admission_limits[i].max_concurrent = y["http"]["admission"][name]["max_concurrent"].as<std::size_t>();
+            if (y["http"]["admission"][name]["max_queue_time"]) settings.admission_limits[i].max_queue_time = y["http"]["admission"][name]["max_queue_time"].as<int64_t>();
+        }
+        if (y["http"]["whitelisted_ips"]) {
+            for (const auto& ip : y["http"]["whitelisted_ips"]) {
+                settings.whitelisted_ips.emplace_back(ip.as<std::string>());
+            }
+        }
+        if (y["http"]["blacklisted_ips"]) {
+            for (const auto& ip : y["http"]["blacklisted_ips"]) {
+                settings.blacklisted_ips.emplace_back(ip.as<std::string>());
+            }
+        }
+        if (y["http"]["blocklist_file"]) settings.blocklist_file = y["http"]["blocklist_file"].as<std::string>();
+        if (y["paths"]) {
+            for (const auto& n : y["paths"]) {
+                auto first = n.first.as<std::string>();
+                auto second = n.second.as<std::string>();
+                if (std::filesystem::is_regular_file(second)) {
+                    settings.custom_paths.emplace_back(n.first.as<std::string>(), n.second.as<std::string>());
+                } else {
+                    if (second.back() == '*') {
+                        for (const auto& entry : std::filesystem::directory_iterator(second.substr(0, second.size() - 1))) {
+                            settings.custom_paths.emplace_back(first + entry.path().filename().string(), entry.path().string());
+                        }
+                    } else {
+                        logger.write_to_log(limhamn::logger::type::warning, "The file " + n.first.as<std::string>() + " does not exist. Skipping.\n");
+                    }
+                }
+            }
+        }
+    }
+
+    return settings;
+}
+
+void webber::validate_settings(const Settings& settings) {
+    if (settings.port <= 0 || settings.port > 65535) {
+        throw std::runtime_error{"http.port must be between 1 and 65535."};
+    }
+    if (settings.log_queue_size < 2) {
+        throw std::runtime_error{"logger.queue_size must be at least 2."};
+    }
+    if (settings.log_when_full != "drop" && settings.log_when_full != "block") {
+        throw std::runtime_error{"logger.when_full must be drop or block."};
+    }
+    if (settings.log_stream_timeout < 0) {
+        throw std::runtime_error{"logger.stream_timeout must not be negative."};
+    }
+    if (settings.log_max_size < 0 || settings.log_max_age < 0) {
+        throw std::runtime_error{"logger.max_size and logger.max_age must not be negative."};
+    }
+    if (settings.rate_limit < 0) {
+        throw std::runtime_error{"http.max_requests_per_ip_per_minute must not be negative."};
+    }
+    if (settings.user_rate_limit < 0) {
+        throw std::runtime_error{"http.max_requests_per_user_per_minute must not be negative."};
+    }
+    if (settings.download_bytes_per_token < 0) {
+        throw std::runtime_error{"http.download_bytes_per_token must not be negative."};
+    }
+    for (const auto& list : {&settings.whitelisted_ips, &settings.blacklisted_ips}) {
+        ip_set set{};
+        for (const auto& it : *list) {
+            set.insert(it);
+        }
+    }
+    for (const auto& it : settings.route_costs) {
+        if (it.path.empty() || it.cost < 0.0 || it.bytes_per_token < 0) {
+            throw std::runtime_error{"http.route_costs entries need a path, and a cost and bytes_per_token that are not negative."};
+        }
+    }
+    if (settings.render_threads < 1) {
+        throw std::runtime_error{"pages.render_threads must be at least 1."};
+    }
+    if (settings.background_render_size < 0) {
+        throw std::runtime_error{"pages.background_render_size must not be negative."};
+    }
+    if (settings.username_min_length > settings.username_max_length) {
+        throw std::runtime_error{"account.username_min_length must not be greater than account.username_max_length."};
+    }
+    if (settings.password_min_length > settings.password_max_length) {
+        throw std::runtime_error{"account.password_min_length must not be greater than account.password_max_length."};
+    }
+    if (settings.query_trace_sample_rate < 0.0 || settings.query_trace_sample_rate > 1.0) {
+        throw std::runtime_error{"database.query_trace_sample_rate must be between 0.0 and 1.0."};
+    }
+    if (settings.trace_sample_rate < 0.0 || settings.trace_sample_rate > 1.0) {
+        throw std::runtime_error{"trace.sample_rate must be between 0.0 and 1.0."};
+    }
+    if (settings.data_directory.empty() || settings.temp_directory.empty() || settings.session_directory.empty()) {
+        throw std::runtime_error{"The data, temp and session directories must be set."};
+    }
+    // --export-pages removes every index.html in it that isn't an exported page, so it must not overlap with
+    // a directory holding anything else
+    if (!settings.export_directory.empty()) {
+        const auto normalize = [](const std::string& path) {
+            std::filesystem::path ret = std::filesystem::weakly_canonical(std::filesystem::absolute(path));
+            return ret.has_filename() ? ret : ret.parent_path();
+        };
+        // whether a is b or one of its ancestors
+        const auto contains = [](const std::filesystem::path& a, const std::filesystem::path& b) {
+            return std::mismatch(a.begin(), a.end(), b.begin(), b.end()).first == a.end();
+        };
+
+        const auto export_directory = normalize(settings.export_directory);
+        for (const auto& it : {settings.data_directory, settings.temp_directory, settings.session_directory}) {
+            const auto directory = normalize(it);
+            if (contains(export_directory, directory) || contains(directory, export_directory)) {
+                throw std::runtime_error{"pages.export_directory must not contain or be inside the data, temp or session directory."};
+            }
+        }
+    }
+}
+
+std::string webber::get_default_config() {
+    std::stringstream ss;
+
+    ss << "# webber Configuration File\n";
+    ss << "#\n";
+    ss << "# This is the configuration file for webber version " << WEBBER_VERSION << ". You can change the settings to your liking.\n";
+    ss << "# It should be placed in /etc/webber/, named config.yaml. If you want to use a different file, you can set the WEBBER_CONFIG_FILE environment variable or pass --config-file.\n";
+    ss << "#\n";
+    ss << "# Logger options:\n";
+    ss << "#   output_to_std: Whether to output log messages to the standard output.\n";
+    ss << "#   halt_on_error: Whether to halt the server on an error.\n";
+    ss << "#   log_access_to_file: Whether to log access messages to a file.\n";
+    ss << "#   log_warning_to_file: Whether to log warning messages to a file.\n";
+    ss << "#   log_error_to_file: Whether to log error messages to a file.\n";
+    ss << "#   log_notice_to_file: Whether to log notice messages to a file.\n";
+    ss << "#   queue_size: The number of log lines that can wait to be written to disk.\n";
+    ss << "#   when_full: What to do with a log line when the queue is full. (drop, block)\n";
+    ss << "#   max_size: The size in bytes at which a log file is rotated. 0 disables rotation by size.\n";
+    ss << "#   max_age: The number of seconds after which a log file is rotated. 0 disables rotation by age.\n";
+    ss << "#   keep: The number of rotated segments to keep per log file. 0 keeps all of them.\n";
+    ss << "#   compress: Whether to gzip rotated segments.\n";
+    ss << "#   stream_max_subscribers: The number of administrators that can follow the logs live at once. Each one occupies a worker while waiting.\n";
+    ss << "#   stream_timeout: The number of milliseconds a live log request waits for new lines before the client reconnects.\n";
+    ss << "logger:\n";
+    ss << "  output_to_std: " << (webber::settings.output_to_std ? "true" : "false") << "\n";
+    ss << "  halt_on_error: " << (webber::settings.halt_on_error ? "true" : "false") << "\n";
+    ss << "  log_access_to_file: " << (webber::settings.log_access_to_file ? "true" : "false") << "\n";
+    ss << "  log_warning_to_file: " << (webber::settings.log_warning_to_file ? "true" : "false") << "\n";
+    ss << "  log_error_to_file: " << (webber::settings.log_error_to_file ? "true" : "false") << "\n";
+    ss << "  log_notice_to_file: " << (webber::settings.log_notice_to_file ? "true" : "false") << "\n";
+    ss << "  queue_size: " << webber::settings.log_queue_size << "\n";
+    ss << "  when_full: \"" << webber::settings.log_when_full << "\"\n";
+    ss << "  max_size: " << webber::settings.log_max_size << "\n";
+    ss << "  max_age: " << webber::settings.log_max_age << "\n";
+    ss << "  keep: " << webber::settings.log_keep << "\n";
+    ss << "  compress: " << (webber::settings.log_compress ? "true" : "false") << "\n";
+    ss << "  stream_max_subscribers: " << webber::settings.log_stream_max_subscribers << "\n";
+    ss << "  stream_timeout: " << webber::settings.log_stream_timeout << "\n";
+    ss << "\n";
+    ss << "# Account options:\n";
+    ss << "#   username_min_length: The minimum length of a username.\n";
+    ss << "#   username_max_length: The maximum length of a username.\n";
+    ss << "#   password_min_length: The minimum length of a password.\n";
+    ss << "#   password_max_length: The maximum length of a password.\n";
+    ss << "#   allowed_characters: The characters allowed in a username or password.\n";
+    ss << "#   allow_all_characters: Whether to allow all characters in a username or password.\n";
+    ss << "account:\n";
+    ss << "  username_min_length: " << webber::settings.username_min_length << "\n";
+    ss << "  username_max_length: " << webber::settings.username_max_length << "\n";
+    ss << "  password_min_length: " << webber::settings.password_min_length << "\n";
+    ss << "  password_max_length: " << webber::settings.password_max_length << "\n";
+    ss << "  allowed_characters: \"" << webber::settings.allowed_characters << "\"\n";
+    ss << "  allow_all_characters: " << (webber::settings.allow_all_characters ? "true" : "false") << "\n";
+    ss << "\n";
+    ss << "# HTTP options:\n";
+    ss << "#   port: The port to run the web server on.\n";
+    ss << "#   trust_x_forwarded_for: Whether to trust the X-Forwarded-For header. ONLY ENABLE IF YOU'RE USING A REVERSE PROXY THAT YOU TRUST!\n";
+    ss << "#   max_requests_per_ip_per_minute: The number of rate limit tokens an IP gets per minute. A request normally costs one token. 0 means no limit.\n";
+    ss << "#   max_requests_per_user_per_minute: The number of rate limit tokens a logged in user gets per minute, on top of the IP limit. 0 means no limit.\n";
+    ss << "#   route_costs: What requests to an endpoint cost, the first matching path (or a path below it) wins. cost is the number of tokens per request,\n";
+    ss << "#     and bytes_per_token (0 to disable) adds one token per that many bytes of request body.\n";
+    ss << "#   download_bytes_per_token: File downloads additionally cost one token per this many bytes. 0 disables it.\n";
+    ss << "#   whitelisted_ips: A list of whitelisted IPs or CIDR ranges (such as 10.0.0.0/8 or 2001:db8::/32).\n";
+    ss << "#   blacklisted_ips: A list of blacklisted IPs or CIDR ranges.\n";
+    ss << "#   blocklist_file: A file with one blacklisted IP or CIDR range per line, reloaded with the configuration. Empty to disable.\n";
+    ss << "#   workers: The number of request workers, each with its own database connection. 0 means one per core.\n";
+    ss << "#   pin_workers: Whether to pin each request worker to its own core.\n";
+    ss << "#   drain_timeout: The number of seconds a drain waits for in-flight requests before exiting anyway, and for an instance taking over to start listening.\n";
+    ss << "#   admission: Per route class (static, page, auth, upload, admin), max_concurrent is how many requests are handled at once (0 means no limit)\n";
+    ss << "#     and max_queue_time how many milliseconds a request may wait for a slot before it is turned away with 503.\n";
+    ss << "#     Whatever these add up to, a quarter of the workers (at least one) are kept free of everything but static requests.\n";
+    ss << "http:\n";
+    ss << "  port: " << webber::settings.port << "\n";
+    ss << "  trust_x_forwarded_for: " << (webber::settings.trust_x_forwarded_for ? "true" : "false") << "\n";
+    ss << "  max_requests_per_ip_per_minute: " << webber::settings.rate_limit << "\n";
+    ss << "  max_requests_per_user_per_minute: " << webber::settings.user_rate_limit << "\n";
+    ss << "  download_bytes_per_token: " << webber::settings.download_bytes_per_token << "\n";
+    ss << "  route_costs:\n";
+    for (const auto& it : webber::settings.route_costs) {
+        ss << "    - path: \"" << it.path << "\"\n";
+        ss << "      cost: " << it.cost << "\n";
+        ss << "      bytes_per_token: " << it.bytes_per_token << "\n";
+    }
+    ss << "  workers: " << webber::settings.workers << "\n";
+    ss << "  pin_workers: " << (webber::settings.pin_workers ? "true" : "false") << "\n";
+    ss << "  drain_timeout: " << webber::settings.drain_timeout << "\n";
+    ss << "  whitelisted_ips:\n";
+    for (const auto& ip : webber::settings.whitelisted_ips) {
+        ss << "    - " << ip << "\n";
+    }
+    ss << "  blacklisted_ips:\n";
+    for (const auto& ip : webber::settings.blacklisted_ips) {
+        ss << "    - " << ip << "\n";
+    }
+    ss << "  blocklist_file: \"" << webber::settings.blocklist_file << "\"\n";
+    ss << "  admission:\n";
+    for (std::size_t i{0}; i < webber::route_class_count; ++i) {
+        ss << "    " << webber::get_route_class_name(static_cast<webber::RouteClass>(i)) << ":\n";
+        ss << "      max_concurrent: " << webber::settings.admission_limits[i].max_concurrent << "\n";
+        ss << "      max_queue_time: " << webber::settings.admission_limits[i].max_queue_time << "\n";
+    }
+    ss << "\n";
+    ss << "# Filesystem options:\n";
+    ss << "#   session_directory: The directory where the session snapshot is stored.\n";
+    ss << "#   data_directory: The directory where data files are stored.\n";
+    ss << "#   temp_directory: The directory where temporary files are stored.\n";
+    ss << "#   access_file: The path to the access log file.\n";
+    ss << "#   warning_file: The path to the warning log file.\n";
+    ss << "#   error_file: The path to the error log file.\n";
+    ss << "#   notice_file: The path to the notice log file.\n";
+    ss << "#   pid_file: The path to the pid file, used by --upgrade to find the instance to take over from.\n";
+    ss << "filesystem:\n";
+    ss << "  session_directory: \"" << webber::settings.session_directory << "\"\n";
+    ss << "  data_directory: \"" << webber::settings.data_directory << "\"\n";
+    ss << "  temp_directory: \"" << webber::settings.temp_directory << "\"\n";
+    ss << "  access_file: \"" << webber::settings.access_file << "\"\n";
+    ss << "  warning_file: \"" << webber::settings.warning_file << "\"\n";
+    ss << "  error_file: \"" << webber::settings.error_file << "\"\n";
+    ss << "  notice_file: \"" << webber::settings.notice_file << "\"\n";
+    ss << "  pid_file: \"" << webber::settings.pid_file << "\"\n";
+    ss << "\n";
+    ss << "# Database options:\n";
+    ss << "#   type: The type of database to use. (sqlite3, postgresql)\n";
+    ss << "#   slow_query_threshold: Queries taking at least this many milliseconds are written to the warning log, with their parameters redacted. -1 disables it.\n";
+    ss << "#   query_trace_sample_rate: The fraction of all queries (0.0 to 1.0) written to the notice log with their timing.\n";
+    ss << "database:\n";
+    ss << "  type: \"" << (webber::settings.enabled_database ? "postgresql" : "sqlite3") << "\"\n";
+    ss << "  slow_query_threshold: " << webber::settings.slow_query_threshold << "\n";
+    ss << "  query_trace_sample_rate: " << webber::settings.query_trace_sample_rate << "\n";
+    ss << "\n";
+    ss << "# SQLite3 options:\n";
+    ss << "#   sqlite_database_file: The path to the SQLite3 database file.\n";
+    ss << "sqlite3:\n";
+    ss << "  sqlite_database_file: \"" << webber::settings.sqlite_database_file << "\"\n";
+    ss << "\n";
+    ss << "# PostgreSQL options:\n";
+    ss << "#   database: The PostgreSQL database.\n";
+    ss << "#   username: The PostgreSQL username.\n";
+    ss << "#   password: The PostgreSQL password.\n";
+    ss << "#   host: The PostgreSQL host.\n";
+    ss << "#   port: The PostgreSQL port.\n";
+    ss << "postgresql:\n";
+    ss << "  database: \"" << webber::settings.psql_database << "\"\n";
+    ss << "  username: \"" << webber::settings.psql_username << "\"\n";
+    ss << "  password: \"" << webber::settings.psql_password << "\"\n";
+    ss << "  host: \"" << webber::settings.psql_host << "\"\n";
+    ss << "  port: " << webber::settings.psql_port << "\n";
+    ss << "\n";
+    ss << "# Client options:\n";
+    ss << "#   session_cookie_name: The name of the session cookie.\n";
+    ss << "client:\n";
+    ss << "  session_cookie_name: \"" << webber::settings.session_cookie_name << "\"\n";
+    ss << "\n";
+    ss << "# Session options:\n";
+    ss << "#   ttl: The number of seconds a session stays valid after it was last used.\n";
+    ss << "#   snapshot_interval: How often, in seconds, sessions are written to the session directory so that they survive a restart.\n";
+    ss << "session:\n";
+    ss << "  ttl: " << webber::settings.session_ttl << "\n";
+    ss << "  snapshot_interval: " << webber::settings.session_snapshot_interval << "\n";
+    ss << "\n";
+    ss << "# Trace options:\n";
+    ss << "#   sample_rate: The fraction of requests (0.0 to 1.0) whose stages are recorded. Dump the last 10 seconds with SIGUSR1 or /api/get_trace.\n";
+    ss << "#   buffer_size: The number of spans kept per thread.\n";
+    ss << "#   metrics_token: A token scrapers send as \"Authorization: Bearer <token>\" to read /api/metrics without logging in. Empty to only allow administrators.\n";
+    ss << "trace:\n";
+    ss << "  sample_rate: " << webber::settings.trace_sample_rate << "\n";
+    ss << "  buffer_size: " << webber::settings.trace_buffer_size << "\n";
+    ss << "  metrics_token: \"" << webber::settings.metrics_token << "\"\n";
+    ss << "\n";
+    ss << "# Site options:\n";
+    ss << "#   url: The URL of the site (e.g. https://example.com).\n";
+    ss << "site:\n";
+    ss << "  url: \"" << webber::settings.site_url << "\"\n";
+    ss << "\n";
+    ss << "# Upload options:\n";
+    ss << "#   max_request_size: The maximum request size in bytes. Any larger will be rejected by the server\n";
+    ss << "#   max_file_size_hash: The maximum file size in bytes that can be hashed. Any larger will not be hashed.\n";
+    ss << "upload:\n";
+    ss << "  max_request_size: " << webber::settings.max_request_size << "\n";
+    ss << "  max_file_size_hash: " << webber::settings.max_file_size_hash << "\n";
+    ss << "\n";
+    ss << "# Download options:\n";
+    ss << "#   preview_files: Whether to preview files in the browser when downloading them.\n";
+    ss << "download:\n";
+    ss << "  preview_files: " << (webber::settings.preview_files ? "true" : "false") << "\n";
+    ss << "\n";
+    ss << "# Page options:\n";
+    ss << "#   render_threads: The number of threads rendering large pages in the background.\n";
+    ss << "#   background_render_size: Pages with more markdown than this many bytes are saved right away and rendered in the background. 0 renders every page before saving it.\n";
+    ss << "#   export_directory: Where public pages are exported to as complete HTML documents, kept up to date as pages change. Empty disables exporting. Run webber --export-pages after changing index.html or settings.json.\n";
+    ss << "#   serve_exports: Whether to serve exported pages from export_directory instead of the database.\n";
+    ss << "pages:\n";
+    ss << "  render_threads: " << webber::settings.render_threads << "\n";
+    ss << "  background_render_size: " << webber::settings.background_render_size << "\n";
+    ss << "  export_directory: \"" << webber::settings.export_directory << "\"\n";
+    ss << "  serve_exports: " << (webber::settings.serve_exports ? "true" : "false") << "\n";
+    ss << "\n";
+    ss << "# Custom paths:\n";
+    ss << "#   These are paths to files that are not in the default directories.\n";
+    ss << "#   The first path is the virtual path, and the second path is the actual path.\n";
+    ss << "paths:\n";
+    for (const auto& p : webber::settings.custom_paths) {
+        ss << "  \"" << p.first << "\": \"" << p.second << "\"\n";
+    }
+    return ss.str();
+}
+
+void webber::prepare_wd() {
+    const auto log_error = [](const std::string& error_msg) {
+        webber::logger.write_to_log(limhamn::logger::type::error, error_msg);
+        std::exit(EXIT_FAILURE);
+    };
+    const auto create_directory = [](const std::string& path) -> bool {
+        try {
+            if (path == "." || path == "..") return true;
+            if (std::filesystem::is_directory(path)) return true;
+            if (!std::filesystem::create_directories(path)) {
+                return false;
+            }
+
+            return true;
+        } catch (const std::filesystem::filesystem_error&) {
+            return false;
+        }
+    };
+    const auto check_if_exists = [](const std::string& path) -> bool {
+        return std::filesystem::exists(path);
+    };
+#ifndef WEBBER_DEBUG
+    const auto remove_all_in_directory = [&check_if_exists](const std::string& path) -> void {
+        if (!check_if_exists(path)) {
+            return;
+        }
+
+        for (const auto& entry : std::filesystem::directory_iterator(path)) {
+#if WEBBER_DEBUG
+            webber::logger.write_to_log(limhamn::logger::type::notice, "Removing: " + entry.path().string() + "\n");
+#endif
+            std::filesystem::remove(entry.path());
+        }
+    };
+#endif
+
+    if (!check_if_exists(webber::settings.session_directory)) {
+        webber::logger.write_to_log(limhamn::logger::type::notice, "The session directory does not exist. Creating it.\n");
+        if (!create_directory(webber::settings.session_directory)) {
+            log_error("Failed to create the session directory. Do I have adequate permissions? Unrecoverable error.\n");
+        }
+        webber::logger.write_to_log(limhamn::logger::type::notice, "The session directory was created.\n");
+    }
+
+    if (!check_if_exists(webber::settings.data_directory)) {
+        webber::logger.write_to_log(limhamn::logger::type::notice, "The data directory does not exist. Creating it.\n");
+        if (!create_directory(webber::settings.data_directory)) {
+            log_error("Failed to create the data directory. Do I have adequate permissions? Unrecoverable error.\n");
+        }
+        webber::logger.write_to_log(limhamn::logger::type::notice, "The data directory was created.\n");
+    }
+
+    if (!check_if_exists(webber::settings.temp_directory)) {
+        webber::logger.write_to_log(limhamn::logger::type::notice, "The temp directory does not exist. Creating it.\n");
+        if (!create_directory(webber::settings.temp_directory)) {
+            log_error("Failed to create the temp directory. Do I have adequate permissions? Unrecoverable error.\n");
+        }
+        webber::logger.write_to_log(limhamn::logger::type::notice, "The temp directory was created.\n");
+    }
+
+    if (!check_if_exists(webber::settings.sqlite_database_file) && !webber::settings.enabled_database) {
+        std::filesystem::path database_file_path{webber::settings.sqlite_database_file};
+        std::filesystem::path database_file_directory{database_file_path.parent_path()};
+
+        webber::logger.write_to_log(limhamn::logger::type::notice, "The database file directory does not exist. Creating it.\n");
+        if (!create_directory(database_file_directory)) {
+            log_error("Failed to create the database file directory. Do I have adequate permissions? Unrecoverable error.\n");
+        }
+        webber::logger.write_to_log(limhamn::logger::type::notice, "The database file directory was created.\n");
+    }
+
+#ifndef WEBBER_DEBUG
+    // the instance being taken over may still be receiving uploads into the temp directory
+    if (!webber::upgrade) {
+        remove_all_in_directory(webber::settings.temp_directory);
+    }
+#endif
+
+    // some initial files
+    if (!check_if_exists(settings.data_directory + "/" + "index.html")) {
+        std::ofstream of(settings.data_directory + "/" + "index.html");
+        of << webber::index_page;
+        of.close();
+    }
+    if (!check_if_exists(settings.data_directory + "/" + "setup.html")) {
+        std::ofstream of(settings.data_directory + "/" + "setup.html");
+        of << webber::setup_page;
+        of.close();
+    }
+    if (!check_if_exists(settings.data_directory + "/" + "style.css")) {
+        std::ofstream of(settings.data_directory + "/" + "style.css");
+        of << webber::index_stylesheet;
+        of.close();
+    }
+    if (!check_if_exists(settings.data_directory + "/" + "script.js")) {
+        std::ofstream of(settings.data_directory + "/" + "script.js");
+        of << webber::index_javascript;
+        of.close();
+    }
+    if (!check_if_exists(settings.data_directory + "/" + "settings.json")) {
+        std::ofstream of(settings.data_directory + "/" + "settings.json");
+        of << webber::default_settings;
+        of.close();
+    }
+}
+
+void webber::clean_data() {
+    std::cout << "This will delete ALL data in the session, temp and data directories. This could very well be unrecoverable and may cause data loss and breakage. Are you sure you want to continue? More than likely, this is not the solution to your problems. (y/N) ";
+    std::string response;
+    std::getline(std::cin, response);
+
+    if (response != "y" && response != "Y") {
+        std::cout << "Aborting.\n";
+        std::exit(EXIT_SUCCESS);
+    }
+
+    const auto check_if_exists = [](const std::string& path) -> bool {
+        return std::filesystem::exists(path);
+    };
+    const auto remove_all_in_directory = [&check_if_exists](const std::string& path) -> void {
+        if (!check_if_exists(path)) {
+            return;
+        }
+
+        for (const auto& entry : std::filesystem::directory_iterator(path)) {
+#if WEBBER_DEBUG
+            webber::logger.write_to_log(limhamn::logger::type::notice, "Removing: " + entry.path().string() + "\n");
+#endif
+            std::filesystem::remove(entry.path());
+        }
+    };
+
+    remove_all_in_directory(webber::settings.temp_directory);
+    remove_all_in_directory(webber::settings.session_directory);
+    remove_all_in_directory(webber::settings.data_directory);
+}
+
+void webber::handle_signals() {
+    // block the signals in every thread spawned after this point, and handle them synchronously in a dedicated thread instead
+    sigset_t set{};
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGUSR2);
+    sigaddset(&set, SIGHUP);
+    sigaddset(&set, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &set, nullptr);
+
+    std::thread{[set]() {
+        int signal{};
+        while (sigwait(&set, &signal) == 0) {
+            // SIGUSR2 is sent by an instance started with --upgrade, the others by whoever wants us gone
+            if (signal == SIGHUP) {
+                logger.write_to_log(limhamn::logger::type::notice, "Received SIGHUP, reloading the configuration file.\n");
+                reload_settings();
+            } else if (signal == SIGUSR1) {
+                try {
+                    const std::string path = trace::dump_to_file(std::chrono::seconds(10));
+                    logger.write_to_log(limhamn::logger::type::notice, "Received SIGUSR1, wrote the last 10 seconds of traces to " + path + ".\n");
+                } catch (const std::exception& e) {
+                    logger.write_to_log(limhamn::logger::type::error, "Failed to write the trace dump: " + std::string{e.what()} + "\n");
+                }
+            } else if (signal == SIGINT || signal == SIGTERM || signal == SIGUSR2) {
+                logger.write_to_log(limhamn::logger::type::notice, "Received signal " + std::to_string(signal) + ", shutting down.\n");
+                drain(signal == SIGUSR2);
+            }
+        }
+    }}.detach();
+}
+
+void webber::print_help() {
+    std::cout << "webber [options]\n";
+    std::cout << "  -h, --help               Display help information\n";
+    std::cout << "  -v, --version            Display the version number\n";
+    std::cout << "  -u, --upgrade            Take over from the running instance once ready, letting it drain\n";
+    std::cout << "  -rp, --rerender-pages    Render every page again from its markdown and exit; history and visits are left alone\n";
+    std::cout << "  -ep, --export-pages      Export every public page to pages.export_directory and exit\n";
+}
@@ -0,0 +1,347 @@
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <vector>
+#include <webber.hpp>
+#include <session.hpp>
+#include <metrics.hpp>
+#include <scrypto.hpp>
+#include <openssl/rand.h>
+
+namespace {
+    constexpr char snapshot_magic[4] = {'W', 'B', 'S', '1'};
+
+    void write_integer(std::ofstream& file, const uint64_t value) {
+        file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void write_string(std::ofstream& file, const std::string& str) {
+        write_integer(file, str.size());
+        file.write(str.data(), static_cast<std::streamsize>(str.size()));
+    }
+
+    bool read_integer(std::ifstream& file, uint64_t& value) {
+        return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(value)));
+    }
+
+    bool read_string(std::ifstream& file, std::string& str) {
+        uint64_t size{};
+        if (!read_integer(file, size) || size > 1024 * 1024) {
+            return false;
+        }
+
+        str.resize(size);
+        return static_cast<bool>(file.read(str.data(), static_cast<std::streamsize>(size)));
+    }
+}
+
+webber::session_store::~session_store() {
+    this->stop();
+}
+
+void webber::session_store::start(const std::string& snapshot_file, const int64_t ttl, const int64_t snapshot_interval) {
+    this->stop();
+
+    this->snapshot_file = snapshot_file;
+    this->ttl = ttl;
+    this->snapshot_interval = snapshot_interval > 0 ? snapshot_interval : 60;
+
+    if (!this->load()) {
+        logger.write_to_log(limhamn::logger::type::warning, "Failed to restore sessions from " + snapshot_file + ", starting with no sessions.\n");
+    }
+
+    std::lock_guard lock{this->sweeper_mutex};
+    this->running = true;
+    this->sweeper = std::thread{[this]() {
+        std::unique_lock lock{this->sweeper_mutex};
+        while (this->running) {
+            this->sweeper_cv.wait_for(lock, std::chrono::seconds(this->snapshot_interval), [this]() { return !this->running; });
+            if (!this->running) {
+                break;
+            }
+
+            lock.unlock();
+            this->sweep();
+            if (!this->save()) {
+                logger.write_to_log(limhamn::logger::type::error, "Failed to write the session snapshot to " + this->snapshot_file + ".\n");
+            }
+            lock.lock();
+        }
+    }};
+}
+
+void webber::session_store::stop() {
+    {
+        std::lock_guard lock{this->sweeper_mutex};
+        if (!this->running) {
+            return;
+        }
+        this->running = false;
+    }
+
+    this->sweeper_cv.notify_all();
+    if (this->sweeper.joinable()) {
+        this->sweeper.join();
+    }
+
+    this->sweep();
+    if (!this->save()) {
+        logger.write_to_log(limhamn::logger::type::error, "Failed to write the session snapshot to " + this->snapshot_file + ".\n");
+    }
+}
+
+webber::session_store::shard& webber::session_store::get_shard(const std::string& id) {
+    return this->shards[std::hash<std::string>{}(id) % shard_count];
+}
+
+int64_t webber::session_store::get_expiry() const {
+    return scrypto::return_unix_timestamp() + this->ttl * 1000;
+}
+
+std::string webber::session_store::get_id(const limhamn::http::server::request& request) {
+    for (const auto& it : request.cookies) {
+        if (it.name == current_settings()->session_cookie_name) {
+            return it.value;
+        }
+    }
+
+    return "";
+}
+
+std::string webber::session_store::generate_id() {
+    static constexpr char hex[] = "0123456789abcdef";
+    std::array<unsigned char, 32> bytes{};
+
+    if (RAND_bytes(bytes.data(), static_cast<int>(bytes.size())) != 1) {
+        throw std::runtime_error{"Failed to generate a session id."};
+    }
+
+    std::string id{};
+    id.reserve(bytes.size() * 2);
+    for (const auto& it : bytes) {
+        id += hex[it >> 4];
+        id += hex[it & 0x0F];
+    }
+
+    return id;
+}
+
+webber::session_store::session webber::session_store::find(const std::string& id) {
+    if (id.empty()) {
+        return {};
+    }
+
+    auto& shard = this->get_shard(id);
+    std::lock_guard lock{shard.mutex};
+
+    const auto it = shard.entries.find(id);
+    if (it == shard.entries.end()) {
+        metrics::record_cache("sessions", false);
+        return {};
+    }
+
+    const int64_t now = scrypto::return_unix_timestamp();
+    if (it->second.expires_at < now) {
+        shard.entries.erase(it);
+        this->generation.fetch_add(1, std::memory_order_relaxed);
+        metrics::record_cache("sessions", false);
+        return {};
+    }
+
+    metrics::record_cache("sessions", true);
+
+    // sliding expiry; not counted as a change, the snapshot interval is far shorter than the ttl
+    it->second.expires_at = now + this->ttl * 1000;
+
+    return it->second.data;
+}
+
+void webber::session_store::put(const std::string& id, const session& data) {
+    if (id.empty()) {
+        return;
+    }
+
+    auto& shard = this->get_shard(id);
+    std::lock_guard lock{shard.mutex};
+
+    auto& entry = shard.entries[id];
+    for (const auto& [key, value] : data) {
+        entry.data[key] = value;
+    }
+    entry.expires_at = this->get_expiry();
+
+    this->generation.fetch_add(1, std::memory_order_relaxed);
+}
+
+void webber::session_store::erase(const std::string& id) {
+    auto& shard = this->get_shard(id);
+    std::lock_guard lock{shard.mutex};
+
+    if (shard.entries.erase(id) != 0) {
+        this->generation.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+std::size_t webber::session_store::size() const {
+    std::size_t size{0};
+    for (const auto& shard : this->shards) {
+        std::lock_guard lock{shard.mutex};
+        size += shard.entries.size();
+    }
+
+    return size;
+}
+
+webber::session_store::session webber::session_store::get(const limhamn::http::server::request& request) {
+    return this->find(get_id(request));
+}
+
+void webber::session_store::update(const limhamn::http::server::request& request, limhamn::http::server::response& response) {
+    if (response.session.empty()) {
+        return;
+    }
+
+    // a login gets a new id, so that an id planted in the client before it logged in (or one seen by someone else
+    // before) never becomes a logged in session
+    std::string id = get_id(request);
+    const bool login = response.session.contains("key");
+    if (id.empty() || login || this->find(id).empty()) {
+        if (!id.empty()) {
+            this->erase(id);
+        }
+        id = generate_id();
+
+        limhamn::http::server::cookie cookie{};
+        cookie.name = current_settings()->session_cookie_name;
+        cookie.value = id;
+        cookie.path = "/";
+        response.cookies.push_back(cookie);
+    }
+
+    this->put(id, response.session);
+}
+
+void webber::session_store::sweep() {
+    const int64_t now = scrypto::return_unix_timestamp();
+
+    for (auto& shard : this->shards) {
+        std::lock_guard lock{shard.mutex};
+        const auto erased = std::erase_if(shard.entries, [&now](const auto& it) {
+            return it.second.expires_at < now;
+        });
+
+        if (erased != 0) {
+            this->generation.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+bool webber::session_store::save() {
+    if (this->snapshot_file.empty()) {
+        return true;
+    }
+
+    std::lock_guard snapshot_lock{this->snapshot_mutex};
+
+    const uint64_t generation = this->generation.load(std::memory_order_relaxed);
+    if (generation == this->saved_generation && std::filesystem::exists(this->snapshot_file)) {
+        return true;
+    }
+
+    // copy one shard at a time so that requests are only blocked for as long as it takes to copy a shard
+    std::vector<std::pair<std::string, entry>> entries{};
+    for (const auto& shard : this->shards) {
+        std::lock_guard lock{shard.mutex};
+        for (const auto& it : shard.entries) {
+            entries.emplace_back(it.first, it.second);
+        }
+    }
+
+    const std::string temp_file = this->snapshot_file + ".tmp";
+    {
+        std::ofstream file{temp_file, std::ios::binary | std::ios::trunc};
+        if (!file.is_open()) {
+            return false;
+        }
+
+        // the ids in it are as good as the users' credentials; restricted while it is still empty
+        std::error_code ec{};
+        std::filesystem::permissions(temp_file, std::filesystem::perms::owner_read | std::filesystem::perms::owner_write, std::filesystem::perm_options::replace, ec);
+        if (ec) {
+            return false;
+        }
+
+        file.write(snapshot_magic, sizeof(snapshot_magic));
+        write_integer(file, entries.size());
+        for (const auto& [id, entry] : entries) {
+            write_string(file, id);
+            write_integer(file, static_cast<uint64_t>(entry.expires_at));
+            write_integer(file, entry.data.size());
+            for (const auto& [key, value] : entry.data) {
+                write_string(file, key);
+                write_string(file, value);
+            }
+        }
+
+        file.flush();
+        if (!file.good()) {
+            return false;
+        }
+    }
+
+    std::error_code ec{};
+    std::filesystem::rename(temp_file, this->snapshot_file, ec);
+    if (ec) {
+        return false;
+    }
+
+    this->saved_generation = generation;
+    return true;
+}
+
+bool webber::session_store::load() {
+    if (this->snapshot_file.empty() || !std::filesystem::is_regular_file(this->snapshot_file)) {
+        return true;
+    }
+
+    std::ifstream file{this->snapshot_file, std::ios::binary};
+    char magic[sizeof(snapshot_magic)]{};
+    if (!file.read(magic, sizeof(magic)) || !std::equal(std::begin(magic), std::end(magic), std::begin(snapshot_magic))) {
+        return false;
+    }
+
+    uint64_t count{};
+    if (!read_integer(file, count)) {
+        return false;
+    }
+
+    const int64_t now = scrypto::return_unix_timestamp();
+    for (uint64_t i{0}; i < count; ++i) {
+        std::string id{};
+        uint64_t expires_at{};
+        uint64_t size{};
+        if (!read_string(file, id) || !read_integer(file, expires_at) || !read_integer(file, size)) {
+            return false;
+        }
+
+        entry e{.expires_at = static_cast<int64_t>(expires_at)};
+        for (uint64_t j{0}; j < size; ++j) {
+            std::string key{};
+            std::string value{};
+            if (!read_string(file, key) || !read_string(file, value)) {
+                return false;
+            }
+            e.data[key] = value;
+        }
+
+        if (e.expires_at < now) {
+            continue;
+        }
+
+        auto& shard = this->get_shard(id);
+        std::lock_guard lock{shard.mutex};
+        shard.entries[id] = std::move(e);
+    }
+
+    return true;
+}
@@ -0,0 +1,128 @@
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <webber.hpp>
+
+namespace {
+    std::atomic<std::shared_ptr<const webber::Settings>> published{};
+}
+
+std::shared_ptr<const webber::Settings> webber::current_settings() {
+    if (auto s = published.load(std::memory_order_acquire)) {
+        return s;
+    }
+
+    // not published yet; the startup copy lives as long as the process
+    return {std::shared_ptr<const Settings>{}, &settings};
+}
+
+void webber::publish_settings(Settings s) {
+    s.custom_path_table.clear();
+    for (const auto& [virtual_path, path] : s.custom_paths) {
+        s.custom_path_table.try_emplace(virtual_path, path);
+    }
+
+    auto blacklist = std::make_shared<ip_set>();
+    for (const auto& it : s.blacklisted_ips) {
+        blacklist->insert(it);
+    }
+    if (!s.blocklist_file.empty()) {
+        std::ifstream file{s.blocklist_file};
+        if (!file.is_open()) {
+            logger.write_to_log(limhamn::logger::type::warning, "Failed to open the blocklist " + s.blocklist_file + ", ignoring it.\n");
+        }
+
+        std::size_t invalid{0};
+        std::string line{};
+        while (std::getline(file, line)) {
+            line = line.substr(0, line.find('#'));
+            line.erase(0, line.find_first_not_of(" \t\r"));
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if (line.empty()) {
+                continue;
+            }
+
+            try {
+                blacklist->insert(line);
+            } catch (const std::exception&) {
+                ++invalid;
+            }
+        }
+
+        if (invalid != 0) {
+            logger.write_to_log(limhamn::logger::type::warning, "Skipped " + std::to_string(invalid) + " invalid entries in the blocklist " + s.blocklist_file + ".\n");
+        }
+    }
+    s.blacklist = std::move(blacklist);
+
+    auto whitelist = std::make_shared<ip_set>();
+    for (const auto& it : s.whitelisted_ips) {
+        whitelist->insert(it);
+    }
+    s.whitelist = std::move(whitelist);
+
+    published.store(std::make_shared<const Settings>(std::move(s)), std::memory_order_release);
+}
+
+bool webber::reload_settings() {
+    if (config_path.empty() || !std::filesystem::exists(config_path)) {
+        logger.write_to_log(limhamn::logger::type::error, "Cannot reload the configuration file, it does not exist.\n");
+        return false;
+    }
+
+    Settings loaded{};
+    try {
+        loaded = parse_settings(config_path);
+        validate_settings(loaded);
+    } catch (const std::exception& e) {
+        logger.write_to_log(limhamn::logger::type::error, "Failed to reload the configuration file, keeping the current settings: " + std::string{e.what()} + "\n");
+        return false;
+    }
+
+    // everything else (ports, directories, database, workers, log files) is only read at startup
+    Settings s = *current_settings();
+    s.halt_on_error = loaded.halt_on_error;
+    s.username_min_length = loaded.username_min_length;
+    s.username_max_length = loaded.username_max_length;
+    s.password_min_length = loaded.password_min_length;
+    s.password_max_length = loaded.password_max_length;
+    s.allowed_characters = loaded.allowed_characters;
+    s.allow_all_characters = loaded.allow_all_characters;
+    s.preview_files = loaded.preview_files;
+    s.site_url = loaded.site_url;
+    s.max_file_size_hash = loaded.max_file_size_hash;
+    s.background_render_size = loaded.background_render_size;
+    s.export_directory = loaded.export_directory;
+    s.serve_exports = loaded.serve_exports;
+    s.custom_paths = loaded.custom_paths;
+    s.blacklisted_ips = loaded.blacklisted_ips;
+    s.whitelisted_ips = loaded.whitelisted_ips;
+    s.blocklist_file = loaded.blocklist_file;
+    s.rate_limit = loaded.rate_limit;
+    s.user_rate_limit = loaded.user_rate_limit;
+    s.route_costs = loaded.route_costs;
+    s.download_bytes_per_token = loaded.download_bytes_per_token;
+    s.slow_query_threshold = loaded.slow_query_threshold;
+    s.query_trace_sample_rate = loaded.query_trace_sample_rate;
+    s.trace_sample_rate = loaded.trace_sample_rate;
+
+    s.log_max_size = loaded.log_max_size;
+    s.log_max_age = loaded.log_max_age;
+    s.log_keep = loaded.log_keep;
+    s.log_compress = loaded.log_compress;
+    s.log_stream_max_subscribers = loaded.log_stream_max_subscribers;
+    s.log_stream_timeout = loaded.log_stream_timeout;
+    logger.set_rotation({
+        .max_size = s.log_max_size,
+        .max_age = s.log_max_age,
+        .keep = s.log_keep,
+        .compress = s.log_compress,
+    });
+
+    publish_settings(std::move(s));
+    reset_client_settings(); // settings.json may have been edited by hand
+    logger.write_to_log(limhamn::logger::type::notice, "Reloaded the configuration file " + config_path + ".\n");
+
+    return true;
+}
@@ -0,0 +1,205 @@
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <vector>
+#include <unistd.h>
+#include <webber.hpp>
+#include <trace.hpp>
+#include <scrypto.hpp>
+#include <nlohmann/json.hpp>
+
+namespace {
+    // every field is atomic so that dump() can read a slot while its owner overwrites it; the sequence
+    // number tells it whether what it read is whole (even and unchanged) or torn (odd or changed)
+    struct event {
+        std::atomic<uint64_t> sequence{0};
+        std::atomic<const char*> name{nullptr};
+        std::atomic<const char*> detail{nullptr};
+        std::atomic<std::size_t> detail_size{0};
+        std::atomic<int64_t> start{0};
+        std::atomic<int64_t> duration{0};
+        std::atomic<uint64_t> request{0};
+    };
+
+    struct ring {
+        std::unique_ptr<event[]> events{};
+        std::size_t size{0};
+        std::atomic<uint64_t> head{0};
+        uint64_t thread_id{0};
+    };
+
+    std::atomic<std::size_t> buffer_size{16384};
+    std::atomic<uint64_t> next_request{1};
+
+    struct registry {
+        std::mutex mutex{};
+        std::vector<std::unique_ptr<ring>> rings{};
+        std::vector<ring*> free_rings{};
+    };
+
+    registry& get_registry() {
+        static registry r{};
+        return r;
+    }
+
+    // rings outlive their threads and are handed to the next thread, like the metrics shards
+    struct ring_handle {
+        ring* r{nullptr};
+
+        ring_handle() {
+            registry& reg = get_registry();
+            std::lock_guard lock{reg.mutex};
+            if (!reg.free_rings.empty()) {
+                this->r = reg.free_rings.back();
+                reg.free_rings.pop_back();
+                return;
+            }
+
+            auto new_ring = std::make_unique<ring>();
+            new_ring->size = std::max<std::size_t>(16, buffer_size.load(std::memory_order_relaxed));
+            new_ring->events = std::make_unique<event[]>(new_ring->size);
+            new_ring->thread_id = reg.rings.size() + 1;
+            reg.rings.push_back(std::move(new_ring));
+            this->r = reg.rings.back().get();
+        }
+
+        ~ring_handle() {
+            registry& reg = get_registry();
+            std::lock_guard lock{reg.mutex};
+            reg.free_rings.push_back(this->r);
+        }
+    };
+
+    ring& local_ring() {
+        thread_local ring_handle handle{};
+        return *handle.r;
+    }
+
+    thread_local uint64_t current_request{0};
+
+    int64_t to_nanoseconds(const webber::trace::clock::time_point tp) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(tp.time_since_epoch()).count();
+    }
+}
+
+void webber::trace::set_buffer_size(const std::size_t events) {
+    buffer_size.store(events, std::memory_order_relaxed);
+}
+
+void webber::trace::begin_request(const double sample_rate) {
+    current_request = 0;
+    if (sample_rate <= 0.0) {
+        return;
+    }
+
+    thread_local std::minstd_rand rng{std::random_device{}()};
+    if (sample_rate >= 1.0 || std::uniform_real_distribution<double>{0.0, 1.0}(rng) < sample_rate) {
+        current_request = next_request.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void webber::trace::end_request() {
+    current_request = 0;
+}
+
+bool webber::trace::active() {
+    return current_request != 0;
+}
+
+void webber::trace::record(const char* name, const clock::time_point start, const clock::time_point end, const std::string_view detail) {
+    if (current_request == 0) {
+        return;
+    }
+
+    ring& r = local_ring();
+    const uint64_t i = r.head.load(std::memory_order_relaxed);
+    event& e = r.events[i % r.size];
+
+    e.sequence.store(2 * i + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    e.name.store(name, std::memory_order_relaxed);
+    e.detail.store(detail.data(), std::memory_order_relaxed);
+    e.detail_size.store(detail.size(), std::memory_order_relaxed);
+    e.start.store(to_nanoseconds(start), std::memory_order_relaxed);
+    e.duration.store(to_nanoseconds(end) - to_nanoseconds(start), std::memory_order_relaxed);
+    e.request.store(current_request, std::memory_order_relaxed);
+    e.sequence.store(2 * i + 2, std::memory_order_release);
+
+    r.head.store(i + 1, std::memory_order_release);
+}
+
+std::string webber::trace::dump(const std::chrono::milliseconds window) {
+    std::vector<ring*> rings{};
+    {
+        registry& reg = get_registry();
+        std::lock_guard lock{reg.mutex};
+        for (const auto& it : reg.rings) {
+            rings.push_back(it.get());
+        }
+    }
+
+    const int64_t since = to_nanoseconds(clock::now()) - std::chrono::duration_cast<std::chrono::nanoseconds>(window).count();
+    const int pid = getpid();
+
+    nlohmann::json events = nlohmann::json::array();
+    for (const auto& r : rings) {
+        const uint64_t head = r->head.load(std::memory_order_acquire);
+        const uint64_t first = head > r->size ? head - r->size : 0;
+
+        for (uint64_t i{first}; i < head; ++i) {
+            const event& e = r->events[i % r->size];
+
+            const uint64_t before = e.sequence.load(std::memory_order_acquire);
+            if (before != 2 * i + 2) {
+                continue;
+            }
+
+            const char* name = e.name.load(std::memory_order_relaxed);
+            const char* detail = e.detail.load(std::memory_order_relaxed);
+            const std::size_t detail_size = e.detail_size.load(std::memory_order_relaxed);
+            const int64_t start = e.start.load(std::memory_order_relaxed);
+            const int64_t duration = e.duration.load(std::memory_order_relaxed);
+            const uint64_t request = e.request.load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (e.sequence.load(std::memory_order_relaxed) != before || name == nullptr || start < since) {
+                continue;
+            }
+
+            nlohmann::json event;
+            event["name"] = name;
+            event["cat"] = "webber";
+            event["ph"] = "X";
+            event["ts"] = static_cast<double>(start) / 1000.0;
+            event["dur"] = static_cast<double>(duration) / 1000.0;
+            event["pid"] = pid;
+            event["tid"] = r->thread_id;
+            event["args"]["request"] = request;
+            if (detail != nullptr && detail_size != 0) {
+                event["args"]["detail"] = std::string{detail, detail_size};
+            }
+
+            events.push_back(std::move(event));
+        }
+    }
+
+    nlohmann::json json;
+    json["traceEvents"] = std::move(events);
+    json["displayTimeUnit"] = "ms";
+
+    return json.dump();
+}
+
+std::string webber::trace::dump_to_file(const std::chrono::milliseconds window) {
+    const std::string path = current_settings()->temp_directory + "/trace-" + std::to_string(scrypto::return_unix_timestamp()) + ".json";
+
+    std::ofstream file{path, std::ios::trunc};
+    if (!file.is_open()) {
+        throw std::runtime_error{"Failed to open " + path + " for writing."};
+    }
+    file << dump(window);
+
+    return path;
+}
@@ -13,7 +13,7 @@ webber::UploadStatus webber::upload_file(const limhamn::http::server::request& r
     logger.write_to_log(limhamn::logger::type::notice, "Attempting to upload a file.\n");
 #endif
 
-    const auto file_handles = limhamn::http::utils::parse_multipart_form_file(req.raw_body, settings.temp_directory + "/%f-%h-%r");
+    const auto file_handles = limhamn::http::utils::parse_multipart_form_file(req.raw_body, current_settings()->temp_directory + "/%f-%h-%r");
     for (const auto& it : file_handles) {
 #ifdef WEBBER_DEBUG
         logger.write_to_log(limhamn::logger::type::notice, "File name: " + it.filename + ", Name: " + it.name + "\n");
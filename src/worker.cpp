@@ -0,0 +1,124 @@
+#include <webber.hpp>
+#include <worker.hpp>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+webber::worker_pool::~worker_pool() {
+    this->stop();
+}
+
+void webber::worker_pool::start(std::size_t count, const bool pin) {
+    this->stop();
+
+    if (count == 0) {
+        count = std::max(1U, std::thread::hardware_concurrency());
+    }
+
+    for (std::size_t i{0}; i < count; ++i) {
+        this->workers.push_back(std::make_unique<worker>());
+    }
+
+    // the database connections are opened by the workers themselves, wait for all of them before accepting requests
+    std::vector<std::future<void>> ready{};
+    for (std::size_t i{0}; i < count; ++i) {
+        auto promise = std::make_shared<std::promise<void>>();
+        ready.push_back(promise->get_future());
+
+        worker& w = *this->workers.at(i);
+        w.thread = std::thread{[&w, i, pin, promise]() {
+            std::shared_ptr<database> db{};
+            try {
+                db = open_database();
+            } catch (const std::exception&) {
+                promise->set_exception(std::current_exception());
+                return;
+            }
+
+            promise->set_value();
+
+#ifdef __linux__
+            if (pin) {
+                cpu_set_t set{};
+                CPU_ZERO(&set);
+                CPU_SET(i % std::max(1U, std::thread::hardware_concurrency()), &set);
+                pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            }
+#endif
+
+            while (true) {
+                std::function<void(database&)> task{};
+                {
+                    std::unique_lock lock{w.mutex};
+                    w.cv.wait(lock, [&w]() { return !w.running || !w.queue.empty() || !w.urgent.empty(); });
+                    auto& queue = !w.urgent.empty() ? w.urgent : w.queue;
+                    if (queue.empty()) {
+                        return;
+                    }
+
+                    task = std::move(queue.front());
+                    queue.pop_front();
+                }
+
+                task(*db);
+                w.depth.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }};
+    }
+
+    for (auto& it : ready) {
+        it.get();
+    }
+
+    logger.write_to_log(limhamn::logger::type::notice, "Started " + std::to_string(count) + " request workers.\n");
+}
+
+void webber::worker_pool::stop() {
+    for (auto& it : this->workers) {
+        {
+            std::lock_guard lock{it->mutex};
+            it->running = false;
+        }
+        it->cv.notify_all();
+    }
+    for (auto& it : this->workers) {
+        if (it->thread.joinable()) {
+            it->thread.join();
+        }
+    }
+
+    this->workers.clear();
+}
+
+std::size_t webber::worker_pool::size() const {
+    return this->workers.size();
+}
+
+webber::worker_pool::worker& webber::worker_pool::pick() {
+    const std::size_t count = this->workers.size();
+    if (count == 1) {
+        return *this->workers.front();
+    }
+
+    // power of two choices: two different workers, take the one with the shorter queue
+    const std::size_t n = this->next.fetch_add(1, std::memory_order_relaxed);
+    worker& a = *this->workers.at(n % count);
+    worker& b = *this->workers.at((n + 1 + (n / count) % (count - 1)) % count);
+
+    return a.depth.load(std::memory_order_relaxed) <= b.depth.load(std::memory_order_relaxed) ? a : b;
+}
+
+void webber::worker_pool::push(std::function<void(database&)> task, const bool urgent) {
+    if (this->workers.empty()) {
+        throw std::runtime_error{"No workers are running."};
+    }
+
+    worker& w = this->pick();
+    w.depth.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard lock{w.mutex};
+        (urgent ? w.urgent : w.queue).push_back(std::move(task));
+    }
+    w.cv.notify_one();
+}
@@ -0,0 +1,710 @@
+/* webber_load - load generator and access log replay for a local webber instance
+ *
+ * scenario mode sends a weighted mix of the request templates in http/ at a target rate, replay mode
+ * re-sends the endpoints of a captured access log with their original spacing. latency is measured from
+ * the time a request was scheduled to be sent, not from when a connection got around to sending it,
+ * so a server that falls behind shows up in the percentiles instead of silently lowering the rate.
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <limhamn/argument_manager/argument_manager.hpp>
+
+namespace webber::load {
+    using clock = std::chrono::steady_clock;
+
+    struct options {
+        std::string host{"127.0.0.1"};
+        std::string port{"8080"};
+        std::string template_directory{"./http"};
+        std::string mix{"get_page=70,user_exists=20,create_page=5,upload_file=5"};
+        std::string replay_file{};
+        std::string username{};
+        std::string key{};
+        double rps{100.0}; // 0 = as fast as the connections allow
+        double speed{1.0}; // replay only
+        std::size_t concurrency{16};
+        std::size_t seed_pages{0};
+        int64_t duration{10}; // seconds, scenario mode only
+        int64_t timeout{30}; // seconds
+    };
+
+    struct request_template {
+        std::string name{};
+        std::string method{};
+        std::string target{};
+        std::vector<std::pair<std::string, std::string>> headers{};
+        std::string body{};
+        double weight{0.0};
+    };
+
+    struct job {
+        std::size_t scenario{};
+        std::string method{};
+        std::string target{};
+        std::vector<std::pair<std::string, std::string>> headers{};
+        std::string body{};
+        clock::time_point intended{};
+        bool idempotent{true}; // whether it may be sent again if the connection fails
+    };
+
+    struct sample {
+        std::size_t scenario{};
+        int status{0}; // 0 = connection error or timeout
+        uint64_t latency_us{0};
+    };
+
+    uint64_t mix_hash(uint64_t x) {
+        // splitmix64, so that the scenario picked for a slot doesn't depend on which thread sent it
+        x += 0x9E3779B97F4A7C15ULL;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+
+    std::string replace_json_string(const std::string& body, const std::string& key, const std::string& value) {
+        const std::regex expression{"(\"" + key + "\"\\s*:\\s*\")[^\"]*(\")"};
+        return std::regex_replace(body, expression, "$1" + value + "$2", std::regex_constants::format_first_only);
+    }
+
+    request_template parse_template(const std::filesystem::path& path) {
+        std::ifstream file{path};
+        if (!file.is_open()) {
+            throw std::runtime_error{"Failed to open the request template " + path.string() + "."};
+        }
+
+        request_template t{};
+        t.name = path.stem().string();
+
+        std::string line{};
+        if (!std::getline(file, line)) {
+            throw std::runtime_error{"The request template " + path.string() + " is empty."};
+        }
+
+        std::istringstream request_line{line};
+        request_line >> t.method >> t.target;
+        if (t.method.empty() || t.target.empty()) {
+            throw std::runtime_error{"The request template " + path.string() + " has no request line."};
+        }
+
+        bool multipart{false};
+        while (std::getline(file, line) && !line.empty() && line != "\r") {
+            const auto colon = line.find(':');
+            if (colon == std::string::npos) {
+                continue;
+            }
+
+            std::string name = line.substr(0, colon);
+            std::string value = line.substr(colon + 1);
+            value.erase(0, value.find_first_not_of(' '));
+            if (!value.empty() && value.back() == '\r') {
+                value.pop_back();
+            }
+
+            // set per connection
+            if (name == "Host") {
+                continue;
+            }
+            if (name == "Content-Type" && value.starts_with("multipart/")) {
+                multipart = true;
+            }
+
+            t.headers.emplace_back(name, value);
+        }
+
+        std::string body{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+        while (!body.empty() && (body.back() == '\n' || body.back() == '\r')) {
+            body.pop_back();
+        }
+
+        // the templates are saved with plain newlines, multipart bodies need crlf
+        if (multipart) {
+            for (const auto& c : body) {
+                if (c == '\n') {
+                    t.body += "\r\n";
+                } else if (c != '\r') {
+                    t.body += c;
+                }
+            }
+            t.body += "\r\n";
+        } else {
+            t.body = body;
+        }
+
+        return t;
+    }
+
+    std::vector<request_template> load_templates(const options& opt) {
+        std::vector<request_template> ret{};
+
+        std::stringstream ss{opt.mix};
+        std::string entry{};
+        while (std::getline(ss, entry, ',')) {
+            const auto eq = entry.find('=');
+            const std::string name = entry.substr(0, eq);
+            const double weight = eq == std::string::npos ? 1.0 : std::stod(entry.substr(eq + 1));
+            if (weight <= 0.0) {
+                continue;
+            }
+
+            request_template t = parse_template(std::filesystem::path{opt.template_directory} / (name + ".http"));
+            t.weight = weight;
+            if (!opt.username.empty()) {
+                t.body = replace_json_string(t.body, "username", opt.username);
+            }
+            if (!opt.key.empty()) {
+                t.body = replace_json_string(t.body, "key", opt.key);
+            }
+
+            ret.push_back(std::move(t));
+        }
+
+        if (ret.empty()) {
+            throw std::runtime_error{"The scenario mix is empty."};
+        }
+
+        return ret;
+    }
+
+    // access log lines look like "<timestamp> ... Request received from <ip> to <endpoint> received, handling it."
+    std::vector<std::pair<int64_t, std::string>> load_replay(const std::string& path) {
+        std::ifstream file{path};
+        if (!file.is_open()) {
+            throw std::runtime_error{"Failed to open the access log " + path + "."};
+        }
+
+        static const std::regex date{R"((\d{4})-(\d{2})-(\d{2})[ T](\d{2}):(\d{2}):(\d{2})(?:\.(\d{1,3}))?)"};
+        static const std::regex unix_time{R"((\d{10,13}))"};
+        static const std::regex endpoint{R"( to (\S+) received)"};
+
+        std::vector<std::pair<int64_t, std::string>> ret{};
+        std::string line{};
+        while (std::getline(file, line)) {
+            std::smatch match{};
+            if (!std::regex_search(line, match, endpoint)) {
+                continue;
+            }
+            const std::string target = match[1].str();
+
+            int64_t millis{};
+            if (std::regex_search(line, match, date)) {
+                std::tm tm{};
+                tm.tm_year = std::stoi(match[1].str()) - 1900;
+                tm.tm_mon = std::stoi(match[2].str()) - 1;
+                tm.tm_mday = std::stoi(match[3].str());
+                tm.tm_hour = std::stoi(match[4].str());
+                tm.tm_min = std::stoi(match[5].str());
+                tm.tm_sec = std::stoi(match[6].str());
+                millis = static_cast<int64_t>(timegm(&tm)) * 1000;
+                if (match[7].matched) {
+                    std::string fraction = match[7].str();
+                    fraction.resize(3, '0');
+                    millis += std::stoi(fraction);
+                }
+            } else if (std::regex_search(line, match, unix_time)) {
+                millis = std::stoll(match[1].str());
+                if (match[1].length() == 10) {
+                    millis *= 1000;
+                }
+            } else {
+                continue;
+            }
+
+            ret.emplace_back(millis, target);
+        }
+
+        std::ranges::stable_sort(ret, [](const auto& a, const auto& b) { return a.first < b.first; });
+        return ret;
+    }
+
+    class connection {
+    public:
+        connection(const options& opt) : opt(opt) {}
+        ~connection() { this->close(); }
+        connection(const connection&) = delete;
+        connection& operator=(const connection&) = delete;
+
+        // returns the status code, or 0 if the request could not be completed
+        int round_trip(const job& j) {
+            std::string raw{};
+            raw += j.method + " " + j.target + " HTTP/1.1\r\n";
+            raw += "Host: " + this->opt.host + ":" + this->opt.port + "\r\n";
+            for (const auto& [name, value] : j.headers) {
+                raw += name + ": " + value + "\r\n";
+            }
+            raw += "Content-Length: " + std::to_string(j.body.size()) + "\r\n";
+            raw += "Connection: keep-alive\r\n\r\n";
+            raw += j.body;
+
+            // a kept-alive connection may have been closed by the server in the meantime, retry once on a fresh one;
+            // a request that creates something may have been handled before the connection failed, so it isn't sent twice
+            for (int attempt{0}; attempt < 2; ++attempt) {
+                const bool reused = this->fd != -1;
+                if (!reused && !this->open()) {
+                    return 0;
+                }
+
+                if (!this->send_all(raw)) {
+                    this->close();
+                    if (reused && j.idempotent) {
+                        continue;
+                    }
+                    return 0;
+                }
+
+                const int status = this->read_response();
+                if (status == 0) {
+                    this->close();
+                    if (reused && j.idempotent) {
+                        continue;
+                    }
+                }
+
+                return status;
+            }
+
+            return 0;
+        }
+    private:
+        const options& opt;
+        int fd{-1};
+        std::string buffer{};
+
+        bool open() {
+            addrinfo hints{};
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+
+            addrinfo* result{nullptr};
+            if (getaddrinfo(this->opt.host.c_str(), this->opt.port.c_str(), &hints, &result) != 0) {
+                return false;
+            }
+
+            for (addrinfo* it = result; it != nullptr; it = it->ai_next) {
+                this->fd = socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+                if (this->fd == -1) {
+                    continue;
+                }
+                if (connect(this->fd, it->ai_addr, it->ai_addrlen) == 0) {
+                    break;
+                }
+                ::close(this->fd);
+                this->fd = -1;
+            }
+            freeaddrinfo(result);
+
+            if (this->fd == -1) {
+                return false;
+            }
+
+            const int one{1};
+            setsockopt(this->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            timeval tv{};
+            tv.tv_sec = this->opt.timeout;
+            setsockopt(this->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            setsockopt(this->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+            this->buffer.clear();
+            return true;
+        }
+
+        void close() {
+            if (this->fd != -1) {
+                ::close(this->fd);
+                this->fd = -1;
+            }
+            this->buffer.clear();
+        }
+
+        bool send_all(const std::string& data) const {
+            std::size_t sent{0};
+            while (sent < data.size()) {
+                const ssize_t n = ::send(this->fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+                if (n <= 0) {
+                    return false;
+                }
+                sent += static_cast<std::size_t>(n);
+            }
+
+            return true;
+        }
+
+        bool fill() {
+            char chunk[16384];
+            const ssize_t n = ::recv(this->fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) {
+                return false;
+            }
+
+            this->buffer.append(chunk, static_cast<std::size_t>(n));
+            return true;
+        }
+
+        int read_response() {
+            std::size_t header_end{};
+            while ((header_end = this->buffer.find("\r\n\r\n")) == std::string::npos) {
+                if (!this->fill()) {
+                    return 0;
+                }
+            }
+
+            const std::string head = this->buffer.substr(0, header_end);
+            this->buffer.erase(0, header_end + 4);
+
+            int status{0};
+            if (head.size() < 12 || std::sscanf(head.c_str(), "HTTP/%*d.%*d %d", &status) != 1) {
+                this->close();
+                return 0;
+            }
+
+            std::string lower{head};
+            std::ranges::transform(lower, lower.begin(), [](const unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+            const bool close_after = lower.find("\r\nconnection: close") != std::string::npos;
+            const bool chunked = lower.find("\r\ntransfer-encoding: chunked") != std::string::npos;
+
+            if (const auto pos = lower.find("\r\ncontent-length:"); pos != std::string::npos) {
+                const std::size_t length = std::stoull(lower.substr(pos + 17));
+                while (this->buffer.size() < length) {
+                    if (!this->fill()) {
+                        this->close();
+                        return 0;
+                    }
+                }
+                this->buffer.erase(0, length);
+            } else if (chunked) {
+                while (true) {
+                    std::size_t line_end{};
+                    while ((line_end = this->buffer.find("\r\n")) == std::string::npos) {
+                        if (!this->fill()) {
+                            this->close();
+                            return 0;
+                        }
+                    }
+
+                    const std::size_t size = std::stoull(this->buffer.substr(0, line_end), nullptr, 16);
+                    while (this->buffer.size() < line_end + 2 + size + 2) {
+                        if (!this->fill()) {
+                            this->close();
+                            return 0;
+                        }
+                    }
+                    this->buffer.erase(0, line_end + 2 + size + 2);
+
+                    if (size == 0) {
+                        break;
+                    }
+                }
+            } else {
+                while (this->fill()) {}
+                this->close();
+                return status;
+            }
+
+            if (close_after) {
+                this->close();
+            }
+
+            return status;
+        }
+    };
+
+    double percentile(const std::vector<uint64_t>& sorted, const double p) {
+        if (sorted.empty()) {
+            return 0.0;
+        }
+
+        const auto index = static_cast<std::size_t>(std::ceil(p * static_cast<double>(sorted.size()))) - 1;
+        return static_cast<double>(sorted.at(std::min(index, sorted.size() - 1))) / 1000.0;
+    }
+
+    void report(const std::vector<std::string>& names, const std::vector<sample>& samples, const double elapsed, const double target_rps) {
+        std::map<std::size_t, std::vector<const sample*>> by_scenario{};
+        for (const auto& it : samples) {
+            by_scenario[it.scenario].push_back(&it);
+        }
+
+        const auto print_row = [](const std::string& name, const std::vector<const sample*>& rows) {
+            std::vector<uint64_t> latencies{};
+            std::size_t status[6]{};
+            for (const auto& it : rows) {
+                latencies.push_back(it->latency_us);
+                ++status[std::clamp(it->status / 100, 0, 5)];
+            }
+            std::ranges::sort(latencies);
+
+            const std::size_t errors = status[0] + status[5];
+            std::cout << std::left << std::setw(16) << name << std::right
+                << std::setw(10) << rows.size()
+                << std::setw(9) << status[2] << std::setw(7) << status[3] << std::setw(7) << status[4] << std::setw(7) << status[5] << std::setw(8) << status[0]
+                << std::setw(9) << std::fixed << std::setprecision(2) << (rows.empty() ? 0.0 : 100.0 * static_cast<double>(errors) / static_cast<double>(rows.size())) << "%"
+                << std::setw(10) << std::setprecision(2) << percentile(latencies, 0.50)
+                << std::setw(10) << percentile(latencies, 0.99)
+                << std::setw(10) << percentile(latencies, 0.999)
+                << std::setw(10) << (latencies.empty() ? 0.0 : static_cast<double>(latencies.back()) / 1000.0) << "\n";
+        };
+
+        std::cout << std::left << std::setw(16) << "scenario" << std::right
+            << std::setw(10) << "requests" << std::setw(9) << "2xx" << std::setw(7) << "3xx" << std::setw(7) << "4xx" << std::setw(7) << "5xx" << std::setw(8) << "failed"
+            << std::setw(10) << "errors" << std::setw(10) << "p50 ms" << std::setw(10) << "p99 ms" << std::setw(10) << "p999 ms" << std::setw(10) << "max ms" << "\n";
+
+        std::vector<const sample*> all{};
+        for (const auto& [scenario, rows] : by_scenario) {
+            print_row(names.at(scenario), rows);
+            all.insert(all.end(), rows.begin(), rows.end());
+        }
+        print_row("total", all);
+
+        std::cout << "\nthroughput: " << std::fixed << std::setprecision(1) << static_cast<double>(samples.size()) / elapsed << " req/s over "
+            << elapsed << " s";
+        if (target_rps > 0.0) {
+            std::cout << " (target " << target_rps << " req/s)";
+        }
+        std::cout << "\nerrors are 5xx responses and failed requests (connection errors and timeouts)\n";
+    }
+
+    void seed_pages(const options& opt, const std::vector<request_template>& templates) {
+        const auto it = std::ranges::find_if(templates, [](const auto& t) { return t.name == "create_page"; });
+        request_template t = it != templates.end() ? *it : parse_template(std::filesystem::path{opt.template_directory} / "create_page.http");
+        if (!opt.username.empty()) {
+            t.body = replace_json_string(t.body, "username", opt.username);
+        }
+        if (!opt.key.empty()) {
+            t.body = replace_json_string(t.body, "key", opt.key);
+        }
+
+        connection c{opt};
+        std::size_t failed{0};
+        for (std::size_t i{0}; i < opt.seed_pages; ++i) {
+            const job j{
+                .scenario = 0,
+                .method = t.method,
+                .target = t.target,
+                .headers = t.headers,
+                .body = replace_json_string(t.body, "page", "/load/" + std::to_string(i)),
+                .intended = clock::now(),
+                .idempotent = false,
+            };
+
+            const int status = c.round_trip(j);
+            if (status < 200 || status >= 300) {
+                ++failed;
+            }
+        }
+
+        std::cout << "seeded " << opt.seed_pages - failed << " of " << opt.seed_pages << " pages under /load/\n";
+    }
+
+    int run(const options& opt) {
+        std::vector<std::string> names{};
+        std::vector<request_template> templates{};
+        std::vector<std::pair<int64_t, std::string>> replay{};
+        double total_weight{0.0};
+
+        if (opt.replay_file.empty()) {
+            templates = load_templates(opt);
+            for (const auto& t : templates) {
+                names.push_back(t.name);
+                total_weight += t.weight;
+            }
+            if (opt.seed_pages != 0) {
+                seed_pages(opt, templates);
+            }
+        } else {
+            replay = load_replay(opt.replay_file);
+            if (replay.empty()) {
+                throw std::runtime_error{"No requests were found in " + opt.replay_file + "."};
+            }
+            names.emplace_back("replay");
+        }
+
+        const clock::time_point start = clock::now() + std::chrono::milliseconds(100);
+        const clock::time_point end = start + std::chrono::seconds(opt.duration);
+        const std::chrono::nanoseconds interval = opt.rps > 0.0
+            ? std::chrono::nanoseconds(static_cast<int64_t>(1e9 / opt.rps))
+            : std::chrono::nanoseconds(0);
+
+        std::atomic<uint64_t> next{0};
+        std::atomic<uint64_t> unique{0};
+
+        // the job for a slot, or nothing once the run is over
+        const auto make_job = [&](const uint64_t slot) -> std::optional<job> {
+            if (!replay.empty()) {
+                if (slot >= replay.size()) {
+                    return std::nullopt;
+                }
+
+                const auto offset = std::chrono::duration<double, std::milli>(static_cast<double>(replay[slot].first - replay.front().first) / opt.speed);
+                return job{
+                    .scenario = 0,
+                    .method = "GET",
+                    .target = replay[slot].second,
+                    .headers = {},
+                    .body = {},
+                    .intended = start + std::chrono::duration_cast<clock::duration>(offset),
+                };
+            }
+
+            const clock::time_point intended = interval.count() > 0 ? start + interval * static_cast<int64_t>(slot) : clock::now();
+            if (intended >= end || (interval.count() == 0 && clock::now() >= end)) {
+                return std::nullopt;
+            }
+
+            double pick = static_cast<double>(mix_hash(slot) >> 11) / static_cast<double>(1ULL << 53) * total_weight;
+            std::size_t scenario{0};
+            while (scenario + 1 < templates.size() && pick >= templates[scenario].weight) {
+                pick -= templates[scenario].weight;
+                ++scenario;
+            }
+
+            const request_template& t = templates[scenario];
+            job j{
+                .scenario = scenario,
+                .method = t.method,
+                .target = t.target,
+                .headers = t.headers,
+                .body = t.body,
+                .intended = intended,
+            };
+
+            // creating the same page or file twice fails, so every create gets its own location
+            if (t.name == "create_page") {
+                j.idempotent = false;
+                j.body = replace_json_string(j.body, "page", "/load/new/" + std::to_string(unique.fetch_add(1)) + "-" + std::to_string(getpid()));
+            } else if (t.name == "upload_file") {
+                j.idempotent = false;
+                j.body = replace_json_string(j.body, "endpoint", "/load/file/" + std::to_string(unique.fetch_add(1)) + "-" + std::to_string(getpid()));
+            } else if (t.name == "get_page" && opt.seed_pages != 0) {
+                j.body = replace_json_string(j.body, "page", "/load/" + std::to_string(mix_hash(slot + 1) % opt.seed_pages));
+            }
+
+            return j;
+        };
+
+        std::mutex samples_mutex{};
+        std::vector<sample> samples{};
+
+        std::vector<std::thread> threads{};
+        for (std::size_t i{0}; i < std::max<std::size_t>(1, opt.concurrency); ++i) {
+            threads.emplace_back([&]() {
+                connection c{opt};
+                std::vector<sample> local{};
+
+                while (true) {
+                    const auto j = make_job(next.fetch_add(1));
+                    if (!j) {
+                        break;
+                    }
+
+                    std::this_thread::sleep_until(j->intended);
+                    const int status = c.round_trip(*j);
+                    const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - j->intended);
+
+                    local.push_back(sample{
+                        .scenario = j->scenario,
+                        .status = status,
+                        .latency_us = static_cast<uint64_t>(std::max<int64_t>(0, latency.count())),
+                    });
+                }
+
+                std::lock_guard lock{samples_mutex};
+                samples.insert(samples.end(), local.begin(), local.end());
+            });
+        }
+
+        for (auto& it : threads) {
+            it.join();
+        }
+
+        const double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        report(names, samples, elapsed, replay.empty() ? opt.rps : 0.0);
+
+        return samples.empty() ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    void print_help() {
+        std::cout << "webber_load [options]\n";
+        std::cout << "  -h, --help               Display help information\n";
+        std::cout << "  --host <host>            The host webber listens on (default 127.0.0.1)\n";
+        std::cout << "  --port <port>            The port webber listens on (default 8080)\n";
+        std::cout << "  --templates <dir>        The directory with the .http request templates (default ./http)\n";
+        std::cout << "  --mix <name=weight,...>  The scenario mix (default get_page=70,user_exists=20,create_page=5,upload_file=5)\n";
+        std::cout << "  --rps <n>                The target request rate, 0 for as fast as possible (default 100)\n";
+        std::cout << "  --concurrency <n>        The number of connections (default 16)\n";
+        std::cout << "  --duration <seconds>     How long to run the scenario mix (default 10)\n";
+        std::cout << "  --timeout <seconds>      Socket timeout per request (default 30)\n";
+        std::cout << "  --username <name>        Replaces the username in the templates\n";
+        std::cout << "  --key <key>              Replaces the key in the templates\n";
+        std::cout << "  --seed-pages <n>         Create n pages under /load/ first, and have get_page read them\n";
+        std::cout << "  --replay <access log>    Replay the endpoints of an access log instead of the mix\n";
+        std::cout << "  --speed <factor>         Replay speed, 2 replays twice as fast (default 1)\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    webber::load::options opt{};
+    limhamn::argument_manager::argument_manager arg{argc, argv};
+
+    const auto value = [](limhamn::argument_manager::collection& c, const std::string& flag) -> std::string {
+        if (c.arguments.size() <= 1) {
+            std::cerr << "The " << flag << " flag requires a value to be specified.\n";
+            std::exit(EXIT_FAILURE);
+        }
+
+        return c.arguments.at(++c.index);
+    };
+
+    arg.push_back("-h|--help|/h|/help|help", [](const limhamn::argument_manager::collection& c) {webber::load::print_help(); std::exit(EXIT_SUCCESS);});
+    arg.push_back("--host", [&](limhamn::argument_manager::collection& c) {opt.host = value(c, "--host");});
+    arg.push_back("--port", [&](limhamn::argument_manager::collection& c) {opt.port = value(c, "--port");});
+    arg.push_back("--templates", [&](limhamn::argument_manager::collection& c) {opt.template_directory = value(c, "--templates");});
+    arg.push_back("--mix", [&](limhamn::argument_manager::collection& c) {opt.mix = value(c, "--mix");});
+    arg.push_back("--rps", [&](limhamn::argument_manager::collection& c) {opt.rps = std::stod(value(c, "--rps"));});
+    arg.push_back("--concurrency", [&](limhamn::argument_manager::collection& c) {opt.concurrency = std::stoull(value(c, "--concurrency"));});
+    arg.push_back("--duration", [&](limhamn::argument_manager::collection& c) {opt.duration = std::stoll(value(c, "--duration"));});
+    arg.push_back("--timeout", [&](limhamn::argument_manager::collection& c) {opt.timeout = std::stoll(value(c, "--timeout"));});
+    arg.push_back("--username", [&](limhamn::argument_manager::collection& c) {opt.username = value(c, "--username");});
+    arg.push_back("--key", [&](limhamn::argument_manager::collection& c) {opt.key = value(c, "--key");});
+    arg.push_back("--seed-pages", [&](limhamn::argument_manager::collection& c) {opt.seed_pages = std::stoull(value(c, "--seed-pages"));});
+    arg.push_back("--replay", [&](limhamn::argument_manager::collection& c) {opt.replay_file = value(c, "--replay");});
+    arg.push_back("--speed", [&](limhamn::argument_manager::collection& c) {opt.speed = std::stod(value(c, "--speed"));});
+    arg.execute([](const std::string& arg) {
+        std::cerr << "unknown argument: " << arg << "\n";
+        std::exit(EXIT_FAILURE);
+    });
+
+    if (opt.speed <= 0.0) {
+        std::cerr << "The replay speed must be greater than 0.\n";
+        return EXIT_FAILURE;
+    }
+
+    try {
+        return webber::load::run(opt);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+}